@@ -5,6 +5,8 @@
 
 #include "LanguageDefinition.h"
 
+#include <time.h>
+
 #define TEST_EXPRESSIONS  1
 #define TEST_DECLARATIONS 1
 #define TEST_STATEMENTS   1
@@ -14,6 +16,22 @@
 #define PRINT_TREES 0
 #define PRINT_COLORED_TREES 1
 
+#define MEMOIZE 0
+#define USE_AST_ARENA 0
+#define DEFER_LISTENERS 0
+
+#define BENCHMARK_LANGUAGE_DEFINITION 0
+#define BENCHMARK_ITERATIONS 100
+
+// Set BENCHMARK_AST_ROLLBACK to time rolling back AST nodes of parents with more and more children,
+#define BENCHMARK_AST_ROLLBACK 0
+
+// Set ANALYZE_GRAMMAR to log the performance lints of the language (see NCC_analyzeGrammar()),
+#define ANALYZE_GRAMMAR 0
+
+// Set OPTIMIZE_RULES to inline the small listener-free rules of the language (see NCC_optimizeRules()),
+#define OPTIMIZE_RULES 0
+
 typedef struct PrettifierData {
     struct NString outString;
     struct NVector colorStack; // const char*
@@ -147,7 +165,11 @@ static void test(struct NCC* ncc, const char* code) {
 
         // Cleanup,
         NString.destroy(&treeString);
+        #if USE_AST_ARENA
+        NCC_clearASTArena(ncc);
+        #else
         NCC_deleteASTNode(&tree, 0);
+        #endif
     }
     int32_t codeLength = NCString.length(code);
     if (matched && matchingResult.matchLength == codeLength) {
@@ -158,14 +180,116 @@ static void test(struct NCC* ncc, const char* code) {
     NLOGI("", "");
 }
 
+#if BENCHMARK_LANGUAGE_DEFINITION
+// Measures the time defineLanguage() takes, averaged over many iterations. That's the time needed
+// to parse every rule text into a rule tree and compile it. Then measures loading the same rules
+// from a precompiled grammar (see NCC_serializeGrammar()), which skips the parsing,
+static void benchmarkLanguageDefinition() {
+
+    struct NByteVector grammarData;
+    NByteVector.initialize(&grammarData, 0);
+
+    clock_t start = clock();
+    for (int32_t i=0; i<BENCHMARK_ITERATIONS; i++) {
+        struct NCC ncc;
+        NCC_initializeNCC(&ncc);
+        defineLanguage(&ncc);
+        if (!i) NCC_serializeGrammar(&ncc, &grammarData);
+        NCC_destroyNCC(&ncc);
+    }
+    clock_t end = clock();
+    int32_t microSeconds = (int32_t) ((end - start) * 1000000 / CLOCKS_PER_SEC / BENCHMARK_ITERATIONS);
+    NLOGI("benchmarkLanguageDefinition()", "defineLanguage() took %s%d%s microseconds on average (%d iterations)", NTCOLOR(HIGHLIGHT), microSeconds, NTCOLOR(STREAM_DEFAULT), BENCHMARK_ITERATIONS);
+
+    start = clock();
+    for (int32_t i=0; i<BENCHMARK_ITERATIONS; i++) {
+        struct NCC ncc;
+        NCC_initializeNCC(&ncc);
+        NCC_deserializeGrammar(&ncc, grammarData.objects, NByteVector.size(&grammarData));
+        NCC_destroyNCC(&ncc);
+    }
+    end = clock();
+    microSeconds = (int32_t) ((end - start) * 1000000 / CLOCKS_PER_SEC / BENCHMARK_ITERATIONS);
+    NLOGI("benchmarkLanguageDefinition()", "NCC_deserializeGrammar() took %s%d%s microseconds on average (%s%d%s bytes)", NTCOLOR(HIGHLIGHT), microSeconds, NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), NByteVector.size(&grammarData), NTCOLOR(STREAM_DEFAULT));
+    NLOGI("", "");
+
+    NByteVector.destroy(&grammarData);
+}
+#endif
+
+#if BENCHMARK_AST_ROLLBACK
+// Matches a list of N items, where every item is first matched by the wrong or side, then rolled
+// back. Each rolled back item is the last of N children of the list node. Rolling back takes the
+// same time per item however long the list is (see removeChildNode() in NCC.c). Long repeats need
+// the stackless engine,
+static void benchmarkASTRollback() {
+
+    struct NCC ncc;
+    NCC_initializeNCC(&ncc);
+    ncc.matchingEngine = NCC_MatchingEngine.STACKLESS;
+    NCC_RuleData ruleData;
+    NCC_initializeRuleData(&ruleData, "", "", NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode);
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "item", "a-z 0-9"));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "list", "{{${item}x,} | {${item}y,}}^*"));
+    NCC_destroyRuleData(&ruleData);
+
+    struct NString text;
+    NString.initialize(&text, "");
+    int32_t childrenCounts[] = { 4000, 16000, 64000, 128000 };
+    for (int32_t i=0, itemsCount=0; i<4; i++) {
+        for (; itemsCount<childrenCounts[i]; itemsCount++) NString.append(&text, "a1y,");
+
+        NCC_MatchingResult matchingResult;
+        NCC_ASTNode_Data tree;
+        clock_t start = clock();
+        boolean matched = NCC_match(&ncc, NCC_getRule(&ncc, "list"), NString.get(&text), &matchingResult, &tree);
+        clock_t end = clock();
+        if (matched && tree.node) NCC_deleteASTNode(&tree, 0);
+
+        int32_t microSeconds = (int32_t) ((end - start) * 1000000 / CLOCKS_PER_SEC);
+        NLOGI("benchmarkASTRollback()", "%s%d%s children: %s%d%s microseconds, %s%d%s nanoseconds per child", NTCOLOR(HIGHLIGHT), itemsCount, NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), microSeconds, NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), (int32_t) (microSeconds * 1000LL / itemsCount), NTCOLOR(STREAM_DEFAULT));
+    }
+    NLOGI("", "");
+
+    NString.destroy(&text);
+    NCC_destroyNCC(&ncc);
+}
+#endif
+
+#if ANALYZE_GRAMMAR
+static void analyzeGrammar(struct NCC* ncc) {
+    struct NString report;
+    NString.initialize(&report, "");
+    NCC_analyzeGrammar(ncc, &report);
+    NLOGI("analyzeGrammar()", "%s", NString.get(&report));
+    NString.destroy(&report);
+}
+#endif
+
 void NMain() {
 
     NSystemUtils.logI("", "besm Allah :)\n\n");
 
+    #if BENCHMARK_LANGUAGE_DEFINITION
+    benchmarkLanguageDefinition();
+    #endif
+    #if BENCHMARK_AST_ROLLBACK
+    benchmarkASTRollback();
+    #endif
+
     // Language definition,
     struct NCC ncc;
     NCC_initializeNCC(&ncc);
+    ncc.memoize = MEMOIZE;
+    ncc.useASTArena = USE_AST_ARENA;
+    ncc.deferListeners = DEFER_LISTENERS;
     defineLanguage(&ncc);
+    #if OPTIMIZE_RULES
+    NCC_optimizeRules(&ncc);
+    #endif
+    #if ANALYZE_GRAMMAR
+    analyzeGrammar(&ncc);
+    #endif
 
     // Test,
     #if TEST_EXPRESSIONS
@@ -7,7 +7,10 @@
 static boolean printListener(struct NCC_MatchingData* matchingData) {
     NLOGI("HelloCC", "ruleName: %s", NString.get(&matchingData->node.rule->ruleName));
     NLOGI("HelloCC", "        Match length: %s%d%s", NTCOLOR(HIGHLIGHT), matchingData->matchLength, NTCOLOR(STREAM_DEFAULT));
-    NLOGI("HelloCC", "        Matched text: %s%s%s", NTCOLOR(HIGHLIGHT), matchingData->matchedText, NTCOLOR(STREAM_DEFAULT));
+    struct NString matchedText;
+    NString.initialize(&matchedText, "");
+    NLOGI("HelloCC", "        Matched text: %s%s%s", NTCOLOR(HIGHLIGHT), NCC_getMatchedText(matchingData, &matchedText), NTCOLOR(STREAM_DEFAULT));
+    NString.destroy(&matchedText);
     return True;
 }
 
@@ -94,6 +97,7 @@ void defineLanguage(struct NCC* ncc) {
     NCC_initializeRuleData(&rdd.pushingRuleData, "", "", NCC_createASTNode, NCC_deleteASTNode,       NCC_matchASTNode);
     NCC_initializeRuleData(&rdd.  printRuleData, "", "",                 0,                 0,          printListener);
     NCC_initializeRuleData(&rdd.specialRuleData, "", "",                 0,                 0, rejectingPrintListener);
+    rdd.specialRuleData.eagerListeners = True; // Rejects matches, so it can't be deferred.
 
     // =====================================
     // Lexical rules,
@@ -57,10 +57,24 @@ void assert(struct NCC* ncc, const char*ruleName, const char* ruleText, const ch
 boolean printListener(NCC_MatchingData* matchingData) {
     NLOGI("HelloCC", "ruleName: %s", NString.get(&matchingData->node.rule->ruleName));
     NLOGI("HelloCC", "        Match length: %s%d%s", NTCOLOR(HIGHLIGHT), matchingData->matchLength, NTCOLOR(STREAM_DEFAULT));
-    NLOGI("HelloCC", "        Matched text: %s%s%s", NTCOLOR(HIGHLIGHT), matchingData->matchedText, NTCOLOR(STREAM_DEFAULT));
+    struct NString matchedText;
+    NString.initialize(&matchedText, "");
+    NLOGI("HelloCC", "        Matched text: %s%s%s", NTCOLOR(HIGHLIGHT), NCC_getMatchedText(matchingData, &matchedText), NTCOLOR(STREAM_DEFAULT));
+    NString.destroy(&matchedText);
     return True;
 }
 
+// Adds white-space, identifier and product rules. The identifier and product rules create AST nodes
+// using the given listeners,
+void addProductRules(struct NCC* ncc, NCC_createASTNodeListener createListener, NCC_deleteASTNodeListener deleteListener, NCC_ruleMatchListener matchListener) {
+    NCC_RuleData ruleData;
+    NCC_initializeRuleData(&ruleData, "", "", 0, 0, 0);
+    NCC_addRule(ncc, ruleData.set(&ruleData, ""          , "{\\ |\\\t|\r|\n}^*"                         )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(ncc, ruleData.set(&ruleData, "identifier", "a-z|A-Z|_ {a-z|A-Z|_|0-9}^*"               )->setListeners(&ruleData, createListener, deleteListener, matchListener));
+    NCC_addRule(ncc, ruleData.set(&ruleData, "product"   , "${identifier} {${} \\* ${} ${identifier}}^*")->setListeners(&ruleData, createListener, deleteListener, matchListener));
+    NCC_destroyRuleData(&ruleData);
+}
+
 //////////////////////////////////////
 // Conditional acceptance test
 //////////////////////////////////////
@@ -149,6 +163,23 @@ boolean validateAssignmentListener(NCC_MatchingData* matchingData) {
     return declared;
 }
 
+boolean evenLengthListener(NCC_MatchingData* matchingData) {
+    if (matchingData->matchLength & 1) return False;
+    return NCC_matchASTNode(matchingData);
+}
+
+boolean terminatingListener(NCC_MatchingData* matchingData) {
+    struct NString matchedText;
+    NString.initialize(&matchedText, "");
+    boolean stop = NCString.equals(NCC_getMatchedText(matchingData, &matchedText), "stop");
+    NString.destroy(&matchedText);
+    if (stop) {
+        matchingData->terminate = True;
+        return False;
+    }
+    return NCC_matchASTNode(matchingData);
+}
+
 //////////////////////////////////////
 // Tests
 //////////////////////////////////////
@@ -188,6 +219,9 @@ void NMain() {
     assert(0, 0, "ab{cd}|{ef}gh", "abgh", False, 2, False);
     assert(0, 0, "a{a|b}", "ab", True, 2, False);
     assert(0, 0, "a{b|c}d", "abf", False, 2, False);
+    assert(0, 0, "{x}|{xy}|{q}y", "xy", True, 2, False);                          // All the branches count for the longest whole match.
+    assert(0, 0, "{ab}|{a}|{abc}cd", "abcd", True, 4, False);
+    assert(0, 0, "{ab}|{a}|{abc}cd", "abce", False, 3, False);
 
     // ^*
     assert(0,           0, "a^*bc", "abc", True, 3, False);
@@ -214,6 +248,10 @@ void NMain() {
     assert(0, 0, "*a*b*c*", "__a__c__", False, 8, False);
     assert(0, 0, "*XYZ", "abcdefgXYZ", True, 10, False);
     assert(0, 0, "{*}XYZ", "abcdefgXYZ", False, 10, False);
+    assert(0, 0, "*XYZ", "abcdefgXY", False, 9, False);
+    assert(0, 0, "*abcab", "ababcabcab", True, 7, False);
+    assert(0, 0, "*{X|Y}Z", "abcYXZ", True, 6, False);
+    assert(0, 0, "*{XY|Z}W", "abcXYW", True, 6, False);
 
     // General test-cases,
     assert(0, 0, "{a-z|A-Z}{a-z|A-Z|0-9}^*", "myVariable3", True, 11, False);
@@ -233,6 +271,25 @@ void NMain() {
     assert(&ncc, "ContainingOptional", "${Optional}${Mandatory}", "xyz", True, 3, False);
     NCC_destroyNCC(&ncc);
 
+    // Long literals are compared a word at a time, but never past the end of the text,
+    NCC_initializeNCC(&ncc);
+    assert(&ncc, "LongLiterals"     , "besmAllahAlrahmanAlraheem", "besmAllahAlrahmanAlraheem", True, 25, False);
+    assert(&ncc, "LastWordMismatch" , "besmAllahAlrahmanAlraheem", "besmAllahAlrahmanAlraheeM", False, 0, False);
+    assert(&ncc, "TruncatedText"    , "besmAllahAlrahmanAlraheem", "besmAllahAlrahman", False, 0, False);
+    assert(&ncc, "ShortLiteralsAtEnd", "abc{d|e}", "abce", True, 4, False);
+    NCC_destroyNCC(&ncc);
+
+    // Character classes. Ors of single characters are folded into classes, and class escapes are
+    // classes to begin with,
+    NCC_initializeNCC(&ncc);
+    assert(&ncc, "FoldedOr"        , "{a-z|A-Z|_} {a-z|A-Z|_|0-9}^*", "_besm1 Allah", True, 6, False);
+    assert(&ncc, "Digits"          , "\\d^*", "2023x", True, 4, False);
+    assert(&ncc, "Words"           , "\\w \\W \\w", "a-b", True, 3, False);
+    assert(&ncc, "NotWhiteSpaces"  , "\\S^* \\s", "besm\t", True, 5, False);
+    assert(&ncc, "NoTerminatingZero", "\\D", "", False, 0, False);
+    assert(&ncc, "EscapedBackslash", "\\\\d", "\\d", True, 2, False);
+    NCC_destroyNCC(&ncc);
+
     NCC_initializeNCC(&ncc);
     assert(&ncc, "Milestone", "", "", True, 0, False);
     assert(&ncc, "123", "123", "123", True, 3, False);
@@ -277,6 +334,10 @@ void NMain() {
     
     assert(&ncc, "unary-operator1", "#{{+}{-}{~}{!} {++}{--} == {+}{-}{~}{!}}", "++", False, 2, False);
     assert(&ncc, "unary-operator2", "#{{+}{-}{~}{!} {++}{--} !=     {++}{--}}", "++", False, 2, False);
+
+    // Literal rules are looked up in a trie, the longest still wins, even if it's a prefix of others,
+    assert(&ncc, "unary-operator3", "#{{+}{-}{~}{!} {++}{--}}", "--", True, 2, False);
+    assert(&ncc, "unary-operator4", "#{{--}{++} {!}{~}{-}{+}}",  "-", True, 1, False);
     NCC_destroyNCC(&ncc);
     
     // Stateful parsing,
@@ -335,6 +396,373 @@ void NMain() {
     NCC_destroyNCC(&ncc);
     NLOGI("", "");
 
+    // Memoization and deferred listeners test. Every test is done 4 times, with and without
+    // memoization, with and without deferring listeners, and should result in the same trees,
+    for (int32_t mode=0; mode<4; mode++) {
+        NCC_initializeNCC(&ncc);
+        ncc.memoize = mode & 1;
+        ncc.deferListeners = mode >> 1;
+        addProductRules(&ncc, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode);
+        NCC_addRule(&ncc, ruleData.set(&ruleData, "sum"       , "${product}"                                       )->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode));
+        NCC_updateRuleText(&ncc, NCC_getRule(&ncc, "sum"), "${product} | {${product} ${} + ${} ${sum}}");
+        NCC_addRule(&ncc, ruleData.set(&ruleData, "evenNumber", "0-9 {0-9}^*"                                      )->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, evenLengthListener));
+        NCC_addRule(&ncc, ruleData.set(&ruleData, "word"      , "a-z {a-z}^*"                                      )->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, terminatingListener));
+        NCC_getRuleData(&ncc, "evenNumber")->eagerListeners = True; // Rejects matches.
+        NCC_getRuleData(&ncc, "word"      )->eagerListeners = True; // Terminates matching.
+        assert(&ncc, "MemoizationTest", "${sum}", "a * b + c * d * e + f", True, 21, True);
+        assert(&ncc, "RejectedMemoizationTest", "{${evenNumber}x} | {${evenNumber}y} | {0-9 {0-9}^* z}", "123z", True, 4, True);
+        assert(&ncc, "RejectedMemoizationTest2", "{${evenNumber}x} | {${evenNumber}y}", "12y", True, 3, True);
+        assert(&ncc, "TerminatedMemoizationTest", "{${word}a} | {${word}b}", "stopb", False, 5, False);
+        NCC_destroyNCC(&ncc);
+        NLOGI("", "");
+    }
+
+    // AST arena test. Generic AST nodes are allocated from the arena and recycled when rolled back,
+    // which should result in the same trees,
+    NCC_initializeNCC(&ncc);
+    ncc.useASTArena = True;
+    addProductRules(&ncc, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode);
+    assert(&ncc, "ArenaTest", "{${product}x} | {${product} ${} y}", "a * b * c y", True, 11, True);
+    assert(&ncc, "ArenaReuseTest", "${product} | ${identifier}", "d * e", True, 5, True);
+    NCC_clearASTArena(&ncc);
+    assert(&ncc, "ArenaClearTest", "${product}", "f * g", True, 5, True);
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // Span-based AST nodes test. Values aren't copied, but should print the same, and should tell
+    // where they are in the text,
+    NCC_initializeNCC(&ncc);
+    addProductRules(&ncc, NCC_createSpanASTNode, NCC_deleteSpanASTNode, NCC_matchSpanASTNode);
+    {
+        const char* text = "a *\n  bc";
+        NCC_MatchingResult matchingResult;
+        NCC_ASTNode_Data treeData;
+        if (NCC_match(&ncc, NCC_getRule(&ncc, "product"), text, &matchingResult, &treeData) && treeData.node) {
+            struct NString treeString;
+            NString.initialize(&treeString, "");
+            NCC_SpanASTTreeToString(treeData.node, 0, &treeString, False);
+            NLOGI(0, "SpanTest:\n%s", NString.get(&treeString));
+            NString.destroy(&treeString);
+
+            int32_t line, column;
+            NCC_SpanASTNode* lastChild = *((NCC_SpanASTNode**) NVector.getLast(&((NCC_SpanASTNode*) treeData.node)->childNodes));
+            NCC_getSpanASTNodeLocation(lastChild, text, &line, &column);
+            if (line!=2 || column!=3) NERROR("HelloCC", "SpanTest: wrong location. Line: %s%d%s, column: %s%d%s", NTCOLOR(HIGHLIGHT), line, NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), column, NTCOLOR(STREAM_DEFAULT));
+            NCC_deleteSpanASTNode(&treeData, 0);
+        } else {
+            NERROR("HelloCC", "SpanTest: match failed");
+        }
+    }
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // Flat AST test. The flat AST should print the same as the node tree of the same match, rolled
+    // back alternatives included,
+    NCC_initializeNCC(&ncc);
+    addProductRules(&ncc, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode);
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "FlatTest"  , "{${product}x} | {${product} ${} y}"         )->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode));
+    {
+        const char* text = "a * b * c y";
+        NCC_MatchingResult matchingResult;
+        NCC_ASTNode_Data treeData;
+        struct NString treeString, flatTreeString;
+        NString.initialize(&treeString, "");
+        NString.initialize(&flatTreeString, "");
+        if (NCC_match(&ncc, NCC_getRule(&ncc, "FlatTest"), text, &matchingResult, &treeData) && treeData.node) {
+            NCC_ASTTreeToString(treeData.node, 0, &treeString, False);
+            NCC_deleteASTNode(&treeData, 0);
+        }
+
+        NCC_FlatAST flatAST;
+        NCC_initializeFlatAST(&flatAST);
+        if (NCC_matchFlat(&ncc, NCC_getRule(&ncc, "FlatTest"), text, &matchingResult, &flatAST) && matchingResult.matchLength==11) {
+            NCC_FlatASTToString(&flatAST, 0, &flatTreeString, False);
+            NLOGI(0, "FlatTest: %d nodes\n%s", flatAST.nodesCount, NString.get(&flatTreeString));
+            if (!NCString.equals(NString.get(&treeString), NString.get(&flatTreeString))) NERROR("HelloCC", "FlatTest: flat AST differs from the node tree:\n%s", NString.get(&treeString));
+        } else {
+            NERROR("HelloCC", "FlatTest: match failed");
+        }
+        NCC_destroyFlatAST(&flatAST);
+        NString.destroy(&treeString);
+        NString.destroy(&flatTreeString);
+    }
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // Lean matching test. Errors are only tracked when lean matches fail, by matching again. Either
+    // way, the same characters should be expected where matching stopped, whatever the engine,
+    int32_t engines[] = { NCC_MatchingEngine.TREE_WALKER, NCC_MatchingEngine.PROGRAM, NCC_MatchingEngine.STACKLESS };
+    for (int32_t mode=0; mode<6; mode++) {
+        NCC_initializeNCC(&ncc);
+        ncc.matchingEngine = engines[mode % 3];
+        ncc.leanMatching = mode >= 3;
+        addProductRules(&ncc, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode);
+        assert(&ncc, "LeanTest", "${product} ${} ;", "a * b;", True, 6, False);
+
+        NCC_MatchingResult matchingResult;
+        struct NString expectedCharacters;
+        NString.initialize(&expectedCharacters, "");
+        if (NCC_match(&ncc, NCC_getRule(&ncc, "LeanTest"), "a * b c;", &matchingResult, 0)) NERROR("HelloCC", "LeanTest: erroneously matched");
+        NCC_getExpectedCharacters(&ncc, &expectedCharacters);
+        NLOGI("HelloCC", "LeanTest: max match length: %s%d%s, expected: %s%s%s at: %s%d%s", NTCOLOR(HIGHLIGHT), ncc.maxMatchLength, NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), NString.get(&expectedCharacters), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), ncc.expectedTextOffset, NTCOLOR(STREAM_DEFAULT));
+        if (ncc.expectedTextOffset != 6 || !NCString.equals(NString.get(&expectedCharacters), "\\x09|\\x0a|\\x0d|\\ |\\*|;")) {
+            NERROR("HelloCC", "LeanTest: wrong expected characters: %s%s%s at: %s%d%s", NTCOLOR(HIGHLIGHT), NString.get(&expectedCharacters), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), ncc.expectedTextOffset, NTCOLOR(STREAM_DEFAULT));
+        }
+        NString.destroy(&expectedCharacters);
+        NCC_destroyNCC(&ncc);
+    }
+    NLOGI("", "");
+
+    // Rule ids test. Rules are numbered in the order they are added, and can be looked up by name or
+    // by id. Enough rules are added to grow the rules table a few times,
+    NCC_initializeNCC(&ncc);
+    {
+        struct NString ruleName;
+        NString.initialize(&ruleName, "");
+        int32_t rulesCount = 300;
+        for (int32_t i=0; i<rulesCount; i++) {
+            NString.set(&ruleName, "rule%d", i);
+            NCC_addRule(&ncc, ruleData.set(&ruleData, NString.get(&ruleName), "a-z")->setListeners(&ruleData, 0, 0, 0));
+        }
+        int32_t firstRuleId = NCC_getRuleData(&ncc, "rule0")->ruleId;
+        for (int32_t i=0; i<rulesCount; i++) {
+            NString.set(&ruleName, "rule%d", i);
+            NCC_Rule* rule = NCC_getRule(&ncc, NString.get(&ruleName));
+            if (!rule || NCC_getRuleById(&ncc, firstRuleId+i) != rule) NERROR("HelloCC", "RuleIdsTest: rule %s%s%s not found by id", NTCOLOR(HIGHLIGHT), NString.get(&ruleName), NTCOLOR(STREAM_DEFAULT));
+        }
+        if (NCC_getRule(&ncc, "rule300") || NCC_getRuleById(&ncc, firstRuleId+rulesCount)) NERROR("HelloCC", "RuleIdsTest: found a rule that wasn't added");
+        NLOGI("HelloCC", "RuleIdsTest: %s%d%s rules", NTCOLOR(HIGHLIGHT), NVector.size(&ncc.rules), NTCOLOR(STREAM_DEFAULT));
+        NString.destroy(&ruleName);
+    }
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // Precompiled grammar test. A grammar loaded from serialized data should match exactly like the
+    // original one, once its listeners are set again,
+    NCC_initializeNCC(&ncc);
+    NCC_addRule(&ncc, ruleData.set(&ruleData, ""          , "{\\ |\\\t|\r|\n}^*"                         )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "identifier", "a-z|A-Z|_ {\\w}^*"                          )->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "if"        , "if"                                         )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "else"      , "else"                                       )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "word"      , "#{{if} {else} {identifier}}"                )->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "comment"   , "/\\**\\*/"                                  )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "GrammarTest", "{${word}|@{comment}|0-9 ${}}^*"            )->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode));
+    {
+        struct NByteVector grammarData;
+        NByteVector.initialize(&grammarData, 0);
+        NCC_serializeGrammar(&ncc, &grammarData);
+
+        struct NCC loadedNCC;
+        NCC_initializeNCC(&loadedNCC);
+        if (NCC_deserializeGrammar(&loadedNCC, grammarData.objects, NByteVector.size(&grammarData))) {
+            const char* listenedRules[] = { "identifier", "word", "GrammarTest" };
+            for (int32_t i=0; i<3; i++) NCC_getRuleData(&loadedNCC, listenedRules[i])->setListeners(NCC_getRuleData(&loadedNCC, listenedRules[i]), NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode);
+
+            const char* text = "if x /* y */ else 1 z";
+            NCC_MatchingResult matchingResult, loadedMatchingResult;
+            NCC_ASTNode_Data treeData, loadedTreeData;
+            struct NString treeString, loadedTreeString;
+            NString.initialize(&treeString, "");
+            NString.initialize(&loadedTreeString, "");
+            if (NCC_match(&ncc, NCC_getRule(&ncc, "GrammarTest"), text, &matchingResult, &treeData) && treeData.node) {
+                NCC_ASTTreeToString(treeData.node, 0, &treeString, False);
+                NCC_deleteASTNode(&treeData, 0);
+            }
+            if (NCC_match(&loadedNCC, NCC_getRule(&loadedNCC, "GrammarTest"), text, &loadedMatchingResult, &loadedTreeData) && loadedTreeData.node) {
+                NCC_ASTTreeToString(loadedTreeData.node, 0, &loadedTreeString, False);
+                NCC_deleteASTNode(&loadedTreeData, 0);
+            }
+            NLOGI("HelloCC", "GrammarTest: %s%d%s bytes, match length: %s%d%s", NTCOLOR(HIGHLIGHT), NByteVector.size(&grammarData), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), loadedMatchingResult.matchLength, NTCOLOR(STREAM_DEFAULT));
+            if (matchingResult.matchLength != 21 || loadedMatchingResult.matchLength != 21 || !NCString.equals(NString.get(&treeString), NString.get(&loadedTreeString))) {
+                NERROR("HelloCC", "GrammarTest: loaded grammar matched differently:\n%s", NString.get(&loadedTreeString));
+            }
+            NString.destroy(&treeString);
+            NString.destroy(&loadedTreeString);
+        } else {
+            NERROR("HelloCC", "GrammarTest: couldn't load the grammar");
+        }
+        NCC_destroyNCC(&loadedNCC);
+
+        // Corrupted data should be rejected. A zero inside a string or at a literal range end would
+        // match the terminating zero of the text. Corrupt the "else" rule name, then the 0-9 range,
+        int32_t dataSize = NByteVector.size(&grammarData);
+        for (int32_t corruption=0; corruption<2; corruption++) {
+            struct NByteVector corruptedData;
+            NByteVector.initialize(&corruptedData, dataSize);
+            NByteVector.resize(&corruptedData, dataSize);
+            NSystemUtils.memcpy(corruptedData.objects, grammarData.objects, dataSize);
+            const char* pattern = corruption ? "09" : "else";
+            int32_t patternLength = NCString.length(pattern);
+            for (int32_t i=0; i<=dataSize-patternLength; i++) {
+                int32_t j=0;
+                while ((j<patternLength) && (corruptedData.objects[i+j] == (uint8_t) pattern[j])) j++;
+                if (j<patternLength) continue;
+                corruptedData.objects[i + (corruption ? 0 : 1)] = 0;
+                break;
+            }
+
+            NCC_initializeNCC(&loadedNCC);
+            int32_t errorsCount = NError.observeErrors();
+            if (NCC_deserializeGrammar(&loadedNCC, corruptedData.objects, dataSize) || NVector.size(&loadedNCC.rules)) {
+                NERROR("HelloCC", "GrammarTest: loaded corrupted data (%s%s%s)", NTCOLOR(HIGHLIGHT), pattern, NTCOLOR(STREAM_DEFAULT));
+            } else if (NError.observeErrors() == errorsCount) {
+                NERROR("HelloCC", "GrammarTest: rejected corrupted data (%s%s%s) without an error", NTCOLOR(HIGHLIGHT), pattern, NTCOLOR(STREAM_DEFAULT));
+            } else {
+                while (NError.observeErrors() > errorsCount) NError.popDestroyAndFreeError();
+            }
+            NCC_destroyNCC(&loadedNCC);
+            NByteVector.destroy(&corruptedData);
+        }
+
+        NByteVector.destroy(&grammarData);
+    }
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // Grammar analysis test. Apart from the first three rules, every rule has a single hazard. The
+    // left recursion of left1 and left2 is reported for both of them,
+    NCC_initializeNCC(&ncc);
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "identifier"       , "a-z {\\w}^*"                  )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "if"               , "if"                          )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "maybe"            , "{q}^*"                       )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "left1"            , "STUB!"                       )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "left2"            , "${left1} x"                  )->setListeners(&ruleData, 0, 0, 0));
+    NCC_updateRuleText(&ncc, NCC_getRule(&ncc, "left1"), "${maybe} ${left2}|y");
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "stub"             , "STUB!"                       )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "nullableRepeat"   , "{${maybe}}^*"                )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "commonPrefix"     , "{abc x}|{abc y}"             )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "orOfRules"        , "${if}|${maybe}|${stub}"      )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "unreachable"      , "{*}xyz"                      )->setListeners(&ruleData, 0, 0, 0));
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "shadowed"         , "#{{identifier} {if}}"        )->setListeners(&ruleData, 0, 0, 0));
+    {
+        struct NString report;
+        NString.initialize(&report, "");
+        int32_t warningsCount = NCC_analyzeGrammar(&ncc, &report);
+        NLOGI("HelloCC", "AnalysisTest: %s%d%s warnings", NTCOLOR(HIGHLIGHT), warningsCount, NTCOLOR(STREAM_DEFAULT));
+        const char* expectedWarnings[] = {
+                "rule \"left1\": left recursive, matching never ends: left1 -> left2 -> left1",
+                "rule \"left2\": left recursive, matching never ends: left2 -> left1 -> left2",
+                "rule \"stub\": still a stub",
+                "rule \"nullableRepeat\": repeated tree (^*) can match nothing",
+                "rule \"commonPrefix\": or branches 1 and 2 share a prefix (rules: 0, characters: 3)",
+                "rule \"orOfRules\": or of rules only, could be the selection #{{if} {maybe} {stub}}",
+                "rule \"unreachable\": anything node (*)",
+                "rule \"shadowed\": selection rule \"if\" can never win, \"identifier\" is attempted first" };
+        int32_t expectedWarningsCount = sizeof(expectedWarnings) / sizeof(const char*);
+        boolean allFound = True;
+        for (int32_t i=0; i<expectedWarningsCount; i++) allFound &= NCString.contains(NString.get(&report), expectedWarnings[i]);
+        if (warningsCount != expectedWarningsCount || !allFound) NERROR("HelloCC", "AnalysisTest: unexpected report:\n%s", NString.get(&report));
+        NString.destroy(&report);
+    }
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // Rule optimization test. Optimized rules should match exactly like the original ones. "either"
+    // is followed by more nodes, so it has to stay isolated, otherwise "xy" would match. "comma" and
+    // "end" end up merged into a single literals node,
+    {
+        const char* rules[][2] = {
+                { ""             , "{\\ }^*"                                                            },
+                { "either"       , "x|{xy}"                                                             },
+                { "comma"        , ","                                                                  },
+                { "empty"        , ""                                                                   },
+                { "end"          , ";"                                                                  },
+                { "item"         , "${either} y|z"                                                      },
+                { "OptimizerTest", "${item} {${} ${comma} ${} ${item}}^* ${empty} @{} ${comma}${end}"   } };
+        struct NCC optimizedNCC;
+        NCC_initializeNCC(&ncc);
+        NCC_initializeNCC(&optimizedNCC);
+        for (int32_t i=0; i<7; i++) {
+            boolean listened = (i >= 5);
+            ruleData.set(&ruleData, rules[i][0], rules[i][1]);
+            ruleData.setListeners(&ruleData, listened ? NCC_createASTNode : 0, listened ? NCC_deleteASTNode : 0, listened ? NCC_matchASTNode : 0);
+            NCC_addRule(&ncc, &ruleData);
+            NCC_addRule(&optimizedNCC, &ruleData);
+        }
+        int32_t inlinedNodesCount = NCC_optimizeRules(&optimizedNCC);
+        NLOGI("HelloCC", "OptimizerTest: %s%d%s inlined substitute nodes", NTCOLOR(HIGHLIGHT), inlinedNodesCount, NTCOLOR(STREAM_DEFAULT));
+        if (inlinedNodesCount != 8) NERROR("HelloCC", "OptimizerTest: expected 8 inlined substitute nodes");
+
+        // Failed matches may report different lengths (see "Rule optimization" in NCC.h),
+        const char* texts[] = { "xyy , xz,xyz  ,;", "xy", "xyy ,", "xyy,:" };
+        for (int32_t i=0; i<4; i++) {
+            NCC_MatchingResult matchingResult, optimizedMatchingResult;
+            NCC_ASTNode_Data treeData, optimizedTreeData;
+            struct NString treeString, optimizedTreeString;
+            NString.initialize(&treeString, "");
+            NString.initialize(&optimizedTreeString, "");
+            boolean matched = NCC_match(&ncc, NCC_getRule(&ncc, "OptimizerTest"), texts[i], &matchingResult, &treeData);
+            if (matched && treeData.node) {
+                NCC_ASTTreeToString(treeData.node, 0, &treeString, False);
+                NCC_deleteASTNode(&treeData, 0);
+            }
+            boolean optimizedMatched = NCC_match(&optimizedNCC, NCC_getRule(&optimizedNCC, "OptimizerTest"), texts[i], &optimizedMatchingResult, &optimizedTreeData);
+            if (optimizedMatched && optimizedTreeData.node) {
+                NCC_ASTTreeToString(optimizedTreeData.node, 0, &optimizedTreeString, False);
+                NCC_deleteASTNode(&optimizedTreeData, 0);
+            }
+            if ((matched != optimizedMatched) || (matched && (matchingResult.matchLength != optimizedMatchingResult.matchLength)) || !NCString.equals(NString.get(&treeString), NString.get(&optimizedTreeString))) {
+                NERROR("HelloCC", "OptimizerTest: optimized rules matched %s%s%s differently:\n%s", NTCOLOR(HIGHLIGHT), texts[i], NTCOLOR(STREAM_DEFAULT), NString.get(&optimizedTreeString));
+            }
+            NString.destroy(&treeString);
+            NString.destroy(&optimizedTreeString);
+        }
+        NCC_destroyNCC(&optimizedNCC);
+    }
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // First-byte dispatch test. Alternatives that can't start at the current character are skipped,
+    // but those that can match nothing (like "maybe") must still be tried,
+    NCC_initializeNCC(&ncc);
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "maybe", "{q}^*")->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode));
+    assert(&ncc, "Dispatch"        , "{x|y|z}^* {a|{b}^*} c", "xyzc", True, 4, False);
+    assert(&ncc, "NullableDispatch", "{${maybe}|x} c", "c", True, 1, False);
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // Matching engines test. The tree walker (reference implementation) should give the same results
+    // as the compiled programs,
+    NCC_initializeNCC(&ncc);
+    ncc.matchingEngine = NCC_MatchingEngine.TREE_WALKER;
+    assert(&ncc, "Or"        , "{ab}|{abc}cdef", "abcdef", True, 6, False);
+    assert(&ncc, "Repeat"    , "{xyz}^*xyz", "xyzxyzxyz", True, 3, False);
+    assert(&ncc, "Anything"  , "/\\**\\*/", "/*besm Allah*/", True, 14, False);
+    assert(&ncc, "Comments"  , "${Anything} {,${Anything}}^*", "/*a*/,/*b*/,/*c*/", True, 17, True);
+    assert(&ncc, "Class"     , "{a-z|_} \\w^*", "_besm1", True, 6, False);
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
+    // The stackless engine should give the same results too, and shouldn't overflow the stack no
+    // matter how deep matching goes (every repetition here is a level deeper),
+    NCC_initializeNCC(&ncc);
+    ncc.matchingEngine = NCC_MatchingEngine.STACKLESS;
+    assert(&ncc, "Or"        , "{ab}|{abc}cdef", "abcdef", True, 6, False);
+    assert(&ncc, "Repeat"    , "{xyz}^*xyz", "xyzxyzxyz", True, 3, False);
+    assert(&ncc, "Anything"  , "/\\**\\*/", "/*besm Allah*/", True, 14, False);
+    assert(&ncc, "Comments"  , "${Anything} {,${Anything}}^*", "/*a*/,/*b*/,/*c*/", True, 17, True);
+    assert(&ncc, "Class"     , "{a-z|_} \\w^*", "_besm1", True, 6, False);
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "item", "a-z {a-z|0-9}^*")->setListeners(&ruleData, 0, 0, 0));
+    int32_t itemsCount = 200000;
+    char* longText = NMALLOC(itemsCount*3+1, "HelloCC.main() longText");
+    for (int32_t i=0; i<itemsCount; i++) NSystemUtils.memcpy(&longText[i*3], "a1,", 3);
+    longText[itemsCount*3] = 0;
+    assert(&ncc, "DeepRepeat", "{${item},}^*", longText, True, itemsCount*3, False);
+    NLOGI("HelloCC", "Peak matching depth: %s%d%s", NTCOLOR(HIGHLIGHT), ncc.peakMatchingDepth, NTCOLOR(STREAM_DEFAULT));
+    NFREE(longText, "HelloCC.main() longText");
+
+    // Every item here is first matched as the wrong or side, whose AST node is rolled back. Rollback
+    // shouldn't get slower as the list node gets more children,
+    NCC_addRule(&ncc, ruleData.set(&ruleData, "wideItem", "a-z {0-9}^*")->setListeners(&ruleData, NCC_createASTNode, NCC_deleteASTNode, NCC_matchASTNode));
+    itemsCount = 100000;
+    longText = NMALLOC(itemsCount*4+1, "HelloCC.main() longText");
+    for (int32_t i=0; i<itemsCount; i++) NSystemUtils.memcpy(&longText[i*4], "a1y,", 4);
+    longText[itemsCount*4] = 0;
+    assert(&ncc, "WideRollBack", "{{${wideItem}x,} | {${wideItem}y,}}^*", longText, True, itemsCount*4, False);
+    NFREE(longText, "HelloCC.main() longText");
+    NCC_destroyNCC(&ncc);
+    NLOGI("", "");
+
     // Clean up,
     NVector.destroy(&declaredVariables);
     NCC_destroyRuleData(&ruleData);
@@ -28,6 +28,7 @@
 // Node types:
 //   Literals:        abc
 //   Literal range:   a-z
+//   Character class: \d \w \s \D \W \S
 //   Or:              |
 //   Repeat:          ^*
 //   Sub-rule:        {ruleText}
@@ -47,6 +48,7 @@
 // ║ Literals      │ for            │ for                                                       ║
 // ║ Literal range │ smallLetter    │ a-z                                                       ║
 // ║ Or            │ letter         │ a-z|A-Z                                                   ║
+// ║ Class         │ digit          │ \d                                                        ║
 // ║ Repeat        │ name           │ A-Za-z^*  // A name always starts with a capital letter.  ║
 // ║ Sub-rule      │ namesList      │ {A-Za-z^*} {,A-Za-z^*}^*                                  ║
 // ║ Substitute    │ integer        │ 0|{1-90-9^*}                                              ║
@@ -116,6 +118,27 @@
 // 2 characters long while the rhs is 3. This is because selecting the lhs will result in the entire
 // tree matching with length 6, while choosing the rhs will only match 3 characters.
 //
+// A chain of ors, like a|{bc}|{de}|f, makes a single or node with all the alternatives as branches.
+// The longest match of the entire tree is selected among all of them, with ties going to the
+// earlier branch. The rest of the tree is matched only once for every distinct branch match length.
+//
+// Character classes:
+// ------------------
+// When both sides of an or node match a single character (literals, literal ranges or other
+// character classes), as in:
+//    a-z|A-Z|_
+// the or node is replaced with a character class node that tests the character against a 256 bits
+// set in a single lookup. The same goes for sub-rules that contain nothing but a character class,
+// like {a-z|_}. This is transparent, the matching results are the same. Common classes can also be
+// written directly using escapes:
+//    \d: digits (0-9).
+//    \w: word characters (a-z, A-Z, 0-9 and _).
+//    \s: whitespaces (space, \t, \n, \v, \f and \r).
+//    \D, \W and \S: any character (but the terminating zero) that is not in \d, \w and \s
+//    respectively.
+// Note that, as a result, escaping d, w, s, D, W or S no longer yields the letter itself. Also,
+// class escapes can't be used as the ends of literal ranges.
+//
 // Wildcard nodes:
 // ---------------
 // Repeat and Anything nodes are wildcard nodes. Anything nodes (*) will match anything until the
@@ -215,6 +238,121 @@
 // create two rules with the exact same definition but different names, just so that one of them
 // creates nodes and the other doesn't.
 //
+// Memoization:
+// ------------
+// Or nodes, selection nodes and repeats can end up matching the same rule at the same position
+// many times. For example:
+//    conditional-expression = ${logical-or-expression} | {${logical-or-expression} ? ...}
+// matches logical-or-expression twice, and every level of a 20 levels deep expression grammar does
+// the same, which makes matching time grow exponentially with the nesting depth. Setting
+// "ncc->memoize" to True turns on packrat parsing. The outcome of every substitute node match
+// (success, match length and the AST listeners calls it made) is cached by (rule, text position).
+// Later attempts to match the same rule at the same position return the cached outcome. If it was
+// a successful match, the AST listeners calls are replayed (create AST node, then the children,
+// then the match listener) to construct an identical AST.
+//
+// Memoization is opt-in because it assumes that the listeners are deterministic. The outcome of
+// a rule match listener (accept/reject and the match length it sets) should only depend on the
+// matched text and the AST node. Listeners that depend on state collected during matching (like a
+// symbol table) shouldn't be used with memoization. Matches that were terminated by a listener are
+// never cached.
+//
+// Deferred listeners:
+// -------------------
+// AST listeners are normally fired while matching, including for the or sides and selection
+// attempts that end up discarded, which are then undone using the delete listeners. Setting
+// "ncc->deferListeners" to True makes matching record the successful rule matches instead (the
+// same records memoization replays), and fire the listeners only once the whole match operation
+// succeeds, for the rule matches that made it into the final match. This removes most AST nodes
+// creation/deletion churn in grammars with heavy alternation.
+//
+// Since deferred match listeners are fired after matching, their return values, match lengths and
+// termination requests are ignored. Rules whose match listeners may reject a match, change its
+// length or terminate the matching should set "eagerListeners" in their rule data. Their listeners
+// are fired while matching (and so are the listeners of the rules in their trees, so that they see
+// their AST nodes) to confirm the match, then undone and fired again once the match operation
+// succeeds. Same as memoization, listeners are assumed to be deterministic. Listeners that depend
+// on state collected during matching (like a symbol table) shouldn't be deferred.
+//
+// AST arena:
+// ----------
+// The generic AST listeners (NCC_createASTNode/NCC_deleteASTNode) allocate every node, its name,
+// value and children vector separately, and backtracking deletes many of them right after they are
+// created. Setting "ncc->useASTArena" to True makes NCC allocate the generic nodes from an arena
+// instead. Nodes are allocated in blocks, and deleted nodes (like those rolled back when an or side
+// or a selection attempt fails) go to a free list, keeping their name, value and children buffers,
+// to be reused by the next nodes created. Once the buffers have grown, creating a node allocates
+// nothing at all.
+//
+// A tree created from the arena can still be deleted using NCC_deleteASTNode(), but it's faster to
+// call NCC_clearASTArena(), which recycles all the arena nodes in one go. All trees created since
+// the last clear become invalid, so only clear when done with all of them. Nodes created by other
+// listeners aren't affected, and should still be deleted using their delete listeners.
+//
+// Lean matching:
+// --------------
+// To report errors, matching keeps track of the nodes being matched, the names of the rules that
+// lead to the longest match (maxMatchRuleStack) and the characters that were expected where
+// matching stopped (NCC_getExpectedCharacters()). All of that is paid for even when the text
+// matches and there is nothing to report. Setting "ncc->leanMatching" to True skips it. Matches
+// that fail are then matched again with error tracking, so errors are still reported. This way,
+// successful matches pay nothing for error reporting, while failing ones take about twice as long.
+// Note that the listeners are fired again during the second attempt.
+//
+// Precompiled grammars:
+// ---------------------
+// Defining a language parses every rule text into a rule tree, every time the program starts.
+// NCC_serializeGrammar() saves the rules of an NCC (names, texts, trees and eager listener flags)
+// as a versioned block of bytes, and NCC_deserializeGrammar() creates the same rules from it without
+// parsing any rule text. NCC_saveGrammar() and NCC_loadGrammar() do the same through a file.
+//
+// The data holds no pointers, only offsets from its beginning and rule ids, and is only read, never
+// modified or kept. Any memory block holding it works, whether read from a file, memory-mapped or
+// compiled into the program as an array. Since functions can't be saved, listeners aren't. Once
+// loaded, set them again by rule name:
+//    NCC_getRuleData(ncc, "identifier")->setListeners(...);
+// The data is bound to the NCC version that saved it and to the byte order of the machine. Data
+// that doesn't match is rejected. In that case, define the language from the rule texts again.
+//
+// Grammar analysis:
+// -----------------
+// NCC_analyzeGrammar() reports the patterns that make matching slow, or make parts of a grammar
+// unreachable, one warning per line:
+//    => Left recursion. A rule that can refer to itself before consuming anything never stops
+//       matching.
+//    => Rules whose text is still "STUB!".
+//    => Repeated trees that can match nothing. Repeating stops at their first empty match (see
+//       "Repeat nodes" above).
+//    => Or branches that start with the same rules or characters, which are matched again for every
+//       branch.
+//    => Ors of rules only, which could be selections.
+//    => Anything nodes with nothing after them in their sub-rules, like {*}xyz (see "Wildcard
+//       nodes" above).
+//    => Selection rules that can never win, literal rules that an earlier rule always matches as
+//       well (ties go to the earlier rule).
+// It also estimates the worst-case backtracking factor of every rule, that is, how many node
+// matches a single attempt of the rule can take per matched character without memoization. Nested
+// ors and rules matched several times by every level of a grammar multiply it. Rules estimated
+// beyond a million are reported. Run it on a language definition (in a test, or in CI) to catch the
+// changes that blow up matching time.
+//
+// Rule optimization:
+// ------------------
+// NCC_optimizeRules() rewrites the rule trees once the language is defined:
+//    => Rules that have no listeners (like punctuators, or rules that only skip white spaces) are
+//       inlined where they're used, instead of being matched through substitute nodes. Silent uses
+//       (@{...}) are only inlined if the rule matches no other rules. Rules beyond a few nodes, and
+//       recursive uses, are left alone.
+//    => Sub-rules are replaced by their contents, unless they are followed by other nodes and
+//       contain or, repeat or anything nodes (whose matching depends on what follows them).
+//    => Consecutive literals, like the ones split apart before or and repeat nodes, or brought
+//       together by the above, are merged into a single literals node.
+// Matching results and ASTs are exactly the same. Only error reporting is affected. Inlined rules
+// no longer appear in maxMatchRuleStack, and failed matches may report shorter maxMatchLengths and
+// different expected characters, since merged literals fail as a whole (see "Lean matching"
+// above). Inlined rules can't be updated anymore, so optimize after all the rules (and stubs) are
+// final. Saved grammars keep the optimized trees.
+//
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // NCC
@@ -223,27 +361,42 @@
 typedef struct NCC_RuleData NCC_RuleData;
 typedef struct NCC_Rule NCC_Rule;
 
-// We define 5 different stacks to be used while matching. That's the maximum number of stack we
-// needed to exist simultaneously so far,
-#define NCC_AST_NODE_STACKS_COUNT 5
-// Take the or node for instance:
-//    => astNodeStacks[0]: the main stack on which all nodes push their ASTs.
-//    => astNodeStacks[1]: rhs of the or node.
-//    => astNodeStacks[2]: lhs of the or node.
-//    => astNodeStacks[3]: the tree following the rhs of the or node.
-//    => astNodeStacks[4]: the tree following the lhs of the or node.
-//
-// While trying to find the longest match, the or node will try to match multiple paths, and will
-// only push some of them to stack 0. We could have used fewer stacks, but it really makes no
-// difference performance or memory wise, and separating them makes the logic much easier to
-// understand.
-//
-// After matching, the matched AST tree should always reside in astNodeStacks[0]. Before returning,
-// node Matching methods always restore the stacks they used to their previous state before
-// matching. astNodeStacks[0] is the only one that changes. matchRuleTree() swaps astNodeStacks[0]
-// with the one specified in the arguments, performs the match then restores the original order.
-// This way, node matching methods needn't worry about which stack to use, and can always rely on
-// index 0 being the main stack.
+// While matching, AST nodes are pushed to a single stack (astNodeStack). Every sub-match starts
+// at a mark (the stack size when it began) and owns the entries pushed above it:
+//    => Accepting a sub-match costs nothing. Its entries are already where they should be, right
+//       after the ones accepted before it.
+//    => Discarding a sub-match truncates the stack back to its mark, calling the delete listeners
+//       of the popped entries.
+//
+// Following trees are matched right on top of the entries of what precedes them, so that entries
+// always appear in matching order. The only time entries are moved is when the or and selection
+// nodes find a longer match after a shorter one. The shorter one lies below, so it's discarded
+// and the longer one is moved down in its place. Substitute nodes that create AST nodes replace
+// the entries of their rules with their new nodes as soon as the rules matches are confirmed,
+// before matching the following trees.
+//
+// After matching, the matched AST tree resides in astNodeStack.
+
+// Every rule tree is also compiled into a program, a contiguous array of instructions, once the rule
+// is added or updated. The matching engine determines which of them is used while matching:
+//    => TREE_WALKER: walks the rule tree nodes, one function call per node. Kept as a reference
+//       implementation.
+//    => PROGRAM: interprets the compiled program. Consecutive literals, literal ranges and
+//       character classes are matched in a tight loop, and only or, sub-rule, repeat, anything,
+//       substitute and selection instructions call out to the same matching logic used by the tree
+//       walker. Before matching, programs are analyzed to find the characters each of them can
+//       start with, so that or sides, repeat bodies and substitute/selection attempts that can't
+//       match at the current character are skipped without being entered.
+//    => STACKLESS: interprets the compiled program as well, but never recurses. Every node being
+//       matched keeps its state in a frame on a growable heap stack (matchingFrames) instead of the
+//       native call stack, so matching depth (long repeats, deeply nested rules) is only bounded by
+//       the available memory. Performs on par with PROGRAM. Note that listeners still run on the
+//       native stack. The depth reached is reported in peakMatchingDepth.
+// All engines produce identical results.
+struct NCC_MatchingEngine {
+    int32_t TREE_WALKER, PROGRAM, STACKLESS;
+};
+extern const struct NCC_MatchingEngine NCC_MatchingEngine;
 
 
 // We won't create a typedef for NCC. Maybe at some point we'll declare a global interface name NCC
@@ -252,18 +405,50 @@ struct NCC {
     void* extraData;                  // User defined data. Can be handy, use for your own purposes.
 
     struct NVector rules;             // A vector of pointers to rules, not rules. This way, even if the vector expands, they still point to the original rules.
-    struct NCC_Rule* matchRule;       // Necessary to allow rules being matched to appear in AST trees.
-    struct NVector* astNodeStacks[NCC_AST_NODE_STACKS_COUNT]; // NCC_ASTNode_Data. To be able to discard nodes that are not needed.
+                                      // Indexed by rule id.
+    struct NVector rulesTable;        // NCC_Rule*. Open addressing hash table, to look rules up by name.
+    int32_t matchingEngine;           // One of NCC_MatchingEngine values. Defaults to PROGRAM.
+    boolean rulesAnalyzed;            // Set to False whenever rules change. Programs are analyzed again
+                                      // before the next match (to skip alternatives that can't match).
+    struct NVector astNodeStack;      // NCC_ASTNode_Data. To be able to discard nodes that are not needed.
     boolean silent;                   // Set during matching if we encounter an "@". Indicates
                                       // whether the current sub-tree being matched should create
                                       // and push ASTs or not.
 
-    // Error reporting,
+    // Error reporting (see "Lean matching" above),
+    boolean leanMatching;             // False by default. Set to True to track errors only when a match fails.
+    boolean trackErrors;              // Set during matching. False while lean matching.
     struct NVector parentStack;       // A vector of NCC_Node*. Used to keep track of the node-matching call-stack.
     struct NVector maxMatchRuleStack; // A vector const char*. It contains the names of all the substitute nodes that
                                       // were in the parentStack at the moment the longest match was set.
     int32_t maxMatchLength;           // The length of the longest match during the last match operation.
+    int32_t expectedTextOffset;       // The furthest text offset where matching a character failed, -1 if none.
+    uint32_t expectedCharacters[8];   // The characters that were expected there. See NCC_getExpectedCharacters().
     const char* textBeginning;        // A pointer to the text currently being matched.
+    const char* textEnd;              // A pointer to its terminating zero. Literals are compared a word at a
+                                      // time only when the whole word lies before it.
+
+    // Memoization (packrat parsing, see "Memoization" above),
+    boolean memoize;                  // False by default. Set to True to cache substitute node matches.
+    struct NVector memoTable;         // Open addressing hash table, keyed by (rule, text offset, silent).
+    int32_t memoEntriesCount;         // The number of occupied memoTable slots.
+    struct NVector memoRuleNames;     // const char*. The maxMatchRuleStack parts reached inside cached matches.
+    struct NVector matchRecords;      // Successful substitute node matches, replayed when a cached match is reused.
+    struct NVector matchRecordChildren; // int32_t. Indices of the children of every match record.
+
+    // Deferred listeners (see "Deferred listeners" above),
+    boolean deferListeners;           // False by default. Set to True to fire AST listeners only for the final match.
+    boolean deferring;                // Set during matching. False while matching the trees of eager rules.
+    boolean recordMatches;            // Set during matching if match records are needed (memoization, deferred listeners or flat ASTs).
+
+    // AST arena (see "AST arena" above),
+    boolean useASTArena;              // False by default. Set to True to allocate generic AST nodes from astArena.
+    struct NCC_ASTArena* astArena;    // Created on first use.
+
+    // Stackless engine,
+    struct NVector matchingFrames;    // Pointers to frames. Allocated in blocks on demand and reused, so frames never move.
+    int32_t matchingDepth;            // The number of frames currently in use.
+    int32_t peakMatchingDepth;        // The maximum matchingDepth reached during the last match operation.
 };
 
 typedef struct NCC_ASTNode_Data {
@@ -278,7 +463,8 @@ typedef struct NCC_MatchingResult {
 
 typedef struct NCC_MatchingData {
     NCC_ASTNode_Data node;
-    const char* matchedText;
+    const char* matchedTextStart;     // Points into the text being matched, NOT zero-terminated. Use NCC_getMatchedText() for a copy.
+    int32_t matchedTextLength;        // The length of the matched text. Remains unchanged even if the listener changes matchLength.
     int32_t matchLength;
     boolean terminate;
 } NCC_MatchingData;
@@ -293,6 +479,9 @@ typedef struct NCC_RuleData {
     NCC_createASTNodeListener createASTNodeListener;
     NCC_deleteASTNodeListener deleteASTNodeListener;
     NCC_ruleMatchListener ruleMatchListener;
+    boolean eagerListeners;           // When deferring listeners, fire this rule's listeners while matching (to confirm matches).
+    int32_t ruleId;                   // Set when the rule is added. Rules are numbered 0, 1, 2... in the order they are added.
+                                      // Cheaper to compare than rule names (in listeners, for example). -1 if not added.
     NCC_RuleData* (*set)(NCC_RuleData* ruleData, const char* ruleName, const char* ruleText);
     NCC_RuleData* (*setListeners)(NCC_RuleData* ruleData, NCC_createASTNodeListener createASTNodeListener, NCC_deleteASTNodeListener deleteASTNodeListener, NCC_ruleMatchListener ruleMatchListener);
 } NCC_RuleData;
@@ -307,10 +496,25 @@ void NCC_destroyRuleData(NCC_RuleData* ruleData);
 
 boolean NCC_addRule(struct NCC* ncc, NCC_RuleData* ruleData);
 NCC_Rule* NCC_getRule(struct NCC* ncc, const char* ruleName);
+NCC_Rule* NCC_getRuleById(struct NCC* ncc, int32_t ruleId);
 NCC_RuleData* NCC_getRuleData(struct NCC* ncc, const char* ruleName);
 boolean NCC_updateRule(struct NCC* ncc, NCC_RuleData* ruleData);
 boolean NCC_updateRuleText(struct NCC* ncc, NCC_Rule* rule, const char* newRuleText);
 boolean NCC_match(struct NCC* ncc, NCC_Rule* rule, const char* text, NCC_MatchingResult* outResult, NCC_ASTNode_Data* outNode); // Returns True if matched. Sets outResult and outNode.
+const char* NCC_getMatchedText(NCC_MatchingData* matchingData, struct NString* outText); // Copies the matched text into outText. Returns the copy.
+const char* NCC_getExpectedCharacters(struct NCC* ncc, struct NString* outCharacters); // Writes the characters expected at expectedTextOffset into outCharacters in rule syntax (a-z|\;). Returns them.
+
+// Precompiled grammars (see "Precompiled grammars" above),
+void    NCC_serializeGrammar  (struct NCC* ncc, struct NByteVector* outData);           // Overwrites outData.
+boolean NCC_deserializeGrammar(struct NCC* ncc, const void* data, int32_t size);       // The NCC must have no rules. Listeners are not set.
+boolean NCC_saveGrammar       (struct NCC* ncc, const char* filePath);
+boolean NCC_loadGrammar       (struct NCC* ncc, const char* filePath);
+
+// Grammar analysis (see "Grammar analysis" above). Returns the number of warnings,
+int32_t NCC_analyzeGrammar(struct NCC* ncc, struct NString* outReport); // Overwrites outReport.
+
+// Rule optimization (see "Rule optimization" above). Returns the number of inlined substitute nodes,
+int32_t NCC_optimizeRules(struct NCC* ncc);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Generic AST construction methods
@@ -321,10 +525,73 @@ typedef struct NCC_ASTNode {
     struct NVector childNodes;
     NCC_RuleData* rule;
     void* extraData;
+    struct NCC_ASTArena* arena;       // The arena this node was allocated from, if any.
 } NCC_ASTNode;
 
+typedef struct NCC_ASTArena {
+    struct NVector blocks;            // NCC_ASTNode*. Nodes are allocated in blocks, so they never move.
+    int32_t lastBlockUsedCount;       // The number of nodes handed out from the last block so far.
+    struct NVector freeNodes;         // NCC_ASTNode*. Deleted nodes, waiting to be reused.
+} NCC_ASTArena;
+
 void*   NCC_createASTNode(NCC_RuleData* ruleData, NCC_ASTNode_Data* astParentNodeData);
 void    NCC_deleteASTNode(NCC_ASTNode_Data* node, NCC_ASTNode_Data* astParentNode);
 boolean NCC_matchASTNode (NCC_MatchingData* matchingData);
+void    NCC_clearASTArena(struct NCC* ncc); // Recycles all the nodes allocated from the arena. Trees created from it become invalid.
+
+// An alternative generic node that doesn't copy any text. Its name is the name of its rule, and its
+// value is a span of the text being matched, copied only when needed (NCC_getSpanASTNodeValue()).
+// As such, the text being matched must outlive the tree. The span also tells where the node is in
+// the text (NCC_getSpanASTNodeLocation()),
+typedef struct NCC_SpanASTNode {
+    NCC_RuleData* rule;
+    const char* valueStart;           // Points into the text being matched. 0 until matched.
+    int32_t valueLength;
+    struct NVector childNodes;        // NCC_SpanASTNode*.
+    void* extraData;
+} NCC_SpanASTNode;
+
+void*   NCC_createSpanASTNode(NCC_RuleData* ruleData, NCC_ASTNode_Data* astParentNodeData);
+void    NCC_deleteSpanASTNode(NCC_ASTNode_Data* node, NCC_ASTNode_Data* astParentNode);
+boolean NCC_matchSpanASTNode (NCC_MatchingData* matchingData);
+const char* NCC_getSpanASTNodeValue(NCC_SpanASTNode* node, struct NString* outValue); // Copies the value into outValue. Returns the copy.
+void    NCC_getSpanASTNodeLocation(NCC_SpanASTNode* node, const char* text, int32_t* outLine, int32_t* outColumn); // 1-based. text is the text that was matched.
 
 void NCC_ASTTreeToString(NCC_ASTNode* tree, struct NString* prefix, struct NString* outString, boolean printColored);
+void NCC_SpanASTTreeToString(NCC_SpanASTNode* tree, struct NString* prefix, struct NString* outString, boolean printColored);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Flat ASTs
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Instead of having listeners build a tree, NCC_matchFlat() can produce the whole AST as a few flat
+// arrays (structure of arrays), all in a single allocation that is reused by the following matches.
+// Nodes are stored in preorder, so a node's descendants follow it directly. It has the same shape as
+// the trees built by the generic listeners: there is a node for every rule that has a create AST
+// node listener, in place of the node the listener would've created. No create, delete or match
+// listeners are fired, except for the rules with "eagerListeners" set, whose listeners are still
+// fired (then undone) to confirm their matches (see "Deferred listeners" above).
+//
+// For example, to visit the children of a node:
+//    for (int32_t child=ast->firstChildren[node]; child!=-1; child=ast->nextSiblings[child]) ...
+typedef struct NCC_FlatAST {
+    struct NCC* ncc;                  // The rules are looked up here.
+    const char* text;                 // The text that was matched. Must outlive the AST.
+    int32_t nodesCount, capacity;
+    int32_t* ruleIds;                 // The id of every node's rule (see NCC_getFlatASTNodeRule()).
+    int32_t* offsets;                 // Where every node's matched text starts, relative to text.
+    int32_t* lengths;                 // The length of every node's matched text.
+    int32_t* firstChildren;           // -1 if a node has no children.
+    int32_t* nextSiblings;            // -1 if a node is the last child. Top level nodes are siblings too.
+} NCC_FlatAST;
+
+// Called for every node in preorder. Return False to skip the node's children,
+typedef boolean (*NCC_FlatASTVisitor)(NCC_FlatAST* ast, int32_t node, int32_t depth, void* data);
+
+NCC_FlatAST* NCC_initializeFlatAST(NCC_FlatAST* ast);
+void NCC_destroyFlatAST(NCC_FlatAST* ast);
+boolean NCC_matchFlat(struct NCC* ncc, NCC_Rule* rule, const char* text, NCC_MatchingResult* outResult, NCC_FlatAST* outAST); // Returns True if matched. Sets outResult and outAST.
+NCC_RuleData* NCC_getFlatASTNodeRule(NCC_FlatAST* ast, int32_t node);
+const char* NCC_getFlatASTNodeValue(NCC_FlatAST* ast, int32_t node, struct NString* outValue); // Copies the node's matched text into outValue. Returns the copy.
+void NCC_visitFlatAST(NCC_FlatAST* ast, NCC_FlatASTVisitor visitor, void* data);
+void NCC_FlatASTToString(NCC_FlatAST* ast, struct NString* prefix, struct NString* outString, boolean printColored);
@@ -31,7 +31,7 @@
 //       => Users have to parse these manually, or implement their logic in the AST node match listeners.
 //
 // In our implementation, trees nodes are regular graph nodes. However, we as we construct AST tree
-// nodes, we also push them to stacks. This makes it easier to cull an entire branch of the tree
+// nodes, we also push them to a stack. This makes it easier to cull an entire branch of the tree
 // (roll it back) if we took a wrong turn while matching. Lots of the matching is based on trial. If
 // a path fails, we cull its branch and try the next one. If multiple paths match, we take the
 // longest match and cull the others.
@@ -41,55 +41,72 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 typedef struct NCC_Node NCC_Node;
+typedef struct NCC_Instruction NCC_Instruction;
 
-static NCC_Node* constructRuleTree(struct NCC* ncc, const char* ruleText);
-static NCC_Node* getNextNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule);
-static void switchStacks(struct NVector** stack1, struct NVector** stack2);
-static void pushASTStack(struct NCC* ncc, struct NVector* stack, int32_t stackMark);
+// A tree to be matched. The tree walker matches rule tree nodes, while the program interpreter
+// matches compiled instructions (see "Program" below). Only one of the two is set. If neither is
+// set, the tree is empty,
+typedef struct RuleTree {
+    NCC_Node* node;
+    const NCC_Instruction* instruction;
+} RuleTree;
+
+static NCC_Node* constructRuleTree(struct NCC* ncc, const char** in_out_rule, boolean inSubRule);
+static NCC_Node* getNextNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule, boolean inSubRule);
+static NCC_Rule* getRule(struct NCC* ncc, const char* ruleName, int32_t ruleNameLength);
+static void removeASTStackEntries(struct NCC* ncc, int32_t start, int32_t end);
+static void* createASTNode(struct NCC* ncc, NCC_RuleData* ruleData, NCC_ASTNode_Data* astParentNode);
 
 // Matching result with extra details (AST related details) that are necessary for implementation
 // only and not exposed to the user,
 typedef struct MatchedASTTree {
     NCC_MatchingResult result;
     NCC_ASTNode_Data* astParentNode;
-    struct NVector **astNodesStack;
-    uint32_t astStackMark;
+    int32_t astStackMark;
 } MatchedASTTree;
 
 static boolean matchRuleTree(
-        struct NCC* ncc, NCC_Node* ruleTree, const char* text,
-        MatchedASTTree* outMatchingResult, NCC_ASTNode_Data* astParentNode, struct NVector** astStack,
+        struct NCC* ncc, RuleTree ruleTree, const char* text,
+        MatchedASTTree* outMatchingResult, NCC_ASTNode_Data* astParentNode,
         int32_t lengthToAddIfTerminated, MatchedASTTree** astTreesToDiscardIfTerminated, int32_t astTreesToDiscardCount);
-static void discardMatchingResult(MatchedASTTree* tree);
+static void discardMatchingResult(struct NCC* ncc, MatchedASTTree* tree);
+static int32_t discardMatchingResultBelow(struct NCC* ncc, MatchedASTTree* tree, MatchedASTTree* aboveTree);
+static boolean programMatch(const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean stacklessMatch(RuleTree tree, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 
 // A convenient macro to be used inside node matching methods. It creates 2 variables to capture
 // the results of matching (treeName and treeNameMatched) and automatically handles termination,
 #define COMMA , // See: https://stackoverflow.com/questions/20913103/is-it-possible-to-pass-a-brace-enclosed-initializer-as-a-macro-parameter#comment31397917_20913103
-#define MatchTree(treeName, ruleTree, text, astParentNode, nccStack, lengthToAddIfTerminated, deleteList, deleteCount) \
+#define MatchTree(treeName, ruleTree, text, astParentNode, lengthToAddIfTerminated, deleteList, deleteCount) \
     MatchedASTTree treeName; \
     boolean treeName ## Matched = matchRuleTree( \
             ncc, ruleTree, text, \
-            &treeName, astParentNode, &ncc->nccStack, \
+            &treeName, astParentNode, \
             lengthToAddIfTerminated, (MatchedASTTree*[]) deleteList, deleteCount); \
     if (treeName.result.terminate) { \
         *outResult = treeName.result; \
         return treeName ## Matched; \
     }
 
-#define DiscardMatchingResult(tree) discardMatchingResult(tree);
+#define DiscardMatchingResult(tree) discardMatchingResult(ncc, tree);
 
-// Pushes the matched ast tree into NCC's stack 0 and adjusts the match length,
+// The matched AST tree is already on the AST stack, right where it belongs. Just adjust the match
+// length,
 #define AcceptMatchResult(tree) { \
-    pushASTStack(ncc, *(tree).astNodesStack, (tree).astStackMark); \
     outResult->matchLength += (tree).result.matchLength; }
 
+// The parent stack is only needed for error reporting (see updateMaxMatch()), so it's not
+// maintained during lean matching,
+#define PushParentNode(node) { if (ncc->trackErrors) NVector.pushBack(&ncc->parentStack, &(node)); }
+#define PopParentNode(node)  { if (ncc->trackErrors) NVector.popBack (&ncc->parentStack, &(node)); }
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Node
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // A little trick to make an enum into an object,
 struct NCC_NodeType {
-    int32_t ROOT, LITERALS, LITERAL_RANGE, OR, SUB_RULE, REPEAT, ANYTHING, SUBSTITUTE, SELECTION;
+    int32_t ROOT, LITERALS, LITERAL_RANGE, OR, SUB_RULE, REPEAT, ANYTHING, SUBSTITUTE, SELECTION, CHARACTER_CLASS;
 };
 const struct NCC_NodeType NCC_NodeType = {
     .ROOT = 0,              // The topmost node of rules trees. Exists for convenience, so that all
@@ -97,9 +114,9 @@ const struct NCC_NodeType NCC_NodeType = {
                             // anything in particular.
     .LITERALS = 1,          // Matches a single or multiple characters exactly. Example: abc
     .LITERAL_RANGE = 2,     // Matches a single character in the specified range. Example: a-z
-    .OR = 3,                // Extracts the previous and next nodes. Checks which one will result in
-                            // the longest match (doesn't just compare node match lengths, but the
-                            // entire tree). Example:
+    .OR = 3,                // Extracts the previous and next nodes (and the nodes after any
+                            // further "|"s). Checks which one will result in the longest match
+                            // (doesn't just compare node match lengths, but the entire tree). Example:
                             //    rule: {ab}|{abc}cdef
                             //    text: abcdef
     .SUB_RULE = 4,          // Groups (and isolates) several nodes into 1. Example: {A-Za-z^*}
@@ -111,7 +128,7 @@ const struct NCC_NodeType NCC_NodeType = {
                             // "Wildcard nodes" and "Or nodes" explanation in "NCC.h".
     .SUBSTITUTE = 7,        // Subrule with a name. Fires listeners to create and manipulate AST
                             // nodes as it matches. Example: ${Identifier}
-    .SELECTION = 8          // Tries a bunch of different named rules (attempted rules list), gets
+    .SELECTION = 8,         // Tries a bunch of different named rules (attempted rules list), gets
                             // the longest match, then either:
                             //   => accepts it. Or,
                             //   => accepts it only if it belongs to a subset of the initial
@@ -120,12 +137,15 @@ const struct NCC_NodeType NCC_NodeType = {
                             //      attempted rules list (verification rules list).
                             // Example: #{{+}{-}{~}{!} {++}{--} != {++}{--}}
                             // See NCC.h for more.
+    .CHARACTER_CLASS = 9    // Matches a single character out of a set. Created by folding or nodes
+                            // whose sides are all single characters, and by class escapes.
+                            // Example: a-z|A-Z|_ or \w
 };
 
 // Nodes of the rule trees,
 typedef struct NCC_Node {
     int32_t type;
-    void *data;
+    void *data;     // Allocated along with the node, right after it (see genericCreateNode()).
     NCC_Node* previousNode;
     NCC_Node*     nextNode;
 } NCC_Node;
@@ -142,43 +162,46 @@ typedef struct NCC_Node {
 static void genericSetNextNode(NCC_Node* node, NCC_Node* nextNode);
 
 // Node specific implementations used to populate the function lookup tables,
-static boolean rootNodeMatch             (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean rootNodeMatch             (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    rootNodeDeleteTree        (NCC_Node* tree);
 
-static boolean literalsNodeMatch         (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean literalsNodeMatch         (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    literalsNodeDeleteTree    (NCC_Node* tree);
 
-static boolean literalRangeNodeMatch     (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean literalRangeNodeMatch     (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    literalRangeNodeDeleteTree(NCC_Node* tree);
 
-static boolean orNodeMatch               (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean orNodeMatch               (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    orNodeDeleteTree          (NCC_Node* tree);
 
-static boolean subRuleNodeMatch          (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean subRuleNodeMatch          (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    subRuleNodeDeleteTree     (NCC_Node* tree);
 
-static boolean repeatNodeMatch           (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean repeatNodeMatch           (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    repeatNodeDeleteTree      (NCC_Node* tree);
 
-static boolean anythingNodeMatch         (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean anythingNodeMatch         (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    anythingNodeDeleteTree    (NCC_Node* tree);
 
-static boolean substituteNodeMatch       (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean substituteNodeMatch       (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    substituteNodeDeleteTree  (NCC_Node* tree);
 
-static boolean selectionNodeMatch        (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static boolean selectionNodeMatch        (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 static void    selectionNodeDeleteTree   (NCC_Node* tree);
 
+static boolean characterClassNodeMatch   (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+static void    characterClassNodeDeleteTree(NCC_Node* tree);
+
 // Actual tables,
-typedef boolean (*NCC_Node_match     )   (NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
+typedef boolean (*NCC_Node_match     )   (NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult);
 typedef void    (*NCC_Node_deleteTree)   (NCC_Node* tree);
 
-/*╔═══════════════════════════════╤════════════════════╤═════════════════════════╤═════════════════════════════╤═════════════════════════════════╤═══════════════════════╤════════════════════════════╤═══════════════════════════╤═════════════════════════════╤═══════════════════════════════╤═══════════════════════════════╗*/
-/*║   Method                       ╲   Node            │   Root                  │   Literals                  │   Literals range                │   Or                  │   Sub-rule                 │   Repeat                  │   Anything                  │   Substitute                  │   Selection                   ║*/
-/*╟─────────────────────────────────┴──────────────────┼─────────────────────────┼─────────────────────────────┼─────────────────────────────────┼───────────────────────┼────────────────────────────┼───────────────────────────┼─────────────────────────────┼───────────────────────────────┼───────────────────────────────╢*/
-/*║*/ static NCC_Node_match      nodeMatch     [] = {/*│*/ rootNodeMatch     , /*│*/ literalsNodeMatch     , /*│*/ literalRangeNodeMatch     , /*│*/ orNodeMatch     , /*│*/ subRuleNodeMatch     , /*│*/ repeatNodeMatch     , /*│*/ anythingNodeMatch     , /*│*/ substituteNodeMatch     , /*│*/ selectionNodeMatch     }; /*║*/
-/*║*/ static NCC_Node_deleteTree nodeDeleteTree[] = {/*│*/ rootNodeDeleteTree, /*│*/ literalsNodeDeleteTree, /*│*/ literalRangeNodeDeleteTree, /*│*/ orNodeDeleteTree, /*│*/ subRuleNodeDeleteTree, /*│*/ repeatNodeDeleteTree, /*│*/ anythingNodeDeleteTree, /*│*/ substituteNodeDeleteTree, /*│*/ selectionNodeDeleteTree}; /*║*/
-/*╚════════════════════════════════════════════════════╧═════════════════════════╧═════════════════════════════╧═════════════════════════════════╧═══════════════════════╧════════════════════════════╧═══════════════════════════╧═════════════════════════════╧═══════════════════════════════╧═══════════════════════════════╝*/
+/*╔═══════════════════════════════╤════════════════════╤═════════════════════════╤═════════════════════════════╤═════════════════════════════════╤═══════════════════════╤════════════════════════════╤═══════════════════════════╤═════════════════════════════╤═══════════════════════════════╤══════════════════════════════╤════════════════════════════════════╗*/
+/*║   Method                       ╲   Node            │   Root                  │   Literals                  │   Literals range                │   Or                  │   Sub-rule                 │   Repeat                  │   Anything                  │   Substitute                  │   Selection                  │   Character class                  ║*/
+/*╟─────────────────────────────────┴──────────────────┼─────────────────────────┼─────────────────────────────┼─────────────────────────────────┼───────────────────────┼────────────────────────────┼───────────────────────────┼─────────────────────────────┼───────────────────────────────┼──────────────────────────────┼────────────────────────────────────╢*/
+/*║*/ static NCC_Node_match      nodeMatch     [] = {/*│*/ rootNodeMatch     , /*│*/ literalsNodeMatch     , /*│*/ literalRangeNodeMatch     , /*│*/ orNodeMatch     , /*│*/ subRuleNodeMatch     , /*│*/ repeatNodeMatch     , /*│*/ anythingNodeMatch     , /*│*/ substituteNodeMatch     , /*│*/ selectionNodeMatch     , /*│*/ characterClassNodeMatch     }; /*║*/
+/*║*/ static NCC_Node_deleteTree nodeDeleteTree[] = {/*│*/ rootNodeDeleteTree, /*│*/ literalsNodeDeleteTree, /*│*/ literalRangeNodeDeleteTree, /*│*/ orNodeDeleteTree, /*│*/ subRuleNodeDeleteTree, /*│*/ repeatNodeDeleteTree, /*│*/ anythingNodeDeleteTree, /*│*/ substituteNodeDeleteTree, /*│*/ selectionNodeDeleteTree, /*│*/ characterClassNodeDeleteTree}; /*║*/
+/*╚════════════════════════════════════════════════════╧═════════════════════════╧═════════════════════════════╧═════════════════════════════════╧═══════════════════════╧════════════════════════════╧═══════════════════════════╧═════════════════════════════╧═══════════════════════════════╧══════════════════════════════╧════════════════════════════════════╝*/
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Rule
@@ -193,9 +216,21 @@ typedef void    (*NCC_Node_deleteTree)   (NCC_Node* tree);
 //   => A rule tree, constructed from the rule text specified by the user.
 //   => AST creation and manipulation listeners (optional). AST nodes are the sole responsibility of the user. Yet,
 //      we provide generic AST handling functions (See "Generic AST construction methods" in NCC.h).
+typedef struct TreeSummary {
+    uint32_t firstBytes[8];     // A 256 bits set of the bytes a non-empty match can start with.
+    boolean nullable;           // Can match without consuming any bytes.
+    boolean hasEmptyEffects;    // Can confirm substitute nodes without consuming any bytes.
+} TreeSummary;
+
 typedef struct NCC_Rule {
     NCC_RuleData data; // We could have flattened the rule data here, but that would only add unnecessary complexity.
     NCC_Node* tree;
+    struct NVector program; // NCC_Instruction. The rule tree, compiled (see "Program" below).
+    TreeSummary summary;    // See "Analysis" below.
+    NCC_Node* wrapperNode;  // A substitute node referring to this rule. Matching it matches the rule
+                            // as a whole, so that the rule itself appears in the AST (see match()).
+    boolean inlined;        // Copied into other rules trees (see "Rule optimization" below). Can't
+                            // be updated anymore.
 } NCC_Rule;
 
 static NCC_RuleData* ruleDataSet(NCC_RuleData* ruleData, const char* ruleName, const char* ruleText) {
@@ -226,6 +261,8 @@ NCC_RuleData* NCC_initializeRuleData(NCC_RuleData* ruleData, const char* ruleNam
     ruleData->createASTNodeListener = createNodeListener;
     ruleData->deleteASTNodeListener = deleteNodeListener;
     ruleData->ruleMatchListener = matchListener;
+    ruleData->eagerListeners = False;
+    ruleData->ruleId = -1;
 
     ruleData->set = ruleDataSet;
     ruleData->setListeners = ruleDataSetListeners;
@@ -250,6 +287,8 @@ static void destroyRule(NCC_Rule* rule) {
 
     // Deleting the parent node triggers deleting the children, hence the entire tree,
     nodeDeleteTree[rule->tree->type](rule->tree);
+    substituteNodeDeleteTree(rule->wrapperNode);
+    NVector.destroy(&rule->program);
 }
 
 static void destroyAndFreeRule(NCC_Rule* rule) {
@@ -257,6 +296,211 @@ static void destroyAndFreeRule(NCC_Rule* rule) {
     NFREE(rule, "NCC.destroyAndFreeRule() rule");
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Character sets
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// 256 bits sets, a bit per character. Used by character class nodes and the analysis of programs,
+
+static inline void addByte(uint32_t* set, unsigned char byte) {
+    set[byte >> 5] |= 1u << (byte & 31);
+}
+
+static inline void addByteRange(uint32_t* set, unsigned char rangeStart, unsigned char rangeEnd) {
+    for (int32_t byte=rangeStart; byte<=rangeEnd; byte++) addByte(set, byte);
+}
+
+static inline void addBytes(uint32_t* set, const uint32_t* bytesToAdd) {
+    for (int32_t i=0; i<8; i++) set[i] |= bytesToAdd[i];
+}
+
+static inline boolean containsByte(const uint32_t* set, unsigned char byte) {
+    return (set[byte >> 5] >> (byte & 31)) & 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Expected characters
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// While tracking errors, every failed attempt to match a character reports the characters that
+// would have matched there. Only the furthest position matters, the text can't be matched beyond
+// it. The characters expected there are collected in ncc->expectedCharacters,
+
+static void expectCharacters(struct NCC* ncc, const char* text, const uint32_t* characters) {
+    int32_t textOffset = text - ncc->textBeginning;
+    if (textOffset < ncc->expectedTextOffset) return;
+    if (textOffset > ncc->expectedTextOffset) {
+        ncc->expectedTextOffset = textOffset;
+        NSystemUtils.memset(ncc->expectedCharacters, 0, sizeof(ncc->expectedCharacters));
+    }
+    addBytes(ncc->expectedCharacters, characters);
+}
+
+static void expectCharacterRange(struct NCC* ncc, const char* text, unsigned char rangeStart, unsigned char rangeEnd) {
+    uint32_t characters[8] = {0};
+    addByteRange(characters, rangeStart, rangeEnd);
+    expectCharacters(ncc, text, characters);
+}
+
+// The literals are expected where they stop matching the text,
+static void expectLiterals(struct NCC* ncc, const char* text, const char* literals) {
+    while (*literals && *text == *literals) { text++; literals++; }
+    expectCharacterRange(ncc, text, (unsigned char) *literals, (unsigned char) *literals);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Literals comparison
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Comparing literals is the innermost operation of matching, so it's done a word (8 bytes) at a
+// time instead of a character at a time. The first word of every literals string is prepared in
+// advance (zero padded), along with a mask of its significant bytes, so that short literals (most
+// keywords and punctuators) are compared in a single operation. Words are only loaded from the
+// text when it has enough characters before its terminating zero (textEnd). Otherwise, we fall
+// back to comparing characters one by one, which stops at the terminating zero at the latest.
+// Note that literals never contain zeros, so the characters of a matched prefix are never beyond
+// textEnd,
+
+#define NCC_WORD_SIZE 8
+
+typedef struct LiteralsWords {
+    int32_t literalsCount;
+    uint64_t firstWord, firstWordMask;
+} LiteralsWords;
+
+static inline uint64_t loadWord(const char* bytes) {
+    // A fixed size copy compiles into a single (unaligned) load wherever the target allows it,
+    uint64_t word;
+    __builtin_memcpy(&word, bytes, NCC_WORD_SIZE);
+    return word;
+}
+
+static void prepareLiteralsWords(const char* literals, int32_t literalsCount, LiteralsWords* outWords) {
+
+    // Building the word byte by byte keeps it independent of the target's byte order,
+    char wordBytes[NCC_WORD_SIZE], maskBytes[NCC_WORD_SIZE];
+    for (int32_t i=0; i<NCC_WORD_SIZE; i++) {
+        boolean significant = i < literalsCount;
+        wordBytes[i] = significant ? literals[i] : 0;
+        maskBytes[i] = significant ? (char) 0xff : 0;
+    }
+    outWords->literalsCount = literalsCount;
+    outWords->firstWord = loadWord(wordBytes);
+    outWords->firstWordMask = loadWord(maskBytes);
+}
+
+static inline boolean literalsMatch(const char* text, const char* textEnd, const char* literals, const LiteralsWords* words) {
+
+    // The terminating zero is readable as well,
+    int32_t literalsCount = words->literalsCount;
+    intptr_t readableCount = textEnd - text + 1;
+    if (readableCount >= NCC_WORD_SIZE && readableCount >= literalsCount) {
+        if ((loadWord(text) ^ words->firstWord) & words->firstWordMask) return False;
+        if (literalsCount <= NCC_WORD_SIZE) return True;
+
+        // Long literals. Compare the middle words, then the last word (which may overlap the
+        // previous one),
+        int32_t lastWordIndex = literalsCount - NCC_WORD_SIZE;
+        for (int32_t i=NCC_WORD_SIZE; i<lastWordIndex; i+=NCC_WORD_SIZE) {
+            if (loadWord(&text[i]) != loadWord(&literals[i])) return False;
+        }
+        return loadWord(&text[lastWordIndex]) == loadWord(&literals[lastWordIndex]);
+    }
+
+    // Near the end of the text,
+    for (int32_t i=0; i<literalsCount; i++) {
+        if (text[i] != literals[i]) return False;
+    }
+    return True;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instruction
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Rule trees are compiled into programs (see "Program" below). A program is an array of
+// instructions. Every node of the rule tree (except for root nodes) becomes an instruction, and the
+// nodes that follow it become the instructions that follow it in the array. The end of every chain
+// of nodes is marked by an END instruction. The trees owned by nodes (like the lhs and rhs of or
+// nodes) are compiled into chains of their own, located after the chain of their owner.
+
+// Op-codes. The interpreter switches over these, so unlike NCC_NodeType, they have to be constant
+// expressions. Op-codes of the instructions that call out to node matching functions have the same
+// values as their node types,
+#define NCC_OP_END            0 // Root nodes are never compiled. The end of a chain takes their value.
+#define NCC_OP_LITERALS       1
+#define NCC_OP_LITERAL_RANGE  2
+#define NCC_OP_CHARACTER_CLASS 9
+
+typedef struct NCC_Instruction {
+    int32_t opCode;
+    union {                                     // The operands. Only those of the op code are set.
+        struct {
+            const char* literals;               // LITERALS.
+            LiteralsWords literalsWords;
+        };
+        struct {
+            unsigned char rangeStart, rangeEnd; // LITERAL_RANGE.
+        };
+        const uint32_t* characterClass;         // CHARACTER_CLASS.
+        int32_t subProgram;                     // SUB_RULE and REPEAT. The offset of the owned tree,
+                                                // relative to this instruction.
+        const int32_t* branchPrograms;          // OR. The offsets of the branches, relative to this
+                                                // instruction.
+    };
+    NCC_Node* node;                             // The node this instruction was compiled from. Used
+                                                // by instructions that call out to node matching
+                                                // functions.
+    uint32_t viableFirstBytes[8];               // The bytes the chain starting here can be attempted
+                                                // at (see "Analysis" below). Attempting it at any
+                                                // other byte is a sure failure of 0 length, without
+                                                // side effects.
+} NCC_Instruction;
+
+// Node matching functions receive the instruction they are executing (or null for the tree
+// walker). These help them find their way without caring about which one is running,
+static inline boolean treeExists(RuleTree tree) {
+    return tree.node || tree.instruction;
+}
+
+static inline RuleTree getNextTree(NCC_Node* node, const NCC_Instruction* instruction) {
+    RuleTree nextTree = {0};
+    if (instruction) {
+        if (instruction[1].opCode != NCC_OP_END) nextTree.instruction = &instruction[1];
+    } else {
+        nextTree.node = node->nextNode;
+    }
+    return nextTree;
+}
+
+static inline RuleTree getSubTree(NCC_Node* subTree, const NCC_Instruction* instruction) {
+    RuleTree tree = {0};
+    if (instruction) {
+        tree.instruction = &instruction[instruction->subProgram];
+    } else {
+        tree.node = subTree;
+    }
+    return tree;
+}
+
+// Trees can be skipped when the text they are attempted at can't start a match. Skipped trees still
+// report the characters they expected,
+static inline boolean isTreeViable(struct NCC* ncc, RuleTree tree, const char* text) {
+    if (!tree.instruction || containsByte(tree.instruction->viableFirstBytes, (unsigned char) *text)) return True;
+    if (ncc->trackErrors) expectCharacters(ncc, text, tree.instruction->viableFirstBytes);
+    return False;
+}
+
+static inline RuleTree getRuleTree(struct NCC* ncc, NCC_Rule* rule) {
+    RuleTree tree = {0};
+    if (ncc->matchingEngine != NCC_MatchingEngine.TREE_WALKER) {
+        tree.instruction = (const NCC_Instruction*) rule->program.objects;
+    } else {
+        tree.node = rule->tree;
+    }
+    return tree;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Generic node methods
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -272,12 +516,12 @@ static void genericSetNextNode(NCC_Node* node, NCC_Node* nextNode) {
     if (nextNode) nextNode->previousNode = node;
 }
 
-// Every node is an NCC_Node, only the data attached differs. This creates the NCC_Node and sets the
-// data. Every node create method calls this,
-static NCC_Node* genericCreateNode(int32_t type, void* data) {
-    NCC_Node* node = NMALLOC(sizeof(NCC_Node), "NCC.genericCreateNode() node");
+// Every node is an NCC_Node, only the data attached differs. This creates the NCC_Node with its
+// data right after it, in the same memory block. Every node create method calls this,
+static NCC_Node* genericCreateNode(int32_t type, int32_t dataSize) {
+    NCC_Node* node = NMALLOC(sizeof(NCC_Node) + dataSize, "NCC.genericCreateNode() node");
     node->type = type;
-    node->data = data;
+    node->data = dataSize ? &node[1] : 0;
     node->previousNode = 0;
     node->nextNode = 0;
     return node;
@@ -287,11 +531,11 @@ static NCC_Node* genericCreateNode(int32_t type, void* data) {
 // Root node
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static boolean rootNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+static boolean rootNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
 
     // Root nodes don't do any matching themselves. If we have next nodes, we'll invoke them and be done,
     if (node->nextNode) {
-        return nodeMatch[node->nextNode->type](node->nextNode, ncc, text, astParentNode, outResult);
+        return nodeMatch[node->nextNode->type](node->nextNode, 0, ncc, text, astParentNode, outResult);
     } else {
         // No tree to match, which matches everything and consumes 0 length. Just zero the result
         // and call it a day,
@@ -316,20 +560,27 @@ static NCC_Node* createRootNode() {
 
 typedef struct LiteralsNodeData {
     struct NString literals;
+    LiteralsWords words;
 } LiteralsNodeData;
 
-static boolean literalsNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+// Should be called whenever the literals change,
+static void updateLiteralsWords(LiteralsNodeData* nodeData) {
+    prepareLiteralsWords(NString.get(&nodeData->literals), NString.length(&nodeData->literals), &nodeData->words);
+}
+
+static boolean literalsNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
     LiteralsNodeData* nodeData = node->data;
 
-    if (!NCString.startsWith(text, NString.get(&nodeData->literals))) {
+    if (!literalsMatch(text, ncc->textEnd, NString.get(&nodeData->literals), &nodeData->words)) {
+        if (ncc->trackErrors) expectLiterals(ncc, text, NString.get(&nodeData->literals));
         NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
         return False;
     }
 
     // Successful match, check next node,
-    int32_t length = NString.length(&nodeData->literals);
+    int32_t length = nodeData->words.literalsCount;
     if (node->nextNode) {
-        boolean matched = nodeMatch[node->nextNode->type](node->nextNode, ncc, &text[length], astParentNode, outResult);
+        boolean matched = nodeMatch[node->nextNode->type](node->nextNode, 0, ncc, &text[length], astParentNode, outResult);
         outResult->matchLength += length;
         return matched;
     }
@@ -344,15 +595,15 @@ static void literalsNodeDeleteTree(NCC_Node* tree) {
     LiteralsNodeData* nodeData = tree->data;
     NString.destroy(&nodeData->literals);
     if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
-    NFREE(tree->data, "NCC.literalsNodeDeleteTree() tree->data");
-    NFREE(tree      , "NCC.literalsNodeDeleteTree() tree"      );
+    NFREE(tree, "NCC.literalsNodeDeleteTree() tree");
 }
 
 static NCC_Node* createLiteralsNode(const char* literals) {
-    LiteralsNodeData* nodeData = NMALLOC(sizeof(LiteralsNodeData), "NCC.createLiteralsNode() nodeData");
-    NCC_Node* node = genericCreateNode(NCC_NodeType.LITERALS, nodeData);
+    NCC_Node* node = genericCreateNode(NCC_NodeType.LITERALS, sizeof(LiteralsNodeData));
+    LiteralsNodeData* nodeData = node->data;
 
     NString.initialize(&nodeData->literals, "%s", literals);
+    updateLiteralsWords(nodeData);
 
     #if NCC_VERBOSE
     NLOGI("NCC", "Created literals node: %s%s%s", NTCOLOR(HIGHLIGHT), literals, NTCOLOR(STREAM_DEFAULT));
@@ -385,6 +636,7 @@ static NCC_Node* breakLastLiteralIfNeeded(NCC_Node* literalsNode) {
     // Remove the last literal from the parent node,
     lastLiteral[0] = 0;
     NByteVector.resize(&nodeData->literals.string, literalsCount);
+    updateLiteralsWords(nodeData);
 
     return newLiteralsNode;
 }
@@ -397,7 +649,7 @@ typedef struct LiteralRangeNodeData {
     unsigned char rangeStart, rangeEnd;
 } LiteralRangeNodeData;
 
-static boolean literalRangeNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+static boolean literalRangeNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
     LiteralRangeNodeData* nodeData = node->data;
 
     // The literal to be matched,
@@ -405,13 +657,14 @@ static boolean literalRangeNodeMatch(NCC_Node* node, struct NCC* ncc, const char
 
     // Fail if out of range,
     if ((literal < nodeData->rangeStart) || (literal > nodeData->rangeEnd)) {
+        if (ncc->trackErrors) expectCharacterRange(ncc, text, nodeData->rangeStart, nodeData->rangeEnd);
         NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
         return False;
     }
 
     // Successful match, check next node,
     if (node->nextNode) {
-        boolean matched = nodeMatch[node->nextNode->type](node->nextNode, ncc, &text[1], astParentNode, outResult);
+        boolean matched = nodeMatch[node->nextNode->type](node->nextNode, 0, ncc, &text[1], astParentNode, outResult);
         outResult->matchLength++;
         return matched;
     }
@@ -424,14 +677,13 @@ static boolean literalRangeNodeMatch(NCC_Node* node, struct NCC* ncc, const char
 
 static void literalRangeNodeDeleteTree(NCC_Node* tree) {
     if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
-    NFREE(tree->data, "NCC.literalRangeNodeDeleteTree() tree->data");
-    NFREE(tree      , "NCC.literalRangeNodeDeleteTree() tree"      );
+    NFREE(tree, "NCC.literalRangeNodeDeleteTree() tree");
 }
 
 static NCC_Node* createLiteralRangeNode(unsigned char rangeStart, unsigned char rangeEnd) {
 
-    LiteralRangeNodeData* nodeData = NMALLOC(sizeof(LiteralRangeNodeData), "NCC.createLiteralRangeNode() nodeData");
-    NCC_Node* node = genericCreateNode(NCC_NodeType.LITERAL_RANGE, nodeData);
+    NCC_Node* node = genericCreateNode(NCC_NodeType.LITERAL_RANGE, sizeof(LiteralRangeNodeData));
+    LiteralRangeNodeData* nodeData = node->data;
 
     // Always set rangeStart to the smaller of the two values,
     if (rangeStart > rangeEnd) {
@@ -448,6 +700,110 @@ static NCC_Node* createLiteralRangeNode(unsigned char rangeStart, unsigned char
     return node;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Character class node
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct CharacterClassNodeData {
+    uint32_t characters[8]; // A bit per character (see "Character sets" above).
+} CharacterClassNodeData;
+
+static boolean characterClassNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+    CharacterClassNodeData* nodeData = node->data;
+
+    // Fail if not in class,
+    if (!containsByte(nodeData->characters, (unsigned char) *text)) {
+        if (ncc->trackErrors) expectCharacters(ncc, text, nodeData->characters);
+        NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+        return False;
+    }
+
+    // Successful match, check next node,
+    if (node->nextNode) {
+        boolean matched = nodeMatch[node->nextNode->type](node->nextNode, 0, ncc, &text[1], astParentNode, outResult);
+        outResult->matchLength++;
+        return matched;
+    }
+
+    // No next node,
+    NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+    outResult->matchLength = 1;
+    return True;
+}
+
+static void characterClassNodeDeleteTree(NCC_Node* tree) {
+    if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
+    NFREE(tree, "NCC.characterClassNodeDeleteTree() tree");
+}
+
+static NCC_Node* createCharacterClassNode(const uint32_t* characters) {
+
+    NCC_Node* node = genericCreateNode(NCC_NodeType.CHARACTER_CLASS, sizeof(CharacterClassNodeData));
+    CharacterClassNodeData* nodeData = node->data;
+    NSystemUtils.memcpy(nodeData->characters, characters, sizeof(nodeData->characters));
+
+    // The terminating zero is never a part of the text,
+    nodeData->characters[0] &= ~1u;
+
+    #if NCC_VERBOSE
+    NLOGI("NCC", "Created character class node");
+    #endif
+    return node;
+}
+
+// Adds the characters matched by a single character tree (a root node followed by one literal,
+// literal range or character class node) to the specified set. Returns False if the tree isn't a
+// single character tree,
+static boolean addSingleCharacterTree(NCC_Node* tree, uint32_t* characters) {
+
+    NCC_Node* node = tree->nextNode;
+    if (!node || node->nextNode) return False;
+
+    if (node->type == NCC_NodeType.LITERALS) {
+        LiteralsNodeData* nodeData = node->data;
+        if (nodeData->words.literalsCount != 1) return False;
+        addByte(characters, NString.get(&nodeData->literals)[0]);
+    } else if (node->type == NCC_NodeType.LITERAL_RANGE) {
+        LiteralRangeNodeData* nodeData = node->data;
+        addByteRange(characters, nodeData->rangeStart, nodeData->rangeEnd);
+    } else if (node->type == NCC_NodeType.CHARACTER_CLASS) {
+        CharacterClassNodeData* nodeData = node->data;
+        addBytes(characters, nodeData->characters);
+    } else {
+        return False;
+    }
+    return True;
+}
+
+// Class escapes (\d, \w, \s and their complements). Returns False if the literal isn't one,
+static boolean getClassEscapeCharacters(char literal, uint32_t* outCharacters) {
+
+    NSystemUtils.memset(outCharacters, 0, sizeof(uint32_t) * 8);
+    switch (literal) {
+        case 'd': case 'D':
+            addByteRange(outCharacters, '0', '9');
+            break;
+        case 'w': case 'W':
+            addByteRange(outCharacters, 'a', 'z');
+            addByteRange(outCharacters, 'A', 'Z');
+            addByteRange(outCharacters, '0', '9');
+            addByte(outCharacters, '_');
+            break;
+        case 's': case 'S':
+            addByte(outCharacters, ' ');
+            addByteRange(outCharacters, '\t', '\r'); // \t, \n, \v, \f and \r.
+            break;
+        default:
+            return False;
+    }
+
+    // Upper case escapes are the complements,
+    if ((literal >= 'A') && (literal <= 'Z')) {
+        for (int32_t i=0; i<8; i++) outCharacters[i] = ~outCharacters[i];
+    }
+    return True;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Common to creating literals and literal-range nodes
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -501,8 +857,68 @@ static char unescapeLiteral(const char** in_out_rule) {
     return literal;
 }
 
+// Skips the plain literals following the first literal of a run, counting them. Stops at anything
+// that should be handled otherwise (reserved characters, class escapes and literal range starts).
+// Unescaped spaces or tabs between literals are skipped. Returns the end of the run,
+static const char* skipLiteralsRun(const char* rule, int32_t* in_out_literalsCount) {
+    uint32_t characters[8];
+    do {
+        const char* literalBeginning = rule;
+        while ((*rule == ' ') || (*rule == '\t')) rule++;
+
+        const char* literalEnd;
+        char currentChar = *rule;
+        if (currentChar == '\\') {
+            if (!rule[1] || getClassEscapeCharacters(rule[1], characters)) return literalBeginning;
+            literalEnd = &rule[2];
+        } else {
+            if (!currentChar || isReserved(currentChar)) return literalBeginning;
+            literalEnd = &rule[1];
+        }
+
+        // Leave literal range starts to their own node,
+        if (*literalEnd == '-') return literalBeginning;
+
+        rule = literalEnd;
+        (*in_out_literalsCount)++;
+    } while (True);
+}
+
+// Appends the first literal and the run of literals that follows it (as skipped by
+// skipLiteralsRun()) to the literals node. The literals are written in place, in one go,
+static void appendLiteralsRun(LiteralsNodeData* nodeData, char firstLiteral, const char* runBeginning, const char* runEnd, int32_t literalsCount) {
+
+    int32_t oldLength = NString.length(&nodeData->literals);
+    NByteVector.resize(&nodeData->literals.string, oldLength + literalsCount + 1);
+    char* literals = &((char*) NString.get(&nodeData->literals))[oldLength];
+
+    *(literals++) = firstLiteral;
+    while (runBeginning < runEnd) {
+        char currentChar = *(runBeginning++);
+        if ((currentChar == ' ') || (currentChar == '\t')) continue;
+        if (currentChar == '\\') currentChar = *(runBeginning++);
+        *(literals++) = currentChar;
+    }
+    *literals = 0;
+
+    updateLiteralsWords(nodeData);
+}
+
 static NCC_Node* handleLiteral(NCC_Node* parentNode, const char** in_out_rule) {
 
+    // Check if this is a class escape,
+    uint32_t characters[8];
+    if (((*in_out_rule)[0] == '\\') && getClassEscapeCharacters((*in_out_rule)[1], characters)) {
+        (*in_out_rule) += 2;
+        if (**in_out_rule == '-') {
+            NERROR("NCC", "handleLiteral(): A class escape can't be followed by an unescaped '%s-%s'", NTCOLOR(HIGHLIGHT), NTCOLOR(STREAM_DEFAULT));
+            return 0;
+        }
+        NCC_Node* node = createCharacterClassNode(characters);
+        genericSetNextNode(parentNode, node);
+        return node;
+    }
+
     char literal = unescapeLiteral(in_out_rule);
     if (!literal) return 0;
 
@@ -523,20 +939,30 @@ static NCC_Node* handleLiteral(NCC_Node* parentNode, const char** in_out_rule) {
         node = createLiteralRangeNode(literal, followingLiteral);
     } else {
 
+        // Take all the plain literals that follow as well,
+        const char* runBeginning = *in_out_rule;
+        int32_t literalsCount = 1;
+        *in_out_rule = skipLiteralsRun(runBeginning, &literalsCount);
+
         // If the parent node is a literals node, just append to it and return,
         if (parentNode->type == NCC_NodeType.LITERALS) {
-            LiteralsNodeData* nodeData = parentNode->data;
-            NString.append(&nodeData->literals, "%c", literal);
+            appendLiteralsRun(parentNode->data, literal, runBeginning, *in_out_rule, literalsCount);
 
             #if NCC_VERBOSE
-            NLOGI("NCC", "Appended to literals node: %s%c%s", NTCOLOR(HIGHLIGHT), literal, NTCOLOR(STREAM_DEFAULT));
+            NLOGI("NCC", "Appended to literals node: %s%s%s", NTCOLOR(HIGHLIGHT), NString.get(&((LiteralsNodeData*) parentNode->data)->literals), NTCOLOR(STREAM_DEFAULT));
             #endif
             return parentNode;
         }
 
         // Parent is not of literals type. Create a new node,
-        char literalString[2] = {literal, 0};
-        node = createLiteralsNode(literalString);
+        node = genericCreateNode(NCC_NodeType.LITERALS, sizeof(LiteralsNodeData));
+        LiteralsNodeData* nodeData = node->data;
+        NString.initialize(&nodeData->literals, "");
+        appendLiteralsRun(nodeData, literal, runBeginning, *in_out_rule, literalsCount);
+
+        #if NCC_VERBOSE
+        NLOGI("NCC", "Created literals node: %s%s%s", NTCOLOR(HIGHLIGHT), NString.get(&nodeData->literals), NTCOLOR(STREAM_DEFAULT));
+        #endif
     }
 
     // Attach to parent node,
@@ -549,141 +975,135 @@ static NCC_Node* handleLiteral(NCC_Node* parentNode, const char** in_out_rule) {
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 typedef struct OrNodeData {
-    NCC_Node* rhsTree;
-    NCC_Node* lhsTree;
+    struct NVector branches;        // NCC_Node*. The trees of the alternatives, in order.
+    struct NVector branchPrograms;  // int32_t. The offsets of the compiled branches, relative to the
+                                    // or instruction.
 } OrNodeData;
 
-static boolean orNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
-    OrNodeData* nodeData = node->data;
-
-    // Push this node as a parent to the rhs and lhs,
-    // TODO: Do we really need to push every node? After all, we only ever check the substitute nodes...
-    NVector.pushBack(&ncc->parentStack, &node);
+#define VERY_NEGATIVE_MATCH_LENGTH (-10000000)   // Outrageously negative, to make sure any match is longer.
 
-    // Match the sides on temporary stacks,
-    // Right hand side,
-    MatchTree(rhs, nodeData->rhsTree, text, astParentNode, astNodeStacks[1], 0, {&rhs}, 1)
+// The following tree is matched once per distinct branch match length. The lengths it was matched
+// at are kept to skip later branches of the same length, up to this count,
+#define NCC_OR_TRIED_LENGTHS_COUNT 8
 
-    // Left hand side,
-    MatchTree(lhs, nodeData->lhsTree, text, astParentNode, astNodeStacks[2], 0, {&rhs COMMA &lhs}, 2)
+static inline RuleTree getBranchTree(OrNodeData* nodeData, const NCC_Instruction* instruction, int32_t branchIndex) {
+    RuleTree tree = {0};
+    if (instruction) {
+        tree.instruction = &instruction[instruction->branchPrograms[branchIndex]];
+    } else {
+        tree.node = *(NCC_Node**) NVector.get(&nodeData->branches, branchIndex);
+    }
+    return tree;
+}
 
-    // Remove this node from the parent stack,
-    NVector.popBack(&ncc->parentStack, &node);
+// A matched tree that matched nothing and pushed nothing. Lets the or node treat the best match
+// so far the same way, whether or not there is one,
+static inline void setEmptyMatch(struct NCC* ncc, MatchedASTTree* tree, NCC_ASTNode_Data* astParentNode) {
+    NSystemUtils.memset(&tree->result, 0, sizeof(NCC_MatchingResult));
+    tree->astParentNode = astParentNode;
+    tree->astStackMark = NVector.size(&ncc->astNodeStack);
+}
 
-    // If neither right or left matched,
-    if ((!rhsMatched) && (!lhsMatched)) {
-        // Return the result with the longest match length,
-        *outResult = rhs.result.matchLength > lhs.result.matchLength ? rhs.result : lhs.result;
-        return False;
+static boolean isLengthTried(const int32_t* triedLengths, int32_t triedLengthsCount, int32_t length) {
+    for (int32_t i=0; i<triedLengthsCount; i++) {
+        if (triedLengths[i] == length) return True;
     }
+    return False;
+}
 
-    // At this point, either LHS, RHS or both matched. We now need to attempt matching the rest of
-    // the text that comes after them.
-
-    // If only one side matched, or both matched but the match length is identical, we needn't check
-    // the following tree twice,
-    if ((rhs.result.matchLength==lhs.result.matchLength) ||
-        (!rhsMatched) ||
-        (!lhsMatched)) {
-
-        // Get the matched tree of the only side that matched, or the rule that occurs first (lhs)
-        // otherwise,
-        MatchedASTTree* matchedTree = lhsMatched ? &lhs : &rhs;
-
-        // If there's a following tree,
-        if (node->nextNode) {
-
-            // In stacks, the first item to be popped is the last to be pushed. That's why we always
-            // push the astNodeStack of the next/child nodes before the current. Hence, we'll match
-            // the following tree on astNodeStacks[0]. Later on, we're going to push one of the two
-            // sides matched earlier,
-            MatchTree(nextNode, node->nextNode, &text[matchedTree->result.matchLength], astParentNode, astNodeStacks[0], matchedTree->result.matchLength, {&nextNode COMMA &lhs COMMA &rhs}, 3)
-
-            // Termination is already handled in the MatchTree macro. Reaching this far means not
-            // terminated. What remains is handling if the node was not matched,
-            *outResult = nextNode.result;   // To set the length (will be amended later) and reset terminate.
-            if (!nextNodeMatched) {
-                DiscardMatchingResult(&lhs)
-                DiscardMatchingResult(&rhs)
-                outResult->matchLength += matchedTree->result.matchLength;
-                return False;
-            }
-        } else {
+static boolean orNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+    OrNodeData* nodeData = node->data;
+    RuleTree nextTree = getNextTree(node, instruction);
+
+    // Tries all the branches in order. Each matched branch is followed by matching the following
+    // tree right after it, and the branch that results in the longest match of the entire tree is
+    // selected. Ties go to the earlier branch. Since matching the following tree at the same length
+    // gives the same result, it's matched only once per distinct branch length.
+
+    // The best branch and its following tree so far. Other branches are matched on top of them.
+    // When a better one is found, the best so far are discarded and replaced by it (just like
+    // selection nodes do),
+    MatchedASTTree bestBranch, bestFollowingTree;
+    setEmptyMatch(ncc, &bestBranch       , astParentNode);
+    setEmptyMatch(ncc, &bestFollowingTree, astParentNode);
+    boolean matchFound=False, branchMatchFound=False;
+    int32_t triedLengths[NCC_OR_TRIED_LENGTHS_COUNT], triedLengthsCount=0;
+
+    // Until something matches, keep the longest failed match for error reporting,
+    outResult->matchLength = VERY_NEGATIVE_MATCH_LENGTH;
 
-            // Clear the terminate flag (or any other members we may add in the future),
-            NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
-        }
+    int32_t branchesCount = NVector.size(&nodeData->branches);
+    for (int32_t i=0; i<branchesCount; i++) {
 
-        // Since we haven't returned yet, then either the following tree matched or there was no
-        // following tree. If both lhs and rhs matched (in case they had the same match length), we
-        // need to discard the unused side's tree,
-        if (lhsMatched && rhsMatched) DiscardMatchingResult(&rhs)
+        // Push this node as a parent to the branch,
+        // TODO: Do we really need to push every node? After all, we only ever check the substitute nodes...
+        PushParentNode(node)
+        MatchTree(branch, getBranchTree(nodeData, instruction, i), text, astParentNode, 0, {&branch COMMA &bestFollowingTree COMMA &bestBranch}, 3)
+        PopParentNode(node)
 
-        // Push the ast stack of the matched side to astNodeStacks[0] and adjust the match length,
-        AcceptMatchResult(*matchedTree)
-        return True;
-    }
+        if (!branchMatched) {
+            if (!branchMatchFound && branch.result.matchLength > outResult->matchLength) *outResult = branch.result;
+            continue;
+        }
+        int32_t branchLength = branch.result.matchLength;
+
+        // If there's no following tree, the longest branch wins,
+        if (!treeExists(nextTree)) {
+            if (!matchFound || branchLength > bestBranch.result.matchLength) {
+                discardMatchingResultBelow(ncc, &bestBranch, &branch);
+                bestBranch = branch;
+                matchFound = True;
+            } else {
+                DiscardMatchingResult(&branch)
+            }
+            continue;
+        }
 
-    // So far we handled:
-    //    => Both sides (lhs and rhs) not matched.
-    //    => One side only matched.
-    //    => Both side matched, but have the same match length.
-    //
-    // What remains is when both sides match but with different match lengths. To maximize the
-    // overall match length, we have to take the rest of the tree into account by attempting to
-    // match at both right and left side lengths,
+        // An earlier branch of the same length already got the following tree matched after it.
+        // Whatever the result was, it wins,
+        if (isLengthTried(triedLengths, triedLengthsCount, branchLength)) {
+            DiscardMatchingResult(&branch)
+            continue;
+        }
+        if (triedLengthsCount < NCC_OR_TRIED_LENGTHS_COUNT) triedLengths[triedLengthsCount++] = branchLength;
 
-    // If no following tree, just accept the longer match,
-    if (!node->nextNode) {
-        NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
-        if (rhs.result.matchLength > lhs.result.matchLength) {
-            DiscardMatchingResult(&lhs)
-            AcceptMatchResult(rhs)
+        // Match the following tree,
+        MatchTree(followingTree, nextTree, &text[branchLength], astParentNode, branchLength, {&followingTree COMMA &branch COMMA &bestFollowingTree COMMA &bestBranch}, 4)
+        int32_t totalLength = branchLength + followingTree.result.matchLength;
+        if (!followingTreeMatched) {
+            if (!matchFound && (!branchMatchFound || totalLength > outResult->matchLength)) {
+                *outResult = followingTree.result;
+                outResult->matchLength = totalLength;
+            }
+            branchMatchFound = True;
+            DiscardMatchingResult(&branch)
+            continue;
+        }
+        branchMatchFound = True;
+
+        // Keep it if it's the longest so far,
+        if (!matchFound || totalLength > bestBranch.result.matchLength + bestFollowingTree.result.matchLength) {
+            // The best following tree lies between the best branch and this branch, so it's discarded
+            // with the best branch,
+            followingTree.astStackMark -= discardMatchingResultBelow(ncc, &bestBranch, &branch);
+            bestBranch = branch;
+            bestFollowingTree = followingTree;
+            matchFound = True;
         } else {
-            DiscardMatchingResult(&rhs)
-            AcceptMatchResult(lhs)
+            DiscardMatchingResult(&followingTree)
+            DiscardMatchingResult(&branch)
         }
-        return True;
     }
 
-    // Right hand side,
-    MatchTree(rhsTree, node->nextNode, &text[rhs.result.matchLength], astParentNode, astNodeStacks[3], rhs.result.matchLength, {&rhsTree COMMA &lhs COMMA &rhs}, 3)
-
-    // Left hand side,
-    MatchTree(lhsTree, node->nextNode, &text[lhs.result.matchLength], astParentNode, astNodeStacks[4], lhs.result.matchLength, {&lhsTree COMMA &rhsTree COMMA &lhs COMMA &rhs}, 4)
-
-    // If neither right or left trees match,
-    int32_t totalRHSMatchLength = rhs.result.matchLength + rhsTree.result.matchLength;
-    int32_t totalLHSMatchLength = lhs.result.matchLength + lhsTree.result.matchLength;
-    if ((!rhsTreeMatched) && (!lhsTreeMatched)) {
-
-        // Return the result with the longest match,
-        if (totalRHSMatchLength > totalLHSMatchLength) {
-            *outResult = rhsTree.result;
-            outResult->matchLength = totalRHSMatchLength;
-        } else {
-            *outResult = lhsTree.result;
-            outResult->matchLength = totalLHSMatchLength;
-        }
-        DiscardMatchingResult(&lhs)
-        DiscardMatchingResult(&rhs)
+    if (!matchFound) {
+        // Clear the result if no branch did that already (all branches were skipped),
+        if (outResult->matchLength==VERY_NEGATIVE_MATCH_LENGTH) NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
         return False;
     }
 
-    // At least one side should have matched,
     NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
-    if (!lhsTreeMatched ||                                              // RHS only matched, or,
-        (rhsTreeMatched && totalRHSMatchLength>totalLHSMatchLength)) {  // Both matched, but rhs length > lhs length.
-        DiscardMatchingResult(&lhsTree)
-        DiscardMatchingResult(&lhs)
-        AcceptMatchResult(rhsTree)
-        AcceptMatchResult(rhs)
-    } else {
-        DiscardMatchingResult(&rhsTree)
-        DiscardMatchingResult(&rhs)
-        AcceptMatchResult(lhsTree)
-        AcceptMatchResult(lhs)
-    }
+    AcceptMatchResult(bestBranch)
+    AcceptMatchResult(bestFollowingTree)
 
     // Or nodes themselves don't get pushed onto the stack. Just return,
     return True;
@@ -691,11 +1111,15 @@ static boolean orNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NC
 
 static void orNodeDeleteTree(NCC_Node* tree) {
     OrNodeData* nodeData = tree->data;
-    nodeDeleteTree[nodeData->rhsTree->type](nodeData->rhsTree);
-    nodeDeleteTree[nodeData->lhsTree->type](nodeData->lhsTree);
+    int32_t branchesCount = NVector.size(&nodeData->branches);
+    for (int32_t i=0; i<branchesCount; i++) {
+        NCC_Node* branch = *(NCC_Node**) NVector.get(&nodeData->branches, i);
+        nodeDeleteTree[branch->type](branch);
+    }
+    NVector.destroy(&nodeData->branches);
+    NVector.destroy(&nodeData->branchPrograms);
     if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
-    NFREE(tree->data, "NCC.orNodeDeleteTree() tree->data");
-    NFREE(tree      , "NCC.orNodeDeleteTree() tree"      );
+    NFREE(tree, "NCC.orNodeDeleteTree() tree");
 }
 
 static char** skipWhiteSpaces(const char** in_out_rule) {
@@ -708,7 +1132,7 @@ static char** skipWhiteSpaces(const char** in_out_rule) {
     return (char**) in_out_rule;
 }
 
-static NCC_Node* createOrNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule) {
+static NCC_Node* createOrNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule, boolean inSubRule) {
 
     // If the parent nod (the one just before the "|") is a literals node with more than one literal,
     // break the last literal apart so that it's the only literal matched in the or,
@@ -721,31 +1145,68 @@ static NCC_Node* createOrNode(struct NCC* ncc, NCC_Node* parentNode, const char*
         return 0;
     }
 
-    // Create node,
-    OrNodeData* nodeData = NMALLOC(sizeof(OrNodeData), "NCC.createOrNode() nodeData");
-    NCC_Node* node = genericCreateNode(NCC_NodeType.OR, nodeData);
-
-    // Remove parent from the grand-parent and attach this node instead,
-    genericSetNextNode(grandParentNode, node);
-
-    // Turn parent node into a tree and attach it as the lhs node,
-    nodeData->lhsTree = createRootNode();
-    genericSetNextNode(nodeData->lhsTree, parentNode);
+    // If the parent node is an or node itself (as in a|b|c), the next node becomes one more branch
+    // of it. Otherwise, create a new node,
+    NCC_Node* node;
+    OrNodeData* nodeData;
+    if (parentNode->type == NCC_NodeType.OR) {
+        node = parentNode;
+        nodeData = node->data;
+    } else {
+        node = genericCreateNode(NCC_NodeType.OR, sizeof(OrNodeData));
+        nodeData = node->data;
+        NVector.initialize(&nodeData->branches      , 0, sizeof(NCC_Node*));
+        NVector.initialize(&nodeData->branchPrograms, 0, sizeof(int32_t  ));
+
+        // Remove parent from the grand-parent and attach this node instead,
+        genericSetNextNode(grandParentNode, node);
+
+        // Turn parent node into a tree and add it as the first branch,
+        NCC_Node* firstBranch = createRootNode();
+        genericSetNextNode(firstBranch, parentNode);
+        NVector.pushBack(&nodeData->branches, &firstBranch);
+    }
 
-    // Create a new tree for the next node and set it as the rhs,
-    nodeData->rhsTree = createRootNode();
+    // Create a new tree for the next node and add it as a branch,
+    NCC_Node* branch = createRootNode();
+    NVector.pushBack(&nodeData->branches, &branch);
     const char* remainingSubRule =  ++(*in_out_rule); // Skip the '|'.
     remainingSubRule = *skipWhiteSpaces(in_out_rule); // Skip whitespaces.
-    if (!**in_out_rule) {
+    if (!**in_out_rule || (inSubRule && (**in_out_rule == '}'))) {
         NERROR("NCC", "createOrNode(): %s|%s can't come at the end of a rule/sub-rule", NTCOLOR(HIGHLIGHT), NTCOLOR(STREAM_DEFAULT));
         return 0; // Since this node is already attached to the tree, it gets cleaned up automatically.
     }
-    NCC_Node* rhsNode = getNextNode(ncc, nodeData->rhsTree, in_out_rule); // This will automatically attach it to rhsTree.
-    if (!rhsNode) {
+    NCC_Node* branchNode = getNextNode(ncc, branch, in_out_rule, inSubRule); // This will automatically attach it to the branch.
+    if (!branchNode) {
         NERROR("NCC", "createOrNode(): couldn't create an rhs node: %s%s%s", NTCOLOR(HIGHLIGHT), remainingSubRule, NTCOLOR(STREAM_DEFAULT));
         return 0; // Since this node is already attached to the tree, it gets cleaned up automatically.
     }
 
+    // A branch is a single node. If a run of literals was taken, keep only the first literal and
+    // parse the rest again after the or node,
+    if (branchNode->type == NCC_NodeType.LITERALS) {
+        LiteralsNodeData* branchNodeData = branchNode->data;
+        if (NString.length(&branchNodeData->literals) > 1) {
+            ((char*) NString.get(&branchNodeData->literals))[1] = 0;
+            NByteVector.resize(&branchNodeData->literals.string, 2);
+            updateLiteralsWords(branchNodeData);
+            *in_out_rule = &remainingSubRule[(remainingSubRule[0] == '\\') ? 2 : 1];
+        }
+    }
+
+    // If both branches of a new node match a single character, replace the node with a character
+    // class node. Later branches get folded into the class node the same way, so that a chain like
+    // a-z|A-Z|_ becomes a single class node,
+    uint32_t characters[8] = {0};
+    if ((NVector.size(&nodeData->branches) == 2) &&
+        addSingleCharacterTree(*(NCC_Node**) NVector.get(&nodeData->branches, 0), characters) &&
+        addSingleCharacterTree(*(NCC_Node**) NVector.get(&nodeData->branches, 1), characters)) {
+        NCC_Node* classNode = createCharacterClassNode(characters);
+        genericSetNextNode(grandParentNode, classNode);
+        orNodeDeleteTree(node);
+        return classNode;
+    }
+
     #if NCC_VERBOSE
     NLOGI("NCC", "Created or node: %s|%s%s", NTCOLOR(HIGHLIGHT), remainingSubRule, NTCOLOR(STREAM_DEFAULT));
     #endif
@@ -760,21 +1221,22 @@ typedef struct SubRuleNodeData {
     NCC_Node* subRuleTree;
 } SubRuleNodeData;
 
-static boolean subRuleNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+static boolean subRuleNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
     SubRuleNodeData* nodeData = node->data;
+    RuleTree nextTree = getNextTree(node, instruction);
 
-    // Match sub-rule on temporary stack 1,
-    NVector.pushBack(&ncc->parentStack, &node);
-    MatchTree(subRule, nodeData->subRuleTree, text, astParentNode, astNodeStacks[1], 0, {&subRule}, 1)
-    NVector.popBack(&ncc->parentStack, &node);
+    // Match sub-rule,
+    PushParentNode(node)
+    MatchTree(subRule, getSubTree(nodeData->subRuleTree, instruction), text, astParentNode, 0, {&subRule}, 1)
+    PopParentNode(node)
     if (!subRuleMatched) {
         *outResult = subRule.result;
         return False;
     }
 
     // Match next node,
-    if (node->nextNode) {
-        MatchTree(followingTree, node->nextNode, &text[subRule.result.matchLength], astParentNode, astNodeStacks[0], subRule.result.matchLength, {&followingTree COMMA &subRule}, 2)
+    if (treeExists(nextTree)) {
+        MatchTree(followingTree, nextTree, &text[subRule.result.matchLength], astParentNode, subRule.result.matchLength, {&followingTree COMMA &subRule}, 2)
         *outResult = followingTree.result;
         if (!followingTreeMatched) {
             outResult->matchLength += subRule.result.matchLength;
@@ -785,7 +1247,7 @@ static boolean subRuleNodeMatch(NCC_Node* node, struct NCC* ncc, const char* tex
         NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
     }
 
-    // Push the sub-rule stack,
+    // Accept the sub-rule,
     AcceptMatchResult(subRule)
 
     return True;
@@ -795,8 +1257,7 @@ static void subRuleNodeDeleteTree(NCC_Node* tree) {
     SubRuleNodeData* nodeData = tree->data;
     nodeDeleteTree[nodeData->subRuleTree->type](nodeData->subRuleTree);
     if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
-    NFREE(tree->data, "NCC.subRuleNodeDeleteTree() tree->data");
-    NFREE(tree      , "NCC.subRuleNodeDeleteTree() tree"      );
+    NFREE(tree, "NCC.subRuleNodeDeleteTree() tree");
 }
 
 static NCC_Node* createSubRuleNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule) {
@@ -804,60 +1265,42 @@ static NCC_Node* createSubRuleNode(struct NCC* ncc, NCC_Node* parentNode, const
     // Skip the '{'.
     const char* subRuleBeginning = (*in_out_rule)++;
 
-    // Find the matching closing braces,
-    int32_t closingBracesRequired=1;
-    boolean subRuleComplete=False;
-    int32_t subRuleLength=0, whiteSpacesCount=0;
-    do {
-        char currentChar = (*in_out_rule)[subRuleLength];
-        if (currentChar=='{') {
-            closingBracesRequired++;
-        } else if (currentChar=='}') {
-            if (!--closingBracesRequired) {
-                subRuleComplete = True;
-                break;
-            }
-        } else if ((currentChar == ' ') || (currentChar == '\t')) {
-            whiteSpacesCount++;
-        } else if (!currentChar) {
-            // Text finished before we found the matching closing braces. Subrule is not complete.
-            break;
-        }
-        subRuleLength++;
-    } while (True);
-
-    // Make sure the sub-rule is well-formed. Can't have a sub-rule made up entirely of whitespaces,
-    if ((subRuleLength-whiteSpacesCount) == 0) {
-        NERROR("NCC", "createSubRuleNode(): can't have empty sub-rules %s{}%s", NTCOLOR(HIGHLIGHT), NTCOLOR(STREAM_DEFAULT));
+    // Create sub-rule tree. It's parsed in place, up to the matching closing brace,
+    NCC_Node* subRuleTree = constructRuleTree(ncc, in_out_rule, True);
+    if (!subRuleTree) {
+        NERROR("NCC", "createSubRuleNode(): couldn't create sub-rule tree: %s%s%s", NTCOLOR(HIGHLIGHT), subRuleBeginning, NTCOLOR(STREAM_DEFAULT));
         return 0;
     }
-    if (!subRuleComplete) {
+
+    // Make sure the sub-rule is well-formed,
+    if (**in_out_rule != '}') {
         NERROR("NCC", "createSubRuleNode(): couldn't find a matching %s}%s in %s%s%s", NTCOLOR(HIGHLIGHT), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), subRuleBeginning, NTCOLOR(STREAM_DEFAULT));
+        rootNodeDeleteTree(subRuleTree);
         return 0;
     }
-
-    // Copy the sub-rule (because the rule text is const char*, can't substitute a zero wherever I need),
-    char* subRule = NMALLOC(subRuleLength+1, "NCC.createSubRuleNode() subRule");
-    NSystemUtils.memcpy(subRule, *in_out_rule, subRuleLength);
-    subRule[subRuleLength] = 0;        // Terminate the string.
-    (*in_out_rule) += subRuleLength+1; // Advance the rule pointer to right after the closing brace.
-
-    // Create sub-rule tree,
-    NCC_Node* subRuleTree = constructRuleTree(ncc, subRule);
-    NFREE(subRule, "NCC.createSubRuleNode() subRule");
-    if (!subRuleTree) {
-        // We deliberately chose to print "subRuleBeginning" over "subRule" because it shows more context,
-        NERROR("NCC", "createSubRuleNode(): couldn't create sub-rule tree: %s%s%s", NTCOLOR(HIGHLIGHT), subRuleBeginning, NTCOLOR(STREAM_DEFAULT));
+    (*in_out_rule)++; // Skip the '}'.
+    if (!subRuleTree->nextNode) {
+        NERROR("NCC", "createSubRuleNode(): can't have empty sub-rules %s{}%s", NTCOLOR(HIGHLIGHT), NTCOLOR(STREAM_DEFAULT));
+        rootNodeDeleteTree(subRuleTree);
         return 0;
     }
 
+    // A sub-rule that contains nothing but a character class is the character class itself,
+    NCC_Node* firstNode = subRuleTree->nextNode;
+    if (firstNode && (firstNode->type == NCC_NodeType.CHARACTER_CLASS) && !firstNode->nextNode) {
+        subRuleTree->nextNode = 0;
+        rootNodeDeleteTree(subRuleTree);
+        genericSetNextNode(parentNode, firstNode);
+        return firstNode;
+    }
+
     // Create the sub-rule node,
-    SubRuleNodeData* nodeData = NMALLOC(sizeof(SubRuleNodeData), "NCC.createSubRuleNode() nodeData");
-    NCC_Node* node = genericCreateNode(NCC_NodeType.SUB_RULE, nodeData);
+    NCC_Node* node = genericCreateNode(NCC_NodeType.SUB_RULE, sizeof(SubRuleNodeData));
+    SubRuleNodeData* nodeData = node->data;
     nodeData->subRuleTree = subRuleTree;
 
     #if NCC_VERBOSE
-    NLOGI("NCC", "Created sub-rule node: %s{%s}%s", NTCOLOR(HIGHLIGHT), subRule, NTCOLOR(STREAM_DEFAULT));
+    NLOGI("NCC", "Created sub-rule node: %s%s%s", NTCOLOR(HIGHLIGHT), subRuleBeginning, NTCOLOR(STREAM_DEFAULT));
     #endif
     genericSetNextNode(parentNode, node);
     return node;
@@ -871,7 +1314,7 @@ typedef struct RepeatNodeData {
     NCC_Node* repeatedNode;
 } RepeatNodeData;
 
-static boolean repeatNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+static boolean repeatNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
 
     // This matches a rule "zero" or more times, and as such, there are no failed matches. A failed
     // match is a successful match of 0 repeats. This returns false only if there's a following tree
@@ -895,12 +1338,14 @@ static boolean repeatNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text
     //       while keeping ast's proper ordering...
 
     RepeatNodeData* nodeData = node->data;
+    RuleTree nextTree = getNextTree(node, instruction);
+    RuleTree repeatedTree = getSubTree(nodeData->repeatedNode, instruction);
 
     // If there are no following nodes, match as much as you can, and always return True,
-    if (!node->nextNode) {
-        NVector.pushBack(&ncc->parentStack, &node);
-        MatchTree(repeatedNode, nodeData->repeatedNode, text, astParentNode, astNodeStacks[1], 0, {&repeatedNode}, 1)
-        NVector.popBack(&ncc->parentStack, &node);
+    if (!treeExists(nextTree)) {
+        PushParentNode(node)
+        MatchTree(repeatedNode, repeatedTree, text, astParentNode, 0, {&repeatedNode}, 1)
+        PopParentNode(node)
         if (!repeatedNodeMatched) {
             // Unlike other nodes, this is not considered a failed match. It's an accepted match of
             // 0 repeats,
@@ -918,20 +1363,20 @@ static boolean repeatNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text
 
         // Attempt matching again (which will work, with at least 0 repeats, since we have no
         // following tree),
-        repeatNodeMatch(node, ncc, &text[repeatedNode.result.matchLength], astParentNode, outResult);
+        repeatNodeMatch(node, instruction, ncc, &text[repeatedNode.result.matchLength], astParentNode, outResult);
         if (outResult->terminate) {
             outResult->matchLength += repeatedNode.result.matchLength;
             return True;
         }
 
-        // Push our non-zero match on top of any other repeats (which are definitely successful)
-        // that could have been made,
+        // Accept our non-zero match, along with any other repeats (which are definitely successful)
+        // that could have been made on top of it,
         AcceptMatchResult(repeatedNode)
         return True;
     }
 
     // We have a following node. Check if its tree matches,
-    MatchTree(followingTree, node->nextNode, text, astParentNode, astNodeStacks[0], 0, {&followingTree}, 1)
+    MatchTree(followingTree, nextTree, text, astParentNode, 0, {&followingTree}, 1)
     *outResult = followingTree.result;
     // If the following tree allows matching 0 characters, then this repeat node is never going to
     // match anything. We'll only treat a zero-length following tree as a delimiter if the repeat
@@ -939,10 +1384,10 @@ static boolean repeatNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text
     // we should stop repeating immediately,
     if (followingTreeMatched && followingTree.result.matchLength!=0) return True;
 
-    // Following tree didn't match or matched with 0 length, attempt repeating (on stack[1]),
-    NVector.pushBack(&ncc->parentStack, &node);
-    MatchTree(repeatedNode, nodeData->repeatedNode, text, astParentNode, astNodeStacks[1], 0, {&followingTree COMMA &repeatedNode}, 2)
-    NVector.popBack(&ncc->parentStack, &node);
+    // Following tree didn't match or matched with 0 length, attempt repeating (on top of it),
+    PushParentNode(node)
+    MatchTree(repeatedNode, repeatedTree, text, astParentNode, 0, {&followingTree COMMA &repeatedNode}, 2)
+    PopParentNode(node)
 
     // See if this repeat has reached an end,
     if (!repeatedNodeMatched || repeatedNode.result.matchLength==0) {
@@ -957,19 +1402,12 @@ static boolean repeatNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text
         return False;
     }
 
-    // Something matched. Discard the zero-length match of the following tree (if any),
-    DiscardMatchingResult(&followingTree)
-    /*
-    if (NVector.size(ncc->astNodeStacks[0]) != followingTree.astStackMark) {
-        NLOGI("sdf", "Discarding!");
-        NCC_ASTNode_Data *nodeData;
-        nodeData = NVector.getLast(ncc->astNodeStacks[0]);
-        NLOGE("sdf", "Discarded name: %s", NString.get(&nodeData->rule->ruleName));
-    }
-    */
+    // Something matched. Discard the zero-length match of the following tree (if any). It lies below
+    // the repeated node,
+    discardMatchingResultBelow(ncc, &followingTree, &repeatedNode);
 
     // Attempt repeating,
-    boolean matched = repeatNodeMatch(node, ncc, &text[repeatedNode.result.matchLength], astParentNode, outResult);
+    boolean matched = repeatNodeMatch(node, instruction, ncc, &text[repeatedNode.result.matchLength], astParentNode, outResult);
     if (outResult->terminate || !matched) {
         // Didn't end properly, discard,
         outResult->matchLength += repeatedNode.result.matchLength;
@@ -977,7 +1415,7 @@ static boolean repeatNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text
         return False;
     }
 
-    // Push the repeated node,
+    // Accept the repeated node,
     AcceptMatchResult(repeatedNode)
     return True;
 }
@@ -991,8 +1429,7 @@ static void repeatNodeDeleteTree(NCC_Node* tree) {
     if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
 
     // Free our data structures,
-    NFREE(tree->data, "NCC.repeatNodeDeleteTree() tree->data");
-    NFREE(tree      , "NCC.repeatNodeDeleteTree() tree"      );
+    NFREE(tree, "NCC.repeatNodeDeleteTree() tree");
 }
 
 static NCC_Node* createRepeatNode(NCC_Node* parentNode, const char** in_out_rule) {
@@ -1022,8 +1459,8 @@ static NCC_Node* createRepeatNode(NCC_Node* parentNode, const char** in_out_rule
     }
 
     // Create node,
-    RepeatNodeData* nodeData = NMALLOC(sizeof(RepeatNodeData), "NCC.createRepeatNode() nodeData");
-    NCC_Node* node = genericCreateNode(NCC_NodeType.REPEAT, nodeData);
+    NCC_Node* node = genericCreateNode(NCC_NodeType.REPEAT, sizeof(RepeatNodeData));
+    RepeatNodeData* nodeData = node->data;
 
     // Remove parent from the grand-parent and attach this node (repeat) instead,
     genericSetNextNode(grandParentNode, node);
@@ -1042,21 +1479,79 @@ static NCC_Node* createRepeatNode(NCC_Node* parentNode, const char** in_out_rule
 // Anything node
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static boolean anythingNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+// Anything nodes attempt the following tree at every position until it matches. Most positions
+// can't possibly start a match, so we skip them:
+//    => If the following tree starts with literals (like the */ in /\**\*/), we only stop where the
+//       literals are found, searching for them using a Boyer-Moore-Horspool skip table prepared
+//       when the rule is compiled.
+//    => Otherwise, the program interpreters only stop at the characters the following chain can be
+//       attempted at (see "Analysis" below).
+// The following tree fails (with no side effects) at the skipped positions anyway. The terminating
+// zero is never skipped, since whatever the following tree returns there is the result.
+typedef struct AnythingNodeData {
+    const char* delimiter;          // The literals the following tree starts with, if any.
+    LiteralsWords delimiterWords;   // Its length is 0 if there are no such literals.
+    int32_t skips[256];             // How far we can shift the search when a character is at the
+                                    // end of the searched window.
+} AnythingNodeData;
+
+static void prepareDelimiterSearch(NCC_Node* node) {
+    AnythingNodeData* nodeData = node->data;
+    NCC_Node* nextNode = node->nextNode;
+    if (!nextNode || (nextNode->type != NCC_NodeType.LITERALS)) {
+        nodeData->delimiterWords.literalsCount = 0;
+        return;
+    }
+
+    LiteralsNodeData* literalsNodeData = nextNode->data;
+    const char* delimiter = NString.get(&literalsNodeData->literals);
+    int32_t delimiterLength = literalsNodeData->words.literalsCount;
+    nodeData->delimiter = delimiter;
+    nodeData->delimiterWords = literalsNodeData->words;
+    for (int32_t i=0; i<256; i++) nodeData->skips[i] = delimiterLength;
+    for (int32_t i=0; i<delimiterLength-1; i++) nodeData->skips[(unsigned char) delimiter[i]] = delimiterLength-1-i;
+}
+
+// Returns the first position at or after "offset" where the following tree could match,
+static int32_t findDelimiterCandidate(struct NCC* ncc, NCC_Node* node, const NCC_Instruction* instruction, const char* text, int32_t offset) {
+
+    AnythingNodeData* nodeData = node->data;
+    int32_t textLength = ncc->textEnd - text;
+    int32_t delimiterLength = nodeData->delimiterWords.literalsCount;
+    if (delimiterLength) {
+        const char* delimiter = nodeData->delimiter;
+        char lastLiteral = delimiter[delimiterLength-1];
+        for (int32_t position=offset; position+delimiterLength <= textLength; ) {
+            char windowLastLiteral = text[position+delimiterLength-1];
+            if ((windowLastLiteral == lastLiteral) &&
+                literalsMatch(&text[position], ncc->textEnd, delimiter, &nodeData->delimiterWords)) return position;
+            position += nodeData->skips[(unsigned char) windowLastLiteral];
+        }
+        return textLength;
+    }
+
+    if (instruction) {
+        const uint32_t* viableBytes = instruction[1].viableFirstBytes;
+        while (text[offset] && !containsByte(viableBytes, (unsigned char) text[offset])) offset++;
+    }
+    return offset;
+}
+
+static boolean anythingNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
 
     // If no following tree, then match the entire text,
-    int32_t totalMatchLength=0;
-    if (!node->nextNode) {
-        while (text[totalMatchLength]) totalMatchLength++;
+    RuleTree nextTree = getNextTree(node, instruction);
+    if (!treeExists(nextTree)) {
         NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
-        outResult->matchLength = totalMatchLength;
+        outResult->matchLength = ncc->textEnd - text;
         return True;
     }
 
     // There's a following tree. Stop as soon as it's matched,
+    int32_t totalMatchLength = findDelimiterCandidate(ncc, node, instruction, text, 0);
     do {
         // Check if the following tree matches,
-        MatchTree(followingTree, node->nextNode, &text[totalMatchLength], astParentNode, astNodeStacks[0], totalMatchLength, {&followingTree}, 1)
+        MatchTree(followingTree, nextTree, &text[totalMatchLength], astParentNode, totalMatchLength, {&followingTree}, 1)
 
         // Same as with repeat nodes, if the following tree allows matching 0 characters, then this
         // anything node is never going to match anything. We'll only treat a zero-length following
@@ -1085,12 +1580,11 @@ static boolean anythingNodeMatch(NCC_Node* node, struct NCC* ncc, const char* te
         if (followingTreeMatched) DiscardMatchingResult(&followingTree)
 
         // Advance!
-        totalMatchLength++;
+        totalMatchLength = findDelimiterCandidate(ncc, node, instruction, text, totalMatchLength+1);
     } while (True);
 }
 
 static void anythingNodeDeleteTree(NCC_Node* tree) {
-    // This node has no data member to delete.
     if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
     NFREE(tree, "NCC.anythingNodeDeleteTree() tree");
 }
@@ -1100,8 +1594,11 @@ static NCC_Node* createAnythingNode(NCC_Node* parentNode, const char** in_out_ru
     // Skip the *,
     (*in_out_rule)++;
 
-    // Create node,
-    NCC_Node* node = genericCreateNode(NCC_NodeType.ANYTHING, 0);
+    // Create node. The delimiter search is prepared once the following node is known (see
+    // compileChain()),
+    NCC_Node* node = genericCreateNode(NCC_NodeType.ANYTHING, sizeof(AnythingNodeData));
+    AnythingNodeData* nodeData = node->data;
+    nodeData->delimiterWords.literalsCount = 0;
 
     #if NCC_VERBOSE
     NLOGI("NCC", "Created anything node: %s*%s%s", NTCOLOR(HIGHLIGHT), *in_out_rule, NTCOLOR(STREAM_DEFAULT));
@@ -1111,141 +1608,554 @@ static NCC_Node* createAnythingNode(NCC_Node* parentNode, const char** in_out_ru
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Substitute node
+// Memoization
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-typedef struct SubstituteNodeData {
-    NCC_Rule* rule;
+// The outcome of matching a rule at a specific text position. Lives in ncc->memoTable, which is an
+// open addressing hash table,
+typedef struct MemoEntry {
+    NCC_Rule* rule;                  // Null for empty slots.
+    int32_t textOffset;
     boolean silent;
-} SubstituteNodeData;
+    boolean matched;
+    int32_t matchLength;             // Whether matched or not, this is the length reported to the caller.
+    int32_t recordIndex;             // The match record to replay if matched. -1 if there is nothing to replay.
+    int32_t maxMatchLength;          // ncc->maxMatchLength if matching the rule advanced it, -1 otherwise.
+    int32_t maxMatchRuleNamesIndex;  // The rule names that came after this rule in ncc->maxMatchRuleStack (in
+    int32_t maxMatchRuleNamesCount;  // ncc->memoRuleNames) when maxMatchLength was set.
+} MemoEntry;
+
+// A successful (and confirmed) substitute node match that fired AST listeners, directly or through
+// its children. Replaying it fires the same listeners in the same order,
+typedef struct MatchRecord {
+    NCC_Rule* rule;
+    int32_t textOffset;
+    int32_t matchLength;             // The length passed to the rule match listener.
+    int32_t firstChildIndex;         // In ncc->matchRecordChildren.
+    int32_t childrenCount;
+} MatchRecord;
+
+// Match records are pushed to the AST stacks as entries that use this as their rule. The record
+// index is stored in place of the node. This way, records are discarded and accepted along with the
+// AST nodes they belong to. It has no delete listener, so discarding just pops it,
+static NCC_RuleData matchRecordMarker;
+
+#define NCC_MEMO_TABLE_INITIAL_CAPACITY 1024
+
+static inline uint32_t memoHash(NCC_Rule* rule, int32_t textOffset, boolean silent) {
+    uint32_t hash = (uint32_t) (((uintptr_t) rule) >> 4);
+    hash = (hash * 0x9E3779B1u) ^ (uint32_t) textOffset;
+    hash = (hash * 0x85EBCA6Bu) ^ (uint32_t) silent;
+    return hash ^ (hash >> 15);
+}
 
-static boolean substituteNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
-    SubstituteNodeData *nodeData = node->data;
+// Returns the slot holding the specified key, or the empty slot where it should be inserted,
+static MemoEntry* getMemoSlot(struct NCC* ncc, NCC_Rule* rule, int32_t textOffset, boolean silent) {
+    uint32_t mask = NVector.size(&ncc->memoTable) - 1;
+    uint32_t index = memoHash(rule, textOffset, silent) & mask;
+    MemoEntry* entries = (MemoEntry*) ncc->memoTable.objects;
+    do {
+        MemoEntry* entry = &entries[index];
+        if (!entry->rule) return entry;
+        if ((entry->rule == rule) && (entry->textOffset == textOffset) && (entry->silent == silent)) return entry;
+        index = (index + 1) & mask;
+    } while (True);
+}
 
-    // This node attempts to match the rule specified when it was declared, and calls listeners to
-    // create/delete AST nodes in the process:
-    //    - If we are currently not silent, and the rule has listeners to create an AST node, we
-    //      create a new AST node and use it while matching the rule tree as the parent. Otherwise,
-    //      we just use astParentNode.
-    //    - We attempt to match the rule. If failed, we roll back any (delete) any created AST nodes.
-    //    - If match succeeds, that doesn't mean that we should accept it. We call the rule match
-    //      listener to confirm the match. If it fails, we clean up and return.
-    //    - If by matching this node we went further into the text to be matched than any previous
-    //      moment during matching, we keep information about the match length and the stack trace
-    //      of all the substitute nodes leading up to this moment.
-    //    - If match succeeds, we move on to match the following tree as usual with other nodes.
-    //    - Finally, if we haven't created a new AST node, we push the ASTs generated by matching
-    //      the rule to the primary stack. If we have created a new one, we only push it, as the
-    //      other nodes would be attached to it as children.
+static boolean getMemoEntry(struct NCC* ncc, NCC_Rule* rule, int32_t textOffset, boolean silent, MemoEntry* outEntry) {
+    if (!ncc->memoEntriesCount) return False;
+    MemoEntry* entry = getMemoSlot(ncc, rule, textOffset, silent);
+    if (!entry->rule) return False;
+    *outEntry = *entry;
+    return True;
+}
 
-    // Variables needed for cleanup and return value,
-    boolean newAstNodeCreated=False, deleteAstNode=False, discardRule, accepted;
+static void setMemoEntry(struct NCC* ncc, MemoEntry* entry) {
+
+    // Keep the load factor below 0.5. Grow (and rehash) if needed,
+    int32_t capacity = NVector.size(&ncc->memoTable);
+    if ((ncc->memoEntriesCount+1)*2 > capacity) {
+        int32_t newCapacity = capacity ? capacity*2 : NCC_MEMO_TABLE_INITIAL_CAPACITY;
+        struct NVector oldTable = ncc->memoTable;
+        NVector.initialize(&ncc->memoTable, newCapacity, sizeof(MemoEntry));
+        NVector.resize(&ncc->memoTable, newCapacity);
+        NSystemUtils.memset(ncc->memoTable.objects, 0, newCapacity * sizeof(MemoEntry));
+        for (int32_t i=0; i<capacity; i++) {
+            MemoEntry* oldEntry = (MemoEntry*) NVector.get(&oldTable, i);
+            if (oldEntry->rule) *getMemoSlot(ncc, oldEntry->rule, oldEntry->textOffset, oldEntry->silent) = *oldEntry;
+        }
+        NVector.destroy(&oldTable);
+    }
 
-    // Silence the ncc if this node is silent,
-    boolean nccOldSilentState = ncc->silent;
-    ncc->silent |= nodeData->silent;
-
-    // Prepare an AST node data (newAstNode) and attach a new AST node to it,
-    NCC_ASTNode_Data newAstNode = { .rule=&nodeData->rule->data };
-    NCC_createASTNodeListener createASTNode = newAstNode.rule->createASTNodeListener;
-    if (createASTNode && !ncc->silent) {
-        newAstNode.node = createASTNode(newAstNode.rule, astParentNode);
-        newAstNodeCreated = (newAstNode.node!=0);
+    MemoEntry* slot = getMemoSlot(ncc, entry->rule, entry->textOffset, entry->silent);
+    if (!slot->rule) ncc->memoEntriesCount++;
+    *slot = *entry;
+}
 
-        // If we called create, we should call delete, even if it returned a null,
-        deleteAstNode = True;
+// Cached outcomes are only valid for the text they were matched against,
+static void clearMemo(struct NCC* ncc) {
+    if (ncc->memoEntriesCount) {
+        NSystemUtils.memset(ncc->memoTable.objects, 0, NVector.size(&ncc->memoTable) * sizeof(MemoEntry));
+        ncc->memoEntriesCount = 0;
     }
+    NVector.clear(&ncc->memoRuleNames);
+    NVector.clear(&ncc->matchRecords);
+    NVector.clear(&ncc->matchRecordChildren);
+}
 
-    // Match rule on a temporary stack,
-    MatchedASTTree rule;
-    NVector.pushBack(&ncc->parentStack, &node);
-    accepted = discardRule = matchRuleTree(ncc, nodeData->rule->tree, text,
-                                           &rule, newAstNodeCreated ? &newAstNode : astParentNode, &ncc->astNodeStacks[1],
-                                           0, 0, 0);
-    NVector.popBack(&ncc->parentStack, &node);
-    if (rule.result.terminate || !accepted) {
-        // Couldn't match rule tree. Nothing more to do,
-        *outResult = rule.result;
-        goto finish;
+// Collects the match records pushed while matching a rule (they are on the AST stack after
+// "stackMark"), removes them from the stack and creates a new record that has them as its children.
+// Returns the index of the new record, or -1 if the match didn't fire any listeners (nothing to
+// replay),
+static int32_t recordMatch(struct NCC* ncc, NCC_Rule* rule, const char* text, int32_t matchLength, int32_t stackMark) {
+
+    int32_t firstChildIndex = NVector.size(&ncc->matchRecordChildren);
+    int32_t childrenCount = 0;
+    struct NVector* stack = &ncc->astNodeStack;
+    int32_t stackSize = NVector.size(stack);
+    int32_t nextAstNodeIndex = stackMark;
+    for (int32_t i=stackMark; i<stackSize; i++) {
+        NCC_ASTNode_Data* stackEntry = NVector.get(stack, i);
+        if (stackEntry->rule != &matchRecordMarker) {
+            // An AST node, keep it,
+            if (nextAstNodeIndex != i) *((NCC_ASTNode_Data*) NVector.get(stack, nextAstNodeIndex)) = *stackEntry;
+            nextAstNodeIndex++;
+            continue;
+        }
+
+        // A child record. Stack entries are in matching order, so are the children,
+        int32_t childRecordIndex = (int32_t) (intptr_t) stackEntry->node;
+        NVector.pushBack(&ncc->matchRecordChildren, &childRecordIndex);
+        childrenCount++;
     }
+    NVector.resize(stack, nextAstNodeIndex);
+
+    if (!childrenCount && !rule->data.createASTNodeListener && !rule->data.ruleMatchListener) return -1;
+
+    MatchRecord record = {
+        .rule = rule,
+        .textOffset = ((intptr_t) text) - ((intptr_t) ncc->textBeginning),
+        .matchLength = matchLength,
+        .firstChildIndex = firstChildIndex,
+        .childrenCount = childrenCount };
+    NVector.pushBack(&ncc->matchRecords, &record);
+    return NVector.size(&ncc->matchRecords) - 1;
+}
 
-    // Found a match (an unconfirmed one, though). Report,
-    if (nodeData->rule->data.ruleMatchListener && !ncc->silent) {
+// Re-fires the listeners of a recorded match (and its children), pushing the resulting AST nodes to
+// NCC's AST stack,
+static void replayMatchRecord(struct NCC* ncc, int32_t recordIndex, NCC_ASTNode_Data* astParentNode) {
+
+    // Copy the record instead of keeping a pointer into the records vector,
+    MatchRecord record = *((MatchRecord*) NVector.get(&ncc->matchRecords, recordIndex));
 
-        // Copy the matched text so that we can zero terminate it,
-        int32_t matchLength = rule.result.matchLength;
-        char* matchedText = NMALLOC(matchLength+1, "NCC.substituteNodeMatch() matchedText");
-        NSystemUtils.memcpy(matchedText, text, matchLength);
-        matchedText[matchLength] = 0;        // 0-terminate the string.
+    // Create AST node,
+    NCC_ASTNode_Data newAstNode = { .rule=&record.rule->data };
+    boolean newAstNodeCreated = False;
+    if (newAstNode.rule->createASTNodeListener) {
+        newAstNode.node = createASTNode(ncc, newAstNode.rule, astParentNode);
+        newAstNodeCreated = (newAstNode.node!=0);
+    }
+
+    // Children,
+    int32_t stackMark = NVector.size(&ncc->astNodeStack);
+    for (int32_t i=0; i<record.childrenCount; i++) {
+        int32_t childRecordIndex = *((int32_t*) NVector.get(&ncc->matchRecordChildren, record.firstChildIndex + i));
+        replayMatchRecord(ncc, childRecordIndex, newAstNodeCreated ? &newAstNode : astParentNode);
+    }
 
-        // Call the match listener,
+    // Match listener. It accepted this exact match before, so we don't check its result,
+    if (newAstNode.rule->ruleMatchListener) {
         NCC_MatchingData matchingData;
         matchingData.node = newAstNode;
-        matchingData.matchedText = matchedText;
-        matchingData.matchLength = matchLength;
+        matchingData.matchedTextStart = &ncc->textBeginning[record.textOffset];
+        matchingData.matchedTextLength = record.matchLength;
+        matchingData.matchLength = record.matchLength;
+        matchingData.terminate = False;
+        newAstNode.rule->ruleMatchListener(&matchingData);
+    }
+
+    // Same as substitute nodes, a created node replaces its children in the stack,
+    if (newAstNodeCreated) {
+        NVector.resize(&ncc->astNodeStack, stackMark);
+        NVector.pushBack(&ncc->astNodeStack, &newAstNode);
+    }
+}
+
+// Pushes a marker of the specified record into NCC's AST stack,
+static void pushMatchRecordMarker(struct NCC* ncc, int32_t recordIndex) {
+    NCC_ASTNode_Data marker = { .node=(void*) (intptr_t) recordIndex, .rule=&matchRecordMarker };
+    NVector.pushBack(&ncc->astNodeStack, &marker);
+}
+
+// Fires the deferred listeners of a successful match operation. The match record markers left on
+// NCC's AST stack are replayed (in matching order), replacing them with the resulting AST nodes,
+static void commitMatchRecords(struct NCC* ncc) {
+
+    // Replay them on top of the markers, then move the resulting AST nodes down in their place,
+    int32_t markersCount = NVector.size(&ncc->astNodeStack);
+    for (int32_t i=0; i<markersCount; i++) {
+        NCC_ASTNode_Data entry = *((NCC_ASTNode_Data*) NVector.get(&ncc->astNodeStack, i));
+        if (entry.rule == &matchRecordMarker) replayMatchRecord(ncc, (int32_t) (intptr_t) entry.node, 0);
+    }
+    removeASTStackEntries(ncc, 0, markersCount);
+}
+
+// Removes all match record markers from the specified stack,
+static void removeMatchRecordMarkers(struct NVector* stack) {
+    int32_t stackSize = NVector.size(stack);
+    int32_t nextAstNodeIndex = 0;
+    for (int32_t i=0; i<stackSize; i++) {
+        NCC_ASTNode_Data* stackEntry = NVector.get(stack, i);
+        if (stackEntry->rule == &matchRecordMarker) continue;
+        if (nextAstNodeIndex != i) *((NCC_ASTNode_Data*) NVector.get(stack, nextAstNodeIndex)) = *stackEntry;
+        nextAstNodeIndex++;
+    }
+    NVector.resize(stack, nextAstNodeIndex);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Substitute node
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct SubstituteNodeData {
+    NCC_Rule* rule;
+    boolean silent;
+} SubstituteNodeData;
+
+// Sets the longest match length reached during the current match operation, and keeps the names
+// of the rules that lead to it for error reporting: the substitute nodes in the parent stack, the
+// specified rule, then the specified inner rule names (if any). The names are skipped when not
+// tracking errors,
+static void updateMaxMatch(struct NCC* ncc, int32_t totalMatchLength, NCC_Rule* rule, const char** innerRuleNames, int32_t innerRuleNamesCount) {
+    ncc->maxMatchLength = totalMatchLength;
+    if (!ncc->trackErrors) return;
+
+    // Copy the names of all the substitute nodes' rules in the parent stack into the max match
+    // stack,
+    NVector.clear(&ncc->maxMatchRuleStack);
+    int32_t parentNodesCount = NVector.size(&ncc->parentStack);
+    for (int32_t i=0; i<parentNodesCount; i++) {
+        NCC_Node* currentParentNode = *(NCC_Node**) NVector.get(&ncc->parentStack, i);
+        if (currentParentNode->type == NCC_NodeType.SUBSTITUTE) {
+            SubstituteNodeData *parentNodeData = currentParentNode->data;
+            const char* ruleName = NString.get(&parentNodeData->rule->data.ruleName);
+            NVector.pushBack(&ncc->maxMatchRuleStack, &ruleName);
+        }
+    }
+
+    // Add this rule to the stack too,
+    const char* ruleName = NString.get(&rule->data.ruleName);
+    NVector.pushBack(&ncc->maxMatchRuleStack, &ruleName);
+    for (int32_t i=0; i<innerRuleNamesCount; i++) NVector.pushBack(&ncc->maxMatchRuleStack, &innerRuleNames[i]);
+
+    // What's expected next is collected by the failed attempts themselves (see "Expected
+    // characters" above),
+}
+
+// Caches the outcome of matching a rule. If matching the rule advanced ncc->maxMatchLength (since
+// it was "oldMaxMatchLength"), the new max match length and the names of the rules that lead to it
+// are cached as well, so that cache hits report the same errors,
+static void memoizeMatch(struct NCC* ncc, NCC_Rule* rule, int32_t textOffset, boolean matched, NCC_MatchingResult* result, int32_t recordIndex, int32_t oldMaxMatchLength) {
+
+    MemoEntry entry = {
+        .rule = rule,
+        .textOffset = textOffset,
+        .silent = ncc->silent,
+        .matched = matched,
+        .matchLength = result->matchLength,
+        .recordIndex = recordIndex,
+        .maxMatchLength = -1 };
+
+    if (ncc->maxMatchLength > oldMaxMatchLength) {
+        entry.maxMatchLength = ncc->maxMatchLength;
+        entry.maxMatchRuleNamesIndex = NVector.size(&ncc->memoRuleNames);
+        entry.maxMatchRuleNamesCount = 0;
+
+        // The names are only there when tracking errors. Skip the names of the parent substitute
+        // nodes and this rule's,
+        if (ncc->trackErrors) {
+            int32_t parentRulesCount = 0;
+            int32_t parentNodesCount = NVector.size(&ncc->parentStack);
+            for (int32_t i=0; i<parentNodesCount; i++) {
+                NCC_Node* currentParentNode = *(NCC_Node**) NVector.get(&ncc->parentStack, i);
+                if (currentParentNode->type == NCC_NodeType.SUBSTITUTE) parentRulesCount++;
+            }
+            int32_t ruleNamesCount = NVector.size(&ncc->maxMatchRuleStack);
+            for (int32_t i=parentRulesCount+1; i<ruleNamesCount; i++) {
+                NVector.pushBack(&ncc->memoRuleNames, NVector.get(&ncc->maxMatchRuleStack, i));
+                entry.maxMatchRuleNamesCount++;
+            }
+        }
+    }
+
+    setMemoEntry(ncc, &entry);
+}
+
+// The state of matching a substitute node. The matching is split into steps shared by the recursive
+// substituteNodeMatch() and the stackless engine, which calls the same steps from its frames,
+typedef struct SubstituteMatch {
+    SubstituteNodeData nodeData;         // A copy, selection nodes reuse their substitute node.
+    NCC_ASTNode_Data newAstNode;
+    MatchedASTTree rule;
+    boolean newAstNodeCreated, deleteAstNode, discardRule, accepted;
+    boolean nccOldSilentState, nccOldDeferringState;
+    boolean replayLater;                 // Listeners fired only to confirm the match, to be undone and fired again on commit.
+    int32_t recordIndex, textOffset, oldMaxMatchLength;
+} SubstituteMatch;
+
+// Returns True if the rule tree should be matched next (into match->rule, using
+// getSubstituteMatchParent() as the AST parent). Otherwise, the result is already known (the rule
+// can't match here, or was found in the memo): if match->accepted is False, the result is set in
+// outResult and matching is over. If True, the rule match is already confirmed,
+static boolean beginSubstituteMatch(struct NCC* ncc, SubstituteMatch* match, NCC_Node* node, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+
+    match->nodeData = *((SubstituteNodeData*) node->data);
+    match->newAstNodeCreated = match->deleteAstNode = False;
+
+    // Skip rules that can't match here, without creating AST nodes for them,
+    if (!isTreeViable(ncc, getRuleTree(ncc, match->nodeData.rule), text)) {
+        NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+        match->accepted = False;
+        return False;
+    }
+
+    // Silence the ncc if this node is silent,
+    match->nccOldSilentState = ncc->silent;
+    ncc->silent |= match->nodeData.silent;
+
+    // When deferring listeners, only eager rules fire theirs while matching. Their rule trees are
+    // matched eagerly as well, so that their listeners see their AST nodes,
+    match->nccOldDeferringState = ncc->deferring;
+    match->replayLater = ncc->deferring && match->nodeData.rule->data.eagerListeners && !ncc->silent;
+    if (match->replayLater) ncc->deferring = False;
+
+    // Prepare an AST node data (newAstNode),
+    NSystemUtils.memset(&match->newAstNode, 0, sizeof(NCC_ASTNode_Data));
+    match->newAstNode.rule = &match->nodeData.rule->data;
+
+    // Check if we've matched this rule here before,
+    match->recordIndex = -1;
+    match->textOffset = ((intptr_t) text) - ((intptr_t) ncc->textBeginning);
+    match->oldMaxMatchLength = ncc->maxMatchLength;
+    MemoEntry memoEntry;
+    if (ncc->memoize && getMemoEntry(ncc, match->nodeData.rule, match->textOffset, ncc->silent, &memoEntry)) {
+
+        // Whatever was reached inside the rule counts for error reporting,
+        if (memoEntry.maxMatchLength > ncc->maxMatchLength) {
+            updateMaxMatch(ncc, memoEntry.maxMatchLength, match->nodeData.rule,
+                           (const char**) NVector.get(&ncc->memoRuleNames, memoEntry.maxMatchRuleNamesIndex),
+                           memoEntry.maxMatchRuleNamesCount);
+        }
+
+        if (!memoEntry.matched) {
+            NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+            outResult->matchLength = memoEntry.matchLength;
+            ncc->silent = match->nccOldSilentState;
+            ncc->deferring = match->nccOldDeferringState;
+            match->accepted = False;
+            return False;
+        }
+
+        // Replay the AST listeners calls, as if the rule was just matched,
+        MatchedASTTree* rule = &match->rule;
+        rule->astParentNode = astParentNode;
+        rule->astStackMark = NVector.size(&ncc->astNodeStack);
+        NSystemUtils.memset(&rule->result, 0, sizeof(NCC_MatchingResult));
+        rule->result.matchLength = memoEntry.matchLength;
+        if (memoEntry.recordIndex != -1) {
+
+            // When deferring listeners, the record marker is enough,
+            if (!match->nccOldDeferringState) replayMatchRecord(ncc, memoEntry.recordIndex, astParentNode);
+
+            // Use a copy of the record, so that record indices keep reflecting the matching order,
+            MatchRecord record = *((MatchRecord*) NVector.get(&ncc->matchRecords, memoEntry.recordIndex));
+            NVector.pushBack(&ncc->matchRecords, &record);
+            match->recordIndex = NVector.size(&ncc->matchRecords) - 1;
+        }
+        match->accepted = match->discardRule = True;
+        return False;
+    }
+
+    // Attach a new AST node to newAstNode,
+    if (match->newAstNode.rule->createASTNodeListener && !ncc->silent && !ncc->deferring) {
+        match->newAstNode.node = createASTNode(ncc, match->newAstNode.rule, astParentNode);
+        match->newAstNodeCreated = (match->newAstNode.node!=0);
+
+        // If we called create, we should call delete, even if it returned a null,
+        match->deleteAstNode = True;
+    }
+    return True;
+}
+
+static inline NCC_ASTNode_Data* getSubstituteMatchParent(SubstituteMatch* match, NCC_ASTNode_Data* astParentNode) {
+    return match->newAstNodeCreated ? &match->newAstNode : astParentNode;
+}
+
+// Called after the rule tree is matched (match->accepted and match->discardRule set to whether it
+// matched). Calls the rule match listener and caches the outcome. Returns True if the match is
+// confirmed. Otherwise, the result is set in outResult and finishSubstituteMatch() should follow,
+static boolean confirmSubstituteMatch(struct NCC* ncc, SubstituteMatch* match, const char* text, NCC_MatchingResult* outResult) {
+
+    NCC_Rule* ruleData = match->nodeData.rule;
+    MatchedASTTree* rule = &match->rule;
+    if (rule->result.terminate || !match->accepted) {
+        // Couldn't match rule tree. Nothing more to do,
+        *outResult = rule->result;
+        if (ncc->memoize && !rule->result.terminate) memoizeMatch(ncc, ruleData, match->textOffset, False, &rule->result, -1, match->oldMaxMatchLength);
+        return False;
+    }
+
+    // Found a match (an unconfirmed one, though). Report,
+    if (ruleData->data.ruleMatchListener && !ncc->silent && !ncc->deferring) {
+
+        // Call the match listener. The matched text isn't copied, listeners get a view of it
+        // instead (and may copy it using NCC_getMatchedText()),
+        NCC_MatchingData matchingData;
+        matchingData.node = match->newAstNode;
+        matchingData.matchedTextStart = text;
+        matchingData.matchedTextLength = rule->result.matchLength;
+        matchingData.matchLength = rule->result.matchLength;
         matchingData.terminate = False;
 
-        accepted = nodeData->rule->data.ruleMatchListener(&matchingData);
-        NFREE(matchedText, "NCC.substituteNodeMatch() matchedText");
+        match->accepted = ruleData->data.ruleMatchListener(&matchingData);
 
         // The rule match listener is allowed to terminate the matching or override the match length,
-        rule.result.matchLength = matchingData.matchLength;
-        rule.result.terminate   = matchingData.terminate  ;
+        rule->result.matchLength = matchingData.matchLength;
+        rule->result.terminate   = matchingData.terminate  ;
 
         // If match rejected, set the result and return gracefully.
-        if (matchingData.terminate || !accepted) {
-            *outResult = rule.result;
-            goto finish;
+        if (matchingData.terminate || !match->accepted) {
+            *outResult = rule->result;
+            if (ncc->memoize && !matchingData.terminate) memoizeMatch(ncc, ruleData, match->textOffset, False, &rule->result, -1, match->oldMaxMatchLength);
+            return False;
         }
     }
 
-    // Finished matching our rule, time to restore NCC's silence state,
-    ncc->silent = nccOldSilentState;
+    // Record (and cache) the confirmed match,
+    if (ncc->recordMatches && !ncc->silent) match->recordIndex = recordMatch(ncc, ruleData, text, rule->result.matchLength, rule->astStackMark);
+    if (ncc->memoize) memoizeMatch(ncc, ruleData, match->textOffset, True, &rule->result, match->recordIndex, match->oldMaxMatchLength);
+    return True;
+}
+
+// Called once the rule match is confirmed, before matching the following tree. The AST stack
+// entries of the rule are finalized here, so that the following tree is matched on top of them and
+// accepting the whole match needs no copying,
+static void substituteMatchConfirmed(struct NCC* ncc, SubstituteMatch* match, NCC_ASTNode_Data* astParentNode) {
+
+    // Finished matching our rule, time to restore NCC's silence and deferring states,
+    ncc->silent = match->nccOldSilentState;
+    ncc->deferring = match->nccOldDeferringState;
 
     // Confirmed match. If the total match length (not just this node, the ENTIRE match operation)
     // exceeds the maximum recorded this far, we need to collect some information for possible error
     // reporting,
-    int32_t totalMatchLength = rule.result.matchLength + (((intptr_t) text) - ((intptr_t) ncc->textBeginning));
-    if (totalMatchLength > ncc->maxMatchLength) {
-        ncc->maxMatchLength = totalMatchLength;
+    int32_t totalMatchLength = match->rule.result.matchLength + match->textOffset;
+    if (totalMatchLength > ncc->maxMatchLength) updateMaxMatch(ncc, totalMatchLength, match->nodeData.rule, 0, 0);
 
-        // Copy the names of all the substitute nodes' rules in the parent stack into the max match
-        // stack,
-        NVector.clear(&ncc->maxMatchRuleStack);
-        int32_t parentNodesCount = NVector.size(&ncc->parentStack);
-        for (int32_t i=0; i<parentNodesCount; i++) {
-            NCC_Node* currentParentNode = *(NCC_Node**) NVector.get(&ncc->parentStack, i);
-            if (currentParentNode->type == NCC_NodeType.SUBSTITUTE) {
-                SubstituteNodeData *parentNodeData = currentParentNode->data;
-                const char* ruleName = NString.get(&parentNodeData->rule->data.ruleName);
-                NVector.pushBack(&ncc->maxMatchRuleStack, &ruleName);
-            }
+    if (match->replayLater) {
+
+        // The listeners were only fired to confirm the match. Undo them, they will be fired again
+        // when the whole match is committed,
+        if (match->newAstNodeCreated) {
+            NVector.resize(&ncc->astNodeStack, match->rule.astStackMark);
+        } else {
+            DiscardMatchingResult(&match->rule)
+        }
+        if (match->deleteAstNode) {
+            // Rules whose listeners are deferred create no AST nodes, so it has no parent,
+            NCC_deleteASTNodeListener deleteListener = match->newAstNode.rule->deleteASTNodeListener;
+            if (deleteListener) deleteListener(&match->newAstNode, 0);
         }
+        match->deleteAstNode = False;
+    } else if (match->newAstNodeCreated) {
+        match->deleteAstNode = False;
 
-        // Add this node to the stack too,
-        const char* ruleName = NString.get(&nodeData->rule->data.ruleName);
-        NVector.pushBack(&ncc->maxMatchRuleStack, &ruleName);
+        // Any AST nodes created while matching the rule are already the children of our newly
+        // created AST node. As such, they needn't be on the stack. Remove them without deleting
+        // them, and push our new AST node in their place,
+        NVector.resize(&ncc->astNodeStack, match->rule.astStackMark);
+        NVector.pushBack(&ncc->astNodeStack, &match->newAstNode);
+    }
+    if (match->recordIndex != -1) pushMatchRecordMarker(ncc, match->recordIndex);
+
+    // From now on, if the following tree doesn't match, discarding the rule entries (including our
+    // new AST node) rolls back the whole match,
+    match->rule.astParentNode = astParentNode;
+    match->discardRule = True;
+}
+
+// Called when the following tree matched or there is no following tree (outResult zeroed),
+static void acceptSubstituteMatch(SubstituteMatch* match, NCC_MatchingResult* outResult) {
+    match->discardRule = False;
+    outResult->matchLength += match->rule.result.matchLength;
+}
+
+// Cleans up and returns whether the node matched,
+static boolean finishSubstituteMatch(struct NCC* ncc, SubstituteMatch* match, NCC_ASTNode_Data* astParentNode) {
+    if (match->discardRule) DiscardMatchingResult(&match->rule)
+    if (match->deleteAstNode) {
+        NCC_deleteASTNodeListener deleteListener = match->newAstNode.rule->deleteASTNodeListener;
+        if (deleteListener) deleteListener(&match->newAstNode, astParentNode);
+    }
+    ncc->silent = match->nccOldSilentState;
+    ncc->deferring = match->nccOldDeferringState;
+    return match->accepted;
+}
+
+static boolean substituteNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
 
-        // Set the expected next node as well (if no next, check parent stack next (recursively
-        // until you find a next)),
-        // TODO: implement node.toString() ...
+    // This node attempts to match the rule specified when it was declared, and calls listeners to
+    // create/delete AST nodes in the process:
+    //    - If we are currently not silent, and the rule has listeners to create an AST node, we
+    //      create a new AST node and use it while matching the rule tree as the parent. Otherwise,
+    //      we just use astParentNode.
+    //    - We attempt to match the rule. If failed, we roll back any (delete) any created AST nodes.
+    //    - If match succeeds, that doesn't mean that we should accept it. We call the rule match
+    //      listener to confirm the match. If it fails, we clean up and return.
+    //    - If by matching this node we went further into the text to be matched than any previous
+    //      moment during matching, we keep information about the match length and the stack trace
+    //      of all the substitute nodes leading up to this moment.
+    //    - If we have created a new AST node, it replaces the ASTs generated by matching the rule
+    //      on the stack, as they are attached to it as children. Otherwise, they're left as is.
+    //    - If match succeeds, we move on to match the following tree (on top of them) as usual
+    //      with other nodes. If it fails, all of them are discarded.
+    //    - If memoization is on, the outcome of matching the rule (up to and including the rule
+    //      match listener) is cached. When the same rule is matched at the same position again, we
+    //      skip directly to matching the following tree (or failing), replaying the recorded AST
+    //      listeners calls if needed.
+
+    SubstituteMatch match;
+    if (beginSubstituteMatch(ncc, &match, node, text, astParentNode, outResult)) {
+
+        // Match rule,
+        PushParentNode(node)
+        match.accepted = match.discardRule = matchRuleTree(ncc, getRuleTree(ncc, match.nodeData.rule), text,
+                                                           &match.rule, getSubstituteMatchParent(&match, astParentNode),
+                                                           0, 0, 0);
+        PopParentNode(node)
+        if (!confirmSubstituteMatch(ncc, &match, text, outResult)) return finishSubstituteMatch(ncc, &match, astParentNode);
+    } else if (!match.accepted) {
+        return False;
     }
+    substituteMatchConfirmed(ncc, &match, astParentNode);
 
     // Match following tree,
-    int32_t matchLength = rule.result.matchLength;
-    if (node->nextNode) {
+    int32_t matchLength = match.rule.result.matchLength;
+    RuleTree nextTree = getNextTree(node, instruction);
+    if (treeExists(nextTree)) {
         MatchedASTTree nextNode;
         // TODO: do we always need to discard self on terminate? Shouldn't it be already discarded?
         //       We probably don't need to. After all, a terminate or match failure will discard
         //       the tree in this function, the only function where ASTs are created. We can add
         //       a few checks to make sure they really aren't needed.
-        accepted = matchRuleTree(ncc, node->nextNode, &text[matchLength],
-                                 &nextNode, astParentNode, &ncc->astNodeStacks[0],
-                                 0, (MatchedASTTree*[]) {&nextNode}, 1);
+        match.accepted = matchRuleTree(ncc, nextTree, &text[matchLength],
+                                       &nextNode, astParentNode,
+                                       0, (MatchedASTTree*[]) {&nextNode}, 1);
         *outResult = nextNode.result;
-        if (nextNode.result.terminate || !accepted) {
-            outResult->matchLength += rule.result.matchLength;
-            goto finish;
+        if (nextNode.result.terminate || !match.accepted) {
+            outResult->matchLength += matchLength;
+            return finishSubstituteMatch(ncc, &match, astParentNode);
         }
     } else {
         // No following tree, prepare output,
@@ -1253,37 +2163,23 @@ static boolean substituteNodeMatch(NCC_Node* node, struct NCC* ncc, const char*
     }
 
     // Following tree matched or no following tree,
-    discardRule = deleteAstNode = False;
-    if (newAstNodeCreated) {
-
-        // Any AST nodes created while matching the rule are already the children of our newly
-        // created AST node. As such, we needn't push them into the stack. Remove child nodes
-        // without deleting them,
-        NVector.resize(*rule.astNodesStack, rule.astStackMark);
-
-        // Push our new AST node,
-        NVector.pushBack(ncc->astNodeStacks[0], &newAstNode);
-        outResult->matchLength += rule.result.matchLength;
-    } else {
-        // Push the child nodes into the primary stack,
-        AcceptMatchResult(rule)
-    }
-
-    finish:
-    if (discardRule) DiscardMatchingResult(&rule)
-    if (deleteAstNode) {
-        NCC_deleteASTNodeListener deleteListener = newAstNode.rule->deleteASTNodeListener;
-        if (deleteListener) deleteListener(&newAstNode, astParentNode);
-    }
-    ncc->silent = nccOldSilentState;
-    return accepted;
+    acceptSubstituteMatch(&match, outResult);
+    return finishSubstituteMatch(ncc, &match, astParentNode);
 }
 
 static void substituteNodeDeleteTree(NCC_Node* tree) {
     // Note: we don't free the rules, we didn't allocate them.
     if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
-    NFREE(tree->data, "NCC.substituteNodeDeleteTree() tree->data");
-    NFREE(tree      , "NCC.substituteNodeDeleteTree() tree"      );
+    NFREE(tree, "NCC.substituteNodeDeleteTree() tree");
+}
+
+// Sets "string" to the "length" characters starting at "text". Used to print rule names that are
+// looked up right from the rule text,
+static void setStringSpan(struct NString* string, const char* text, int32_t length) {
+    NByteVector.resize(&string->string, length+1);
+    char* characters = (char*) NString.get(string);
+    NSystemUtils.memcpy(characters, text, length);
+    characters[length] = 0;
 }
 
 static NCC_Node* createSubstituteNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule) {
@@ -1324,30 +2220,27 @@ static NCC_Node* createSubstituteNode(struct NCC* ncc, NCC_Node* parentNode, con
         ruleNameLength++;
     } while(True);
 
-    // Extract rule name,
-    char *ruleName = NMALLOC(ruleNameLength+1, "NCC.createSubstituteNode() ruleName");
-    NSystemUtils.memcpy(ruleName, ruleNameBeginning, ruleNameLength);
-    ruleName[ruleNameLength] = 0;
-
     // Look for a match within our defined rules,
-    NCC_Rule* rule = NCC_getRule(ncc, ruleName);
+    NCC_Rule* rule = getRule(ncc, ruleNameBeginning, ruleNameLength);
     if (!rule) {
-        NERROR("NCC", "createSubstituteNode(): couldn't find a rule named: %s%s%s", NTCOLOR(HIGHLIGHT), ruleName, NTCOLOR(STREAM_DEFAULT));
-        NFREE(ruleName, "NCC.createSubstituteNode() ruleName 1");
+        struct NString ruleName;
+        NString.initialize(&ruleName, "");
+        setStringSpan(&ruleName, ruleNameBeginning, ruleNameLength);
+        NERROR("NCC", "createSubstituteNode(): couldn't find a rule named: %s%s%s", NTCOLOR(HIGHLIGHT), NString.get(&ruleName), NTCOLOR(STREAM_DEFAULT));
+        NString.destroy(&ruleName);
         return 0;
     }
 
     // Create the node,
-    SubstituteNodeData* nodeData = NMALLOC(sizeof(SubstituteNodeData), "NCC.createSubstituteNode() nodeData");
-    NCC_Node* node = genericCreateNode(NCC_NodeType.SUBSTITUTE, nodeData);
+    NCC_Node* node = genericCreateNode(NCC_NodeType.SUBSTITUTE, sizeof(SubstituteNodeData));
+    SubstituteNodeData* nodeData = node->data;
     nodeData->rule = rule;
     nodeData->silent = silent;
 
     #if NCC_VERBOSE
-    NLOGI("NCC", "Created substitute node: %s${%s}%s", NTCOLOR(HIGHLIGHT), ruleName, NTCOLOR(STREAM_DEFAULT));
+    NLOGI("NCC", "Created substitute node: %s${%s}%s", NTCOLOR(HIGHLIGHT), NString.get(&rule->data.ruleName), NTCOLOR(STREAM_DEFAULT));
     #endif
 
-    NFREE(ruleName, "NCC.createSubstituteNode() ruleName 2");
     genericSetNextNode(parentNode, node);
     return node;
 }
@@ -1359,11 +2252,148 @@ static NCC_Node* createSubstituteNode(struct NCC* ncc, NCC_Node* parentNode, con
 typedef struct SelectionNodeData {
     struct NVector    attemptedRules;  // SubstituteNodeData
     struct NVector verificationRules;  // NCC_Rule*
+    struct NVector literalsTrie;            // LiteralsTrieNode. See "Literal rules trie" below.
+    struct NVector literalRulesTrieNodes;   // int32_t, per attempted rule. Empty if the trie isn't used.
     NCC_Node* substituteNode;   // Used in matching.
     boolean matchIfIncluded;    // Indicates the verification mode. If true, accept if the matched rule is included in the verification rules, reject otherwise.
 } SelectionNodeData;
 
-static boolean selectionNodeMatch(NCC_Node* node, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+// Literal rules trie:
+// ------------------
+// Selections over keywords and punctuators attempt many rules that are plain literals. Attempting
+// all of them at every position wastes a lot of time, especially when the text matches none of them
+// (as with identifiers checked against the keywords). Instead, the literals of these rules are put
+// in a trie, which is walked once along the text to find the ones that match there. Only these are
+// attempted, along with the rules that aren't plain literals, in their original order. Skipping the
+// rest is safe, they would fail with 0 length and no side effects, just like non-viable trees (see
+// "Analysis" below). The trie is built during the analysis, so it's only used in programs,
+
+#define NCC_MAX_LITERALS_TRIE_MATCHES 16
+
+typedef struct LiteralsTrieNode {
+    unsigned char literal;
+    boolean terminal;                   // The literals of some rule end here.
+    int32_t firstChild, nextSibling;    // Indices in the trie, -1 if none.
+} LiteralsTrieNode;
+
+typedef struct LiteralsTrieMatches {
+    int32_t count;  // -1 if there were too many matches to keep, all rules should be attempted then.
+    int32_t nodes[NCC_MAX_LITERALS_TRIE_MATCHES];
+} LiteralsTrieMatches;
+
+// Returns the literals of the rule if it matches nothing else, 0 otherwise,
+static const char* getRuleLiterals(NCC_Rule* rule) {
+    NCC_Node* node = rule->tree->nextNode;
+    if (!node || node->type != NCC_NodeType.LITERALS || node->nextNode) return 0;
+    return NString.get(&((LiteralsNodeData*) node->data)->literals);
+}
+
+static int32_t getLiteralsTrieChild(struct NVector* trie, int32_t parentIndex, unsigned char literal) {
+
+    // Look for an existing child,
+    LiteralsTrieNode* nodes = (LiteralsTrieNode*) trie->objects;
+    for (int32_t childIndex = nodes[parentIndex].firstChild; childIndex != -1; childIndex = nodes[childIndex].nextSibling) {
+        if (nodes[childIndex].literal == literal) return childIndex;
+    }
+
+    // Not found, add one,
+    int32_t childIndex = NVector.size(trie);
+    LiteralsTrieNode* child = NVector.emplaceBack(trie);
+    LiteralsTrieNode* parent = NVector.get(trie, parentIndex);
+    child->literal = literal;
+    child->terminal = False;
+    child->firstChild = -1;
+    child->nextSibling = parent->firstChild;
+    parent->firstChild = childIndex;
+    return childIndex;
+}
+
+static void prepareLiteralsTrie(SelectionNodeData* nodeData) {
+
+    // Start with the root node only,
+    NVector.clear(&nodeData->literalsTrie);
+    NVector.clear(&nodeData->literalRulesTrieNodes);
+    LiteralsTrieNode* root = NVector.emplaceBack(&nodeData->literalsTrie);
+    NSystemUtils.memset(root, 0, sizeof(LiteralsTrieNode));
+    root->firstChild = root->nextSibling = -1;
+
+    // Add the literals of the literal rules, keeping the node where each ends,
+    int32_t literalRulesCount=0;
+    int32_t attemptedRulesCount = NVector.size(&nodeData->attemptedRules);
+    for (int32_t i=0; i<attemptedRulesCount; i++) {
+        const char* literals = getRuleLiterals(((SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, i))->rule);
+        int32_t nodeIndex = -1;
+        if (literals) {
+            nodeIndex = 0;
+            for (; *literals; literals++) nodeIndex = getLiteralsTrieChild(&nodeData->literalsTrie, nodeIndex, (unsigned char) *literals);
+            ((LiteralsTrieNode*) NVector.get(&nodeData->literalsTrie, nodeIndex))->terminal = True;
+            literalRulesCount++;
+        }
+        NVector.pushBack(&nodeData->literalRulesTrieNodes, &nodeIndex);
+    }
+
+    // A single literal rule is better left to the viability check,
+    if (literalRulesCount < 2) NVector.clear(&nodeData->literalRulesTrieNodes);
+}
+
+static inline boolean literalsTrieUsed(SelectionNodeData* nodeData, const NCC_Instruction* instruction) {
+    return instruction && NVector.size(&nodeData->literalRulesTrieNodes);
+}
+
+static void findLiteralRules(SelectionNodeData* nodeData, const char* text, const char* textEnd, LiteralsTrieMatches* outMatches) {
+
+    // Walk down the trie as long as the text matches, keeping the terminal nodes on the way,
+    const LiteralsTrieNode* nodes = (const LiteralsTrieNode*) nodeData->literalsTrie.objects;
+    outMatches->count = 0;
+    int32_t nodeIndex = nodes[0].firstChild;
+    while (nodeIndex != -1 && text < textEnd) {
+        if (nodes[nodeIndex].literal != (unsigned char) *text) {
+            nodeIndex = nodes[nodeIndex].nextSibling;
+            continue;
+        }
+        if (nodes[nodeIndex].terminal) {
+            if (outMatches->count == NCC_MAX_LITERALS_TRIE_MATCHES) {
+                outMatches->count = -1;
+                return;
+            }
+            outMatches->nodes[outMatches->count++] = nodeIndex;
+        }
+        nodeIndex = nodes[nodeIndex].firstChild;
+        text++;
+    }
+}
+
+static inline boolean isAttemptedRuleFound(struct NCC* ncc, SelectionNodeData* nodeData, int32_t ruleIndex, const LiteralsTrieMatches* matches, const char* text) {
+    int32_t ruleTrieNode = ((int32_t*) nodeData->literalRulesTrieNodes.objects)[ruleIndex];
+    if (ruleTrieNode == -1 || matches->count == -1) return True;
+    for (int32_t i=0; i<matches->count; i++) {
+        if (matches->nodes[i] == ruleTrieNode) return True;
+    }
+
+    // Not found. Attempting the rule would have failed where its literals stop matching the text,
+    if (ncc->trackErrors) expectLiterals(ncc, text, getRuleLiterals(((SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, ruleIndex))->rule));
+    return False;
+}
+
+static boolean isAttemptedRule(SelectionNodeData* nodeData, int32_t ruleId) {
+    int32_t rulesCount = NVector.size(&nodeData->attemptedRules);
+    for (int32_t i=0; i<rulesCount; i++) {
+        SubstituteNodeData* attemptedRule = (SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, i);
+        if (attemptedRule->rule->data.ruleId == ruleId) return True;
+    }
+    return False;
+}
+
+static boolean isVerificationRule(SelectionNodeData* nodeData, int32_t ruleId) {
+    int32_t rulesCount = NVector.size(&nodeData->verificationRules);
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* verificationRule = *(NCC_Rule**) NVector.get(&nodeData->verificationRules, i);
+        if (verificationRule->data.ruleId == ruleId) return True;
+    }
+    return False;
+}
+
+static boolean selectionNodeMatch(NCC_Node* node, const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
     SelectionNodeData *nodeData = node->data;
 
     // Tries all rules in the attemptedRules list, picks the one with longest match length among the
@@ -1372,22 +2402,29 @@ static boolean selectionNodeMatch(NCC_Node* node, struct NCC* ncc, const char* t
 
     // Look for the longest successful match in the attempted rules list,
     MatchedASTTree longestMatchRule;
-    const char* longestMatchRuleName=0;
+    int32_t longestMatchRuleId=-1;
     boolean matchFound=False;
-    #define VERY_NEGATIVE_MATCH_LENGTH (-10000000)   // Outrageously negative, to make sure any match is longer.
     outResult->matchLength = VERY_NEGATIVE_MATCH_LENGTH;
-    int32_t currentNodeStackIndex=1;    // We'll match on temporary stacks 1 and 2, switching as needed.
     int32_t attemptedRulesCount = NVector.size(&nodeData->attemptedRules);
+    boolean useLiteralsTrie = literalsTrieUsed(nodeData, instruction);
+    LiteralsTrieMatches literalRules;
+    if (useLiteralsTrie) findLiteralRules(nodeData, text, ncc->textEnd, &literalRules);
     for (int32_t i=0; i<attemptedRulesCount; i++) {
         SubstituteNodeData* attemptedRuleData = (SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, i);
 
+        // Skip the literal rules that don't match here, as if they failed with 0 length,
+        if (useLiteralsTrie && !isAttemptedRuleFound(ncc, nodeData, i, &literalRules, text)) {
+            if (outResult->matchLength == VERY_NEGATIVE_MATCH_LENGTH) NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+            continue;
+        }
+
         // Matching through a substitute node, this way the top-most rule can be pushed,
         // We'll wrap the rule into a substitute node. This is very convenient, for we can just use
         // the substitute node match, and it'll take care of AST handling for us,
         *((SubstituteNodeData*) nodeData->substituteNode->data) = *attemptedRuleData;
-        NVector.pushBack(&ncc->parentStack, &node);
-        MatchTree(rule, nodeData->substituteNode, text, astParentNode, astNodeStacks[currentNodeStackIndex], 0, {&rule}, 1)
-        NVector.popBack(&ncc->parentStack, &node);
+        PushParentNode(node)
+        MatchTree(rule, ((RuleTree) { .node=nodeData->substituteNode }), text, astParentNode, 0, {&rule}, 1)
+        PopParentNode(node)
 
         // Even if we don't find a match, we still want to keep the maximum match length for error
         // reporting. If we haven't found a match yet, then a simple comparison will do,
@@ -1399,16 +2436,12 @@ static boolean selectionNodeMatch(NCC_Node* node, struct NCC* ncc, const char* t
         // Valid match, compare to the longest (if any),
         if (matchFound) {
             if (rule.result.matchLength > longestMatchRule.result.matchLength) {
-                // The new rule is longer, discard the previous match,
-                DiscardMatchingResult(&longestMatchRule)
+                // The new rule is longer, discard the previous match (which lies below it),
+                discardMatchingResultBelow(ncc, &longestMatchRule, &rule);
 
                 // Set the new one as the longest,
                 longestMatchRule = rule;
-                longestMatchRuleName = NString.get(&attemptedRuleData->rule->data.ruleName);
-
-                // Switch to the other temporary stack, to be able to discard this rule's stack if
-                // a better match is found,
-                currentNodeStackIndex = 3 - currentNodeStackIndex;  // To switch between 1 and 2.
+                longestMatchRuleId = attemptedRuleData->rule->data.ruleId;
             } else {
                 // Not a longer match, discard and go on,
                 DiscardMatchingResult(&rule)
@@ -1417,11 +2450,7 @@ static boolean selectionNodeMatch(NCC_Node* node, struct NCC* ncc, const char* t
             // This is the first match. It's the longest so far,
             matchFound = True;
             longestMatchRule = rule;
-            longestMatchRuleName = NString.get(&attemptedRuleData->rule->data.ruleName);
-
-            // Switch to the other temporary stack, to be able to discard this rule's stack if
-            // a better match is found,
-            currentNodeStackIndex = 3 - currentNodeStackIndex;  // To switch between 1 and 2.
+            longestMatchRuleId = attemptedRuleData->rule->data.ruleId;
         }
     }
 
@@ -1432,27 +2461,18 @@ static boolean selectionNodeMatch(NCC_Node* node, struct NCC* ncc, const char* t
         return False;
     }
 
-    // Now, let's find the match in the verification rules (if any),
-    matchFound = False;
-    int32_t verificationRulesCount = NVector.size(&nodeData->verificationRules);
-    for (int32_t i=0; i<verificationRulesCount; i++) {
-        NCC_Rule* rule = *(NCC_Rule**) NVector.get(&nodeData->verificationRules, i);
-        if (NCString.equals(longestMatchRuleName, NString.get(&rule->data.ruleName))) {
-            matchFound = True;
-            break;
-        }
-    }
-
-    // If either match found when it shouldn't or no match found when it should, reject,
-    if (matchFound ^ nodeData->matchIfIncluded) {
+    // Now, let's find the match in the verification rules (if any). If either match found when it
+    // shouldn't or no match found when it should, reject,
+    if (isVerificationRule(nodeData, longestMatchRuleId) ^ nodeData->matchIfIncluded) {
         *outResult = longestMatchRule.result;
         DiscardMatchingResult(&longestMatchRule)
         return False;
     }
 
     // Verified, match next node as usual,
-    if (node->nextNode) {
-        MatchTree(followingTree, node->nextNode, &text[longestMatchRule.result.matchLength], astParentNode, astNodeStacks[0], longestMatchRule.result.matchLength, {&followingTree COMMA &longestMatchRule}, 2)
+    RuleTree nextTree = getNextTree(node, instruction);
+    if (treeExists(nextTree)) {
+        MatchTree(followingTree, nextTree, &text[longestMatchRule.result.matchLength], astParentNode, longestMatchRule.result.matchLength, {&followingTree COMMA &longestMatchRule}, 2)
         *outResult = followingTree.result;
         if (!followingTreeMatched) {
             outResult->matchLength += longestMatchRule.result.matchLength;
@@ -1463,7 +2483,7 @@ static boolean selectionNodeMatch(NCC_Node* node, struct NCC* ncc, const char* t
         NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
     }
 
-    // Push the matched rule stack,
+    // Accept the matched rule,
     AcceptMatchResult(longestMatchRule)
     return True;
 }
@@ -1474,6 +2494,8 @@ static void selectionNodeDeleteTree(NCC_Node* tree) {
     SelectionNodeData* nodeData = tree->data;
     NVector.destroy(&nodeData->   attemptedRules);
     NVector.destroy(&nodeData->verificationRules);
+    NVector.destroy(&nodeData->literalsTrie);
+    NVector.destroy(&nodeData->literalRulesTrieNodes);
 
     // We've create the substitute node during the initialization of this node. It needs to be freed
     // as well,
@@ -1483,26 +2505,7 @@ static void selectionNodeDeleteTree(NCC_Node* tree) {
     if (tree->nextNode) nodeDeleteTree[tree->nextNode->type](tree->nextNode);
 
     // Free our data structures and self,
-    NFREE(tree->data, "NCC.selectionNodeDeleteTree() tree->data");
-    NFREE(tree      , "NCC.selectionNodeDeleteTree() tree"      );
-}
-
-static NCC_Rule* getAttemptedRule(SelectionNodeData* nodeData, const char* ruleName) {
-    int32_t rulesCount = NVector.size(&nodeData->attemptedRules);
-    for (int32_t i=0; i<rulesCount; i++) {
-        SubstituteNodeData* attemptedRule = (SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, i);
-        if (NCString.equals(ruleName, NString.get(&attemptedRule->rule->data.ruleName))) return attemptedRule->rule;
-    }
-    return 0; // Not found.
-}
-
-static NCC_Rule* getVerificationRule(SelectionNodeData* nodeData, const char* ruleName) {
-    int32_t rulesCount = NVector.size(&nodeData->verificationRules);
-    for (int32_t i=0; i<rulesCount; i++) {
-        NCC_Rule* verificationRule = *(NCC_Rule**) NVector.get(&nodeData->verificationRules, i);
-        if (NCString.equals(ruleName, NString.get(&verificationRule->data.ruleName))) return verificationRule;
-    }
-    return 0; // Not found.
+    NFREE(tree, "NCC.selectionNodeDeleteTree() tree");
 }
 
 static NCC_Node* createSelectionNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule) {
@@ -1517,9 +2520,12 @@ static NCC_Node* createSelectionNode(struct NCC* ncc, NCC_Node* parentNode, cons
     }
 
     // Prepare data structures,
-    SelectionNodeData* nodeData = NMALLOC(sizeof(SelectionNodeData), "NCC.createSelectionNode() nodeData");
+    NCC_Node* node = genericCreateNode(NCC_NodeType.SELECTION, sizeof(SelectionNodeData));
+    SelectionNodeData* nodeData = node->data;
     NVector.initialize(&nodeData->   attemptedRules, 0, sizeof(SubstituteNodeData));
     NVector.initialize(&nodeData->verificationRules, 0, sizeof(NCC_Rule*         ));
+    NVector.initialize(&nodeData->literalsTrie         , 0, sizeof(LiteralsTrieNode));
+    NVector.initialize(&nodeData->literalRulesTrieNodes, 0, sizeof(int32_t         ));
     nodeData->matchIfIncluded = False;
 
     // Parse the node text,
@@ -1554,7 +2560,8 @@ static NCC_Node* createSelectionNode(struct NCC* ncc, NCC_Node* parentNode, cons
         if (currentChar=='{') {
 
             // Parse rule name,
-            NString.set(&ruleName, "");
+            const char* ruleNameBeginning = *in_out_rule;
+            int32_t ruleNameLength=0;
             do {
                 currentChar = *((*in_out_rule)++);
                 if (currentChar=='}') break;
@@ -1562,23 +2569,23 @@ static NCC_Node* createSelectionNode(struct NCC* ncc, NCC_Node* parentNode, cons
                     NERROR("NCC", "createSelectionNode(): couldn't find a matching %s}%s in %s%s%s", NTCOLOR(HIGHLIGHT), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), ruleBeginning, NTCOLOR(STREAM_DEFAULT));
                     goto finish;
                 }
-                NString.append(&ruleName, "%c", currentChar);
+                ruleNameLength++;
             } while(True);
 
-            // Some badly-formed-rule checks,
-            NCC_Rule* rule=0;
+            // Some badly-formed-rule checks. The rule name is only copied for error messages,
+            NCC_Rule* rule = getRule(ncc, ruleNameBeginning, ruleNameLength);
             if (!verificationModeSet) {
                 // Check if the rule exists,
-                rule = NCC_getRule(ncc, NString.get(&ruleName));
                 if (!rule) {
+                    setStringSpan(&ruleName, ruleNameBeginning, ruleNameLength);
                     NERROR("NCC", "createSelectionNode(): couldn't find a rule named: %s%s%s used in %s%s%s", NTCOLOR(HIGHLIGHT), NString.get(&ruleName), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), ruleBeginning, NTCOLOR(STREAM_DEFAULT));
                     goto finish;
                 }
             } else {
                 // Verification rules must be a subset of the attempted rules list. Look for this
                 // rule in the attempted rules list,
-                rule = getAttemptedRule(nodeData, NString.get(&ruleName));
-                if (!rule) {
+                if (!rule || !isAttemptedRule(nodeData, rule->data.ruleId)) {
+                    setStringSpan(&ruleName, ruleNameBeginning, ruleNameLength);
                     NERROR("NCC", "createSelectionNode(): couldn't find a rule named: %s%s%s in the attempted rules list in %s%s%s", NTCOLOR(HIGHLIGHT), NString.get(&ruleName), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), ruleBeginning, NTCOLOR(STREAM_DEFAULT));
                     goto finish;
                 }
@@ -1586,7 +2593,8 @@ static NCC_Node* createSelectionNode(struct NCC* ncc, NCC_Node* parentNode, cons
 
             // Add to the appropriate list,
             if (verificationModeSet) {
-                if (getVerificationRule(nodeData, NString.get(&ruleName))) {
+                if (isVerificationRule(nodeData, rule->data.ruleId)) {
+                    setStringSpan(&ruleName, ruleNameBeginning, ruleNameLength);
                     NERROR("NCC", "createSelectionNode(): rule: %s%s%s is already in the verification rules list of %s%s%s", NTCOLOR(HIGHLIGHT), NString.get(&ruleName), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), ruleBeginning, NTCOLOR(STREAM_DEFAULT));
                     goto finish;
                 }
@@ -1599,7 +2607,8 @@ static NCC_Node* createSelectionNode(struct NCC* ncc, NCC_Node* parentNode, cons
                     goto finish;
                 }
             } else {
-                if (getAttemptedRule(nodeData, NString.get(&ruleName))) {
+                if (isAttemptedRule(nodeData, rule->data.ruleId)) {
+                    setStringSpan(&ruleName, ruleNameBeginning, ruleNameLength);
                     NERROR("NCC", "createSelectionNode(): rule: %s%s%s is already in the attempted rules list of %s%s%s", NTCOLOR(HIGHLIGHT), NString.get(&ruleName), NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), ruleBeginning, NTCOLOR(STREAM_DEFAULT));
                     goto finish;
                 }
@@ -1677,13 +2686,10 @@ static NCC_Node* createSelectionNode(struct NCC* ncc, NCC_Node* parentNode, cons
         }
     } while (True);
 
-    // The node text should be completely parsed by now, create the node,
-    NCC_Node* node = genericCreateNode(NCC_NodeType.SELECTION, nodeData);
-
-    // Create a substitute node to be used in matching,
-    SubstituteNodeData* substituteNodeData = NMALLOC(sizeof(SubstituteNodeData), "NCC.createSelectionNode() substituteNodeData");
-    nodeData->substituteNode = genericCreateNode(NCC_NodeType.SUBSTITUTE, substituteNodeData);
-    substituteNodeData->rule = 0;
+    // The node text should be completely parsed by now. Create a substitute node to be used in
+    // matching,
+    nodeData->substituteNode = genericCreateNode(NCC_NodeType.SUBSTITUTE, sizeof(SubstituteNodeData));
+    ((SubstituteNodeData*) nodeData->substituteNode->data)->rule = 0;
 
     #if NCC_VERBOSE
     NLOGI("NCC", "Created selection node");
@@ -1698,351 +2704,2605 @@ static NCC_Node* createSelectionNode(struct NCC* ncc, NCC_Node* parentNode, cons
     NString.destroy(&ruleName);
     NVector.destroy(&nodeData->   attemptedRules);
     NVector.destroy(&nodeData->verificationRules);
-    NFREE(nodeData, "NCC.createSelectionNode() nodeData");
+    NVector.destroy(&nodeData->literalsTrie);
+    NVector.destroy(&nodeData->literalRulesTrieNodes);
+    NFREE(node, "NCC.createSelectionNode() node");
     return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Helper functions
+// Program
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Constructs a rule tree from rule text,
-static NCC_Node* constructRuleTree(struct NCC* ncc, const char* ruleText) {
-
-    // Every rule tree must start with a root node,
-    NCC_Node* rootNode = createRootNode();
-
-    // Start parsing the rule text,
-    NCC_Node* currentNode = rootNode;
-    const char* remainingText = ruleText;
-    int32_t oldErrorsCount = NError.observeErrors();
-    do {
-        // Parse next node,
-        currentNode = getNextNode(ncc, currentNode, &remainingText);
+const struct NCC_MatchingEngine NCC_MatchingEngine = {
+    .TREE_WALKER = 0,
+    .PROGRAM = 1,
+    .STACKLESS = 2
+};
 
-        // If new errors observed,
-        if (NError.observeErrors()>oldErrorsCount) break;
+// Compiles the chain of nodes starting at "node" (and the trees they own) and appends it to
+// "program". Returns the index of the first instruction of the chain,
+static int32_t compileChain(NCC_Node* node, struct NVector* program) {
+
+    // Compile the chain itself,
+    int32_t chainBeginning = NVector.size(program);
+    for (; node; node = node->nextNode) {
+
+        // Root nodes don't do any matching,
+        if (node->type == NCC_NodeType.ROOT) continue;
+
+        NCC_Instruction* instruction = NVector.emplaceBack(program);
+        NSystemUtils.memset(instruction, 0, sizeof(NCC_Instruction));
+        NSystemUtils.memset(instruction->viableFirstBytes, 0xff, sizeof(instruction->viableFirstBytes));
+        instruction->opCode = node->type;
+        instruction->node = node;
+        if (node->type == NCC_NodeType.LITERALS) {
+            LiteralsNodeData* nodeData = node->data;
+            instruction->literals = NString.get(&nodeData->literals);
+            instruction->literalsWords = nodeData->words;
+        } else if (node->type == NCC_NodeType.LITERAL_RANGE) {
+            LiteralRangeNodeData* nodeData = node->data;
+            instruction->rangeStart = nodeData->rangeStart;
+            instruction->rangeEnd = nodeData->rangeEnd;
+        } else if (node->type == NCC_NodeType.CHARACTER_CLASS) {
+            CharacterClassNodeData* nodeData = node->data;
+            instruction->characterClass = nodeData->characters;
+        } else if (node->type == NCC_NodeType.ANYTHING) {
+            prepareDelimiterSearch(node);
+        }
+    }
+    NCC_Instruction* endInstruction = NVector.emplaceBack(program);
+    NSystemUtils.memset(endInstruction, 0, sizeof(NCC_Instruction));
+    NSystemUtils.memset(endInstruction->viableFirstBytes, 0xff, sizeof(endInstruction->viableFirstBytes));
+    endInstruction->opCode = NCC_OP_END;
+
+    // Compile the owned trees after the chain. Note that the program vector may expand while
+    // compiling, so we can't hold on to instruction pointers,
+    int32_t chainEnd = NVector.size(program) - 1;
+    for (int32_t i=chainBeginning; i<chainEnd; i++) {
+        NCC_Node* currentNode = ((NCC_Instruction*) NVector.get(program, i))->node;
+        if (currentNode->type == NCC_NodeType.OR) {
+
+            // The branches offsets are kept in the node data, which doesn't move,
+            OrNodeData* nodeData = currentNode->data;
+            int32_t branchesCount = NVector.size(&nodeData->branches);
+            NVector.resize(&nodeData->branchPrograms, branchesCount);
+            for (int32_t j=0; j<branchesCount; j++) {
+                int32_t branchBeginning = compileChain(*(NCC_Node**) NVector.get(&nodeData->branches, j), program);
+                *(int32_t*) NVector.get(&nodeData->branchPrograms, j) = branchBeginning - i;
+            }
+            ((NCC_Instruction*) NVector.get(program, i))->branchPrograms = (const int32_t*) nodeData->branchPrograms.objects;
+            continue;
+        }
 
-        // No errors. If we no longer get new nodes, then we've finished the text,
-        if (!currentNode) return rootNode;
-    } while (True);
+        NCC_Node* ownedTree = 0;
+        if (currentNode->type == NCC_NodeType.SUB_RULE) {
+            ownedTree = ((SubRuleNodeData*) currentNode->data)->subRuleTree;
+        } else if (currentNode->type == NCC_NodeType.REPEAT) {
+            ownedTree = ((RepeatNodeData*) currentNode->data)->repeatedNode;
+        }
+        if (ownedTree) {
+            int32_t subProgramBeginning = compileChain(ownedTree, program);
+            ((NCC_Instruction*) NVector.get(program, i))->subProgram = subProgramBeginning - i;
+        }
+    }
 
-    // Failed,
-    nodeDeleteTree[rootNode->type](rootNode);
-    return 0;
+    return chainBeginning;
 }
 
-// Identifies and creates the next rule tree node from the rule text. "in_out_rule" will be modified
-// to point after the returned node text. This function is used to systematically parse rule text
-// into a rule tree,
-static NCC_Node* getNextNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule) {
-
-    // Skip unescaped spaces or tabs,
-    char currentChar = **skipWhiteSpaces(in_out_rule);
-
-    // Handle different token types,
-    switch (currentChar) {
-        case   0: return 0;
-        case '#': return createSelectionNode (ncc, parentNode, in_out_rule);
-        case '@':
-        case '$': return createSubstituteNode(ncc, parentNode, in_out_rule);
-        case '*': return createAnythingNode  (     parentNode, in_out_rule);
-        case '{': return createSubRuleNode   (ncc, parentNode, in_out_rule);
-        case '^': return createRepeatNode    (     parentNode, in_out_rule);
-        case '|': return createOrNode        (ncc, parentNode, in_out_rule);
-        case '-':
-            NERROR("NCC", "getNextNode(): a '%s-%s' must always be preceded by a literal", NTCOLOR(HIGHLIGHT), NTCOLOR(STREAM_DEFAULT));
-            return 0;
-        default: return handleLiteral(parentNode, in_out_rule);
+// Returns the number of instructions the chain starting at "node" (and the trees it owns) compiles
+// into,
+static int32_t getInstructionsCount(NCC_Node* node) {
+
+    // An instruction per node, and an end instruction,
+    int32_t instructionsCount=1;
+    for (; node; node = node->nextNode) {
+        if (node->type == NCC_NodeType.ROOT) continue;
+        instructionsCount++;
+        if (node->type == NCC_NodeType.OR) {
+            OrNodeData* nodeData = node->data;
+            int32_t branchesCount = NVector.size(&nodeData->branches);
+            for (int32_t i=0; i<branchesCount; i++) instructionsCount += getInstructionsCount(*(NCC_Node**) NVector.get(&nodeData->branches, i));
+        } else if (node->type == NCC_NodeType.SUB_RULE) {
+            instructionsCount += getInstructionsCount(((SubRuleNodeData*) node->data)->subRuleTree);
+        } else if (node->type == NCC_NodeType.REPEAT) {
+            instructionsCount += getInstructionsCount(((RepeatNodeData*) node->data)->repeatedNode);
+        }
     }
+    return instructionsCount;
 }
 
-// Could as well be named switch vectors,
-static void switchStacks(struct NVector** stack1, struct NVector** stack2) {
-    struct NVector* temp = *stack1;
-    *stack1 = *stack2;
-    *stack2 = temp;
+static void compileRuleTree(NCC_Node* ruleTree, struct NVector* program) {
+
+    // Programs are kept for as long as their rules exist. Allocate exactly what's needed,
+    NVector.destroy(program);
+    NVector.initialize(program, getInstructionsCount(ruleTree), sizeof(NCC_Instruction));
+    compileChain(ruleTree, program);
 }
 
-// Pushes all the AST nodes after the mark into the NCC's main AST node stack (astNodeStacks[0]),
-static void pushASTStack(struct NCC* ncc, struct NVector* stack, int32_t stackMark) {
+// Matches the literals, literal ranges and character classes at the beginning of a chain of
+// instructions, advancing in_out_matchLength. Returns the first instruction that calls out to a
+// node matching function. If the chain ended or failed before reaching one, returns null and sets
+// outMatched,
+static inline const NCC_Instruction* matchLiterals(const NCC_Instruction* instruction, struct NCC* ncc, const char* text, int32_t* in_out_matchLength, boolean* outMatched) {
 
-    // Get the number of nodes to be moved,
-    int32_t stackSize = NVector.size(stack);
-    int32_t entriesToPush = stackSize - stackMark;
-    if (!entriesToPush) return;
+    const char* textEnd = ncc->textEnd;
+    int32_t matchLength = *in_out_matchLength;
+    do {
+        switch (instruction->opCode) {
 
-    // Moves all the entries after the stack mark to ncc->astNodeStacks[0],
-    int32_t currentMainStackPosition = NVector.size(ncc->astNodeStacks[0]);
-    NVector.resize(ncc->astNodeStacks[0], currentMainStackPosition + entriesToPush);
-    NSystemUtils.memcpy(
-            ncc->astNodeStacks[0]->objects + (currentMainStackPosition * sizeof(NCC_ASTNode_Data)),
-            stack                ->objects + (stackMark                * sizeof(NCC_ASTNode_Data)),
-            entriesToPush * sizeof(NCC_ASTNode_Data));
+            case NCC_OP_LITERALS:
+                if (!literalsMatch(&text[matchLength], textEnd, instruction->literals, &instruction->literalsWords)) goto fail;
+                matchLength += instruction->literalsWords.literalsCount;
+                break;
 
-    // Shrink the original stack to discard the moved nodes,
-    NVector.resize(stack, stackMark);
-}
+            case NCC_OP_LITERAL_RANGE: {
+                unsigned char literal = (unsigned char) text[matchLength];
+                if ((literal < instruction->rangeStart) || (literal > instruction->rangeEnd)) goto fail;
+                matchLength++;
+                break;
+            }
 
-// Discards any AST nodes created when matching the provided tree by calling the appropriate delete
-// listeners,
-static void discardMatchingResult(MatchedASTTree* tree) {
+            case NCC_OP_CHARACTER_CLASS:
+                if (!containsByte(instruction->characterClass, (unsigned char) text[matchLength])) goto fail;
+                matchLength++;
+                break;
 
-    struct NVector* stack = *tree->astNodesStack;
-    NCC_ASTNode_Data currentNode;
-    while (NVector.size(stack) > tree->astStackMark) {
-        NVector.popBack(stack, &currentNode);
+            case NCC_OP_END:
+                *in_out_matchLength = matchLength;
+                *outMatched = True;
+                return 0;
 
-        // Get that specific rule's delete listener,
-        NCC_deleteASTNodeListener deleteListener = currentNode.rule->deleteASTNodeListener;
-        if (deleteListener) {
-            deleteListener(&currentNode, tree->astParentNode);
+            default:
+                *in_out_matchLength = matchLength;
+                return instruction;
+        }
+        instruction++;
+    } while (True);
+
+    // Failed matches still report the length matched so far, and what was expected,
+    fail:
+    if (ncc->trackErrors) {
+        const char* failedText = &text[matchLength];
+        switch (instruction->opCode) {
+            case NCC_OP_LITERALS       : expectLiterals(ncc, failedText, instruction->literals); break;
+            case NCC_OP_LITERAL_RANGE  : expectCharacterRange(ncc, failedText, instruction->rangeStart, instruction->rangeEnd); break;
+            case NCC_OP_CHARACTER_CLASS: expectCharacters(ncc, failedText, instruction->characterClass); break;
+        }
+    }
+    *in_out_matchLength = matchLength;
+    *outMatched = False;
+    return 0;
+}
+
+// Executes a chain of instructions. Literals, literal ranges and character classes are matched right
+// here. The rest of the instructions are handed (along with the rest of the chain) to their node matching functions,
+static boolean programMatch(const NCC_Instruction* instruction, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+
+    int32_t matchLength=0;
+    boolean matched;
+    instruction = matchLiterals(instruction, ncc, text, &matchLength, &matched);
+    if (instruction) {
+        matched = nodeMatch[instruction->opCode](instruction->node, instruction, ncc, &text[matchLength], astParentNode, outResult);
+        outResult->matchLength += matchLength;
+        return matched;
+    }
+
+    NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+    outResult->matchLength = matchLength;
+    return matched;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Analysis
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Before matching, every chain of every program gets a summary: the bytes a non-empty match of it
+// can start with (its FIRST set), whether it can match without consuming anything (nullable), and
+// whether it can confirm substitute nodes without consuming anything (which has side effects, like
+// calling listeners and updating the max match length). When a chain is neither nullable nor has
+// empty effects, attempting it at a byte outside its FIRST set is a sure failure of 0 length with
+// no side effects. The interpreters skip such attempts (see isTreeViable()). This is what lets or
+// nodes, repeat nodes and selection nodes skip the alternatives that can't start at the current
+// byte.
+//
+// Rules refer to each other (even recursively), so the rules summaries are computed iteratively
+// until none of them changes. They only grow with every iteration, so this is guaranteed to end.
+// Summaries don't depend on listeners, as these can be changed at any time through the rule data.
+
+static void summarizeChain(struct NCC* ncc, NCC_Instruction* instruction, boolean setViableFirstBytes, TreeSummary* outSummary);
+
+static void summarizeSubstitute(NCC_Rule* rule, TreeSummary* outSummary) {
+    *outSummary = rule->summary;
+
+    // Empty matches of the rule get confirmed. Also, a match listener may extend them to any length,
+    if (rule->summary.nullable) {
+        outSummary->hasEmptyEffects = True;
+        NSystemUtils.memset(outSummary->firstBytes, 0xff, sizeof(outSummary->firstBytes));
+    }
+}
+
+// Summarizes what a single instruction matches, not taking the following instructions into account,
+static void summarizeInstruction(struct NCC* ncc, NCC_Instruction* instruction, boolean setViableFirstBytes, TreeSummary* outSummary) {
+
+    NSystemUtils.memset(outSummary, 0, sizeof(TreeSummary));
+    TreeSummary subSummary;
+    int32_t opCode = instruction->opCode;
+    if (opCode == NCC_OP_LITERALS) {
+        addByte(outSummary->firstBytes, instruction->literals[0]);
+    } else if (opCode == NCC_OP_LITERAL_RANGE) {
+        addByteRange(outSummary->firstBytes, instruction->rangeStart, instruction->rangeEnd);
+    } else if (opCode == NCC_OP_CHARACTER_CLASS) {
+        addBytes(outSummary->firstBytes, instruction->characterClass);
+    } else if (opCode == NCC_NodeType.OR) {
+        int32_t branchesCount = NVector.size(&((OrNodeData*) instruction->node->data)->branches);
+        for (int32_t i=0; i<branchesCount; i++) {
+            summarizeChain(ncc, &instruction[instruction->branchPrograms[i]], setViableFirstBytes, &subSummary);
+            addBytes(outSummary->firstBytes, subSummary.firstBytes);
+            outSummary->nullable        |= subSummary.nullable;
+            outSummary->hasEmptyEffects |= subSummary.hasEmptyEffects;
+        }
+    } else if (opCode == NCC_NodeType.SUB_RULE) {
+        summarizeChain(ncc, &instruction[instruction->subProgram], setViableFirstBytes, outSummary);
+    } else if (opCode == NCC_NodeType.REPEAT) {
+        summarizeChain(ncc, &instruction[instruction->subProgram], setViableFirstBytes, outSummary);
+        outSummary->nullable = True;
+    } else if (opCode == NCC_NodeType.ANYTHING) {
+        addByteRange(outSummary->firstBytes, 1, 255);
+        outSummary->nullable = True;
+    } else if (opCode == NCC_NodeType.SUBSTITUTE) {
+        summarizeSubstitute(((SubstituteNodeData*) instruction->node->data)->rule, outSummary);
+    } else if (opCode == NCC_NodeType.SELECTION) {
+        SelectionNodeData* nodeData = instruction->node->data;
+        int32_t attemptedRulesCount = NVector.size(&nodeData->attemptedRules);
+        for (int32_t i=0; i<attemptedRulesCount; i++) {
+            summarizeSubstitute(((SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, i))->rule, &subSummary);
+            addBytes(outSummary->firstBytes, subSummary.firstBytes);
+            outSummary->nullable        |= subSummary.nullable;
+            outSummary->hasEmptyEffects |= subSummary.hasEmptyEffects;
+        }
+    }
+}
+
+// Summarizes the chain starting at "instruction". Every instruction is the beginning of a chain (the
+// tree following the instruction before it). If "setViableFirstBytes", the viable bytes of all of
+// them are set,
+static void summarizeChain(struct NCC* ncc, NCC_Instruction* instruction, boolean setViableFirstBytes, TreeSummary* outSummary) {
+
+    // Find the end of the chain,
+    int32_t chainLength=0;
+    while (instruction[chainLength].opCode != NCC_OP_END) chainLength++;
+
+    // Walk the chain backwards, prepending one instruction at a time,
+    NSystemUtils.memset(outSummary, 0, sizeof(TreeSummary));
+    outSummary->nullable = True;
+    TreeSummary instructionSummary;
+    for (int32_t i=chainLength-1; i>=0; i--) {
+        summarizeInstruction(ncc, &instruction[i], setViableFirstBytes, &instructionSummary);
+        if (instructionSummary.nullable) {
+            addBytes(instructionSummary.firstBytes, outSummary->firstBytes);
+            instructionSummary.hasEmptyEffects |= outSummary->hasEmptyEffects;
+            instructionSummary.nullable = outSummary->nullable;
+        }
+        *outSummary = instructionSummary;
+
+        if (setViableFirstBytes) {
+            if (outSummary->nullable || outSummary->hasEmptyEffects) {
+                NSystemUtils.memset(instruction[i].viableFirstBytes, 0xff, sizeof(instruction[i].viableFirstBytes));
+            } else {
+                NSystemUtils.memcpy(instruction[i].viableFirstBytes, outSummary->firstBytes, sizeof(instruction[i].viableFirstBytes));
+            }
+        }
+    }
+}
+
+static boolean summariesEqual(TreeSummary* summary1, TreeSummary* summary2) {
+    if ((summary1->nullable != summary2->nullable) || (summary1->hasEmptyEffects != summary2->hasEmptyEffects)) return False;
+    for (int32_t i=0; i<8; i++) {
+        if (summary1->firstBytes[i] != summary2->firstBytes[i]) return False;
+    }
+    return True;
+}
+
+static void analyzeRules(struct NCC* ncc) {
+
+    // Start from the smallest possible summaries (matching nothing),
+    int32_t rulesCount = NVector.size(&ncc->rules);
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = *((NCC_Rule**) NVector.get(&ncc->rules, i));
+        NSystemUtils.memset(&rule->summary, 0, sizeof(TreeSummary));
+    }
+
+    // Grow them until they stabilize,
+    boolean changed;
+    do {
+        changed = False;
+        for (int32_t i=0; i<rulesCount; i++) {
+            NCC_Rule* rule = *((NCC_Rule**) NVector.get(&ncc->rules, i));
+            TreeSummary summary;
+            summarizeChain(ncc, (NCC_Instruction*) rule->program.objects, False, &summary);
+            if (!summariesEqual(&summary, &rule->summary)) {
+                rule->summary = summary;
+                changed = True;
+            }
+        }
+    } while (changed);
+
+    // Set the viable first bytes of all the instructions,
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = *((NCC_Rule**) NVector.get(&ncc->rules, i));
+        TreeSummary summary;
+        summarizeChain(ncc, (NCC_Instruction*) rule->program.objects, True, &summary);
+    }
+
+    // Prepare the literal rules tries of the selection nodes,
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = *((NCC_Rule**) NVector.get(&ncc->rules, i));
+        int32_t instructionsCount = NVector.size(&rule->program);
+        for (int32_t j=0; j<instructionsCount; j++) {
+            NCC_Instruction* instruction = NVector.get(&rule->program, j);
+            if (instruction->opCode == NCC_NodeType.SELECTION) prepareLiteralsTrie(instruction->node->data);
+        }
+    }
+    ncc->rulesAnalyzed = True;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Stackless engine
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The stackless engine executes the same programs using the same matching logic as the node
+// matching functions, but instead of calling each other recursively, every call pushes a frame to
+// ncc->matchingFrames. A frame keeps the local variables of a node matching function and the point
+// where it should resume (its state). Stepping a frame runs it until it either calls a tree (pushes
+// the callee frame and returns to the loop in stacklessMatch()), or returns (pops itself and hands
+// its result to the frame below it, its caller). Literals and literal ranges need no frames, they
+// are matched right away when a chain is called.
+//
+// Frames are allocated in blocks and reused, so they never move. This allows passing pointers
+// to their members (like a newly created AST node) as if they were local variables.
+//
+// The frame steps mirror the control flow of their node matching functions exactly, so that all
+// engines produce identical results. When changing one, change the other.
+
+typedef struct OrNodeLocals {
+    MatchedASTTree branch, followingTree, bestBranch, bestFollowingTree;
+    boolean branchMatched, followingTreeMatched, matchFound, branchMatchFound;
+    int32_t branchIndex;
+    int32_t triedLengths[NCC_OR_TRIED_LENGTHS_COUNT], triedLengthsCount;
+} OrNodeLocals;
+
+typedef struct SubRuleNodeLocals {
+    MatchedASTTree subRule, followingTree;
+    boolean subRuleMatched, followingTreeMatched;
+} SubRuleNodeLocals;
+
+typedef struct RepeatNodeLocals {
+    MatchedASTTree repeatedNode, followingTree;
+    boolean repeatedNodeMatched, followingTreeMatched;
+} RepeatNodeLocals;
+
+typedef struct AnythingNodeLocals {
+    MatchedASTTree followingTree;
+    boolean followingTreeMatched;
+    int32_t totalMatchLength;
+} AnythingNodeLocals;
+
+typedef struct SubstituteNodeLocals {
+    SubstituteMatch match;
+    MatchedASTTree nextNode;
+} SubstituteNodeLocals;
+
+typedef struct SelectionNodeLocals {
+    MatchedASTTree rule, longestMatchRule, followingTree;
+    boolean ruleMatched, followingTreeMatched, matchFound, useLiteralsTrie;
+    int32_t longestMatchRuleId;
+    int32_t attemptedRuleIndex;
+    LiteralsTrieMatches literalRules;
+} SelectionNodeLocals;
+
+typedef struct MatchingFrame {
+    int32_t type;                       // The type of the node being matched. ROOT for bottom frames.
+    int32_t state;                      // Where to resume the next time this frame is stepped.
+    NCC_Node* node;
+    const NCC_Instruction* instruction;
+    const char* text;
+    NCC_ASTNode_Data* astParentNode;
+    int32_t prefixLength;               // The length of the literals matched before this node in its
+                                        // chain. Added to the result upon returning.
+    NCC_MatchingResult result;          // The outResult of the node matching function.
+
+    // Set when a called tree returns,
+    boolean calleeMatched;
+    NCC_MatchingResult calleeResult;
+
+    union {
+        OrNodeLocals orNode;
+        SubRuleNodeLocals subRuleNode;
+        RepeatNodeLocals repeatNode;
+        AnythingNodeLocals anythingNode;
+        SubstituteNodeLocals substituteNode;
+        SelectionNodeLocals selectionNode;
+    } locals;
+} MatchingFrame;
+
+static inline MatchingFrame* getTopFrame(struct NCC* ncc) {
+    return *(MatchingFrame**) NVector.get(&ncc->matchingFrames, ncc->matchingDepth-1);
+}
+
+#define NCC_MATCHING_FRAMES_BLOCK_SIZE 64
+
+static MatchingFrame* pushFrame(struct NCC* ncc, int32_t type) {
+
+    // Allocate new frames only if all previously allocated ones are in use,
+    if (ncc->matchingDepth == NVector.size(&ncc->matchingFrames)) {
+        MatchingFrame* newFrames = NMALLOC(sizeof(MatchingFrame) * NCC_MATCHING_FRAMES_BLOCK_SIZE, "NCC.pushFrame() newFrames");
+        for (int32_t i=0; i<NCC_MATCHING_FRAMES_BLOCK_SIZE; i++) {
+            MatchingFrame* newFrame = &newFrames[i];
+            NVector.pushBack(&ncc->matchingFrames, &newFrame);
+        }
+    }
+    ncc->matchingDepth++;
+    if (ncc->matchingDepth > ncc->peakMatchingDepth) ncc->peakMatchingDepth = ncc->matchingDepth;
+
+    MatchingFrame* frame = getTopFrame(ncc);
+    frame->type = type;
+    frame->state = 0;
+    return frame;
+}
+
+// The stackless counterpart of calling a node matching function,
+static void pushNodeFrame(struct NCC* ncc, NCC_Node* node, const NCC_Instruction* instruction, const char* text, NCC_ASTNode_Data* astParentNode, int32_t prefixLength) {
+    MatchingFrame* frame = pushFrame(ncc, node->type);
+    frame->node = node;
+    frame->instruction = instruction;
+    frame->text = text;
+    frame->astParentNode = astParentNode;
+    frame->prefixLength = prefixLength;
+}
+
+// Hands a result to the frame on top (the caller),
+static inline void deliverResult(struct NCC* ncc, boolean matched, NCC_MatchingResult* result) {
+    MatchingFrame* caller = getTopFrame(ncc);
+    caller->calleeMatched = matched;
+    caller->calleeResult = *result;
+}
+
+// Pops the frame on top and hands its result to its caller,
+static void returnFrame(struct NCC* ncc, boolean matched) {
+    MatchingFrame* frame = getTopFrame(ncc);
+    NCC_MatchingResult result = frame->result;
+    result.matchLength += frame->prefixLength;
+    ncc->matchingDepth--;
+    deliverResult(ncc, matched, &result);
+}
+
+// The stackless counterpart of programMatch(). If the chain ends before reaching an instruction
+// that needs a frame, the result is delivered right away,
+static void pushTree(struct NCC* ncc, RuleTree tree, const char* text, NCC_ASTNode_Data* astParentNode) {
+
+    // Only selection nodes call single node trees (their substitute node),
+    if (tree.node) {
+        pushNodeFrame(ncc, tree.node, 0, text, astParentNode, 0);
+        return;
+    }
+
+    int32_t matchLength=0;
+    boolean matched;
+    const NCC_Instruction* instruction = matchLiterals(tree.instruction, ncc, text, &matchLength, &matched);
+    if (instruction) {
+        pushNodeFrame(ncc, instruction->node, instruction, &text[matchLength], astParentNode, matchLength);
+        return;
+    }
+
+    NCC_MatchingResult result;
+    NSystemUtils.memset(&result, 0, sizeof(NCC_MatchingResult));
+    result.matchLength = matchLength;
+    deliverResult(ncc, matched, &result);
+}
+
+// The stackless counterpart of matchRuleTree(). Once the caller is stepped again, it should collect
+// the result using finishCall(),
+static void callTree(struct NCC* ncc, RuleTree tree, const char* text, MatchedASTTree* outMatchingResult, NCC_ASTNode_Data* astParentNode) {
+    outMatchingResult->astParentNode = astParentNode;
+    outMatchingResult->astStackMark = NVector.size(&ncc->astNodeStack);
+    if (!isTreeViable(ncc, tree, text)) {
+        NCC_MatchingResult result;
+        NSystemUtils.memset(&result, 0, sizeof(NCC_MatchingResult));
+        deliverResult(ncc, False, &result);
+        return;
+    }
+    pushTree(ncc, tree, text, astParentNode);
+}
+
+static boolean finishCall(
+        struct NCC* ncc, MatchingFrame* frame, MatchedASTTree* matchingResult,
+        int32_t lengthToAddIfTerminated, MatchedASTTree** astTreesToDiscardIfTerminated, int32_t astTreesToDiscardCount) {
+
+    matchingResult->result = frame->calleeResult;
+
+    // Same as matchRuleTree(),
+    if (matchingResult->result.terminate) {
+        matchingResult->result.matchLength += lengthToAddIfTerminated;
+        for (int32_t i=0; i<astTreesToDiscardCount; i++) DiscardMatchingResult(astTreesToDiscardIfTerminated[i]);
+    }
+    return frame->calleeMatched;
+}
+
+// Frame steps counterparts of the MatchTree macro. CallTree sets the state to resume at, and
+// returns to the matching loop. ResumeTree collects the results at that state,
+#define CallTree(treeName, ruleTree, text, astParentNode, resumeState) { \
+    frame->state = resumeState; \
+    callTree(ncc, ruleTree, text, &locals->treeName, astParentNode); \
+    return; }
+
+#define ResumeTree(treeName, lengthToAddIfTerminated, deleteList, deleteCount) \
+    locals->treeName ## Matched = finishCall( \
+            ncc, frame, &locals->treeName, \
+            lengthToAddIfTerminated, (MatchedASTTree*[]) deleteList, deleteCount); \
+    if (locals->treeName.result.terminate) { \
+        *outResult = locals->treeName.result; \
+        ReturnFrame(locals->treeName ## Matched) \
+    }
+
+#define ReturnFrame(matched) { \
+    returnFrame(ncc, matched); \
+    return; }
+
+static void orNodeStep(struct NCC* ncc, MatchingFrame* frame) {
+    OrNodeLocals* locals = &frame->locals.orNode;
+    NCC_Node* node = frame->node;
+    const char* text = frame->text;
+    NCC_ASTNode_Data* astParentNode = frame->astParentNode;
+    NCC_MatchingResult* outResult = &frame->result;
+    OrNodeData* nodeData = node->data;
+    RuleTree nextTree = getNextTree(node, frame->instruction);
+    int32_t branchesCount = NVector.size(&nodeData->branches);
+    int32_t branchLength, totalLength;
+
+    switch (frame->state) {
+        case 0:
+            setEmptyMatch(ncc, &locals->bestBranch       , astParentNode);
+            setEmptyMatch(ncc, &locals->bestFollowingTree, astParentNode);
+            locals->matchFound = locals->branchMatchFound = False;
+            locals->triedLengthsCount = 0;
+            outResult->matchLength = VERY_NEGATIVE_MATCH_LENGTH;
+            locals->branchIndex = 0;
+            goto attemptBranch;
+
+        case 1:
+            ResumeTree(branch, 0, {&locals->branch COMMA &locals->bestFollowingTree COMMA &locals->bestBranch}, 3)
+            PopParentNode(node)
+
+            if (!locals->branchMatched) {
+                if (!locals->branchMatchFound && locals->branch.result.matchLength > outResult->matchLength) *outResult = locals->branch.result;
+                goto nextBranch;
+            }
+            branchLength = locals->branch.result.matchLength;
+
+            if (!treeExists(nextTree)) {
+                if (!locals->matchFound || branchLength > locals->bestBranch.result.matchLength) {
+                    discardMatchingResultBelow(ncc, &locals->bestBranch, &locals->branch);
+                    locals->bestBranch = locals->branch;
+                    locals->matchFound = True;
+                } else {
+                    DiscardMatchingResult(&locals->branch)
+                }
+                goto nextBranch;
+            }
+
+            if (isLengthTried(locals->triedLengths, locals->triedLengthsCount, branchLength)) {
+                DiscardMatchingResult(&locals->branch)
+                goto nextBranch;
+            }
+            if (locals->triedLengthsCount < NCC_OR_TRIED_LENGTHS_COUNT) locals->triedLengths[locals->triedLengthsCount++] = branchLength;
+            CallTree(followingTree, nextTree, &text[branchLength], astParentNode, 2)
+
+        case 2:
+            branchLength = locals->branch.result.matchLength;
+            ResumeTree(followingTree, branchLength, {&locals->followingTree COMMA &locals->branch COMMA &locals->bestFollowingTree COMMA &locals->bestBranch}, 4)
+            totalLength = branchLength + locals->followingTree.result.matchLength;
+            if (!locals->followingTreeMatched) {
+                if (!locals->matchFound && (!locals->branchMatchFound || totalLength > outResult->matchLength)) {
+                    *outResult = locals->followingTree.result;
+                    outResult->matchLength = totalLength;
+                }
+                locals->branchMatchFound = True;
+                DiscardMatchingResult(&locals->branch)
+                goto nextBranch;
+            }
+            locals->branchMatchFound = True;
+
+            if (!locals->matchFound || totalLength > locals->bestBranch.result.matchLength + locals->bestFollowingTree.result.matchLength) {
+                locals->followingTree.astStackMark -= discardMatchingResultBelow(ncc, &locals->bestBranch, &locals->branch);
+                locals->bestBranch = locals->branch;
+                locals->bestFollowingTree = locals->followingTree;
+                locals->matchFound = True;
+            } else {
+                DiscardMatchingResult(&locals->followingTree)
+                DiscardMatchingResult(&locals->branch)
+            }
+
+            nextBranch:
+            locals->branchIndex++;
+
+            attemptBranch:
+            if (locals->branchIndex < branchesCount) {
+                PushParentNode(node)
+                CallTree(branch, getBranchTree(nodeData, frame->instruction, locals->branchIndex), text, astParentNode, 1)
+            }
+
+            if (!locals->matchFound) {
+                if (outResult->matchLength==VERY_NEGATIVE_MATCH_LENGTH) NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+                ReturnFrame(False)
+            }
+
+            NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+            AcceptMatchResult(locals->bestBranch)
+            AcceptMatchResult(locals->bestFollowingTree)
+            ReturnFrame(True)
+    }
+}
+
+static void subRuleNodeStep(struct NCC* ncc, MatchingFrame* frame) {
+    SubRuleNodeLocals* locals = &frame->locals.subRuleNode;
+    NCC_Node* node = frame->node;
+    NCC_ASTNode_Data* astParentNode = frame->astParentNode;
+    NCC_MatchingResult* outResult = &frame->result;
+    SubRuleNodeData* nodeData = node->data;
+    RuleTree nextTree = getNextTree(node, frame->instruction);
+
+    switch (frame->state) {
+        case 0:
+            PushParentNode(node)
+            CallTree(subRule, getSubTree(nodeData->subRuleTree, frame->instruction), frame->text, astParentNode, 1)
+
+        case 1:
+            ResumeTree(subRule, 0, {&locals->subRule}, 1)
+            PopParentNode(node)
+            if (!locals->subRuleMatched) {
+                *outResult = locals->subRule.result;
+                ReturnFrame(False)
+            }
+            if (treeExists(nextTree)) CallTree(followingTree, nextTree, &frame->text[locals->subRule.result.matchLength], astParentNode, 2)
+            NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+            break;
+
+        case 2:
+            ResumeTree(followingTree, locals->subRule.result.matchLength, {&locals->followingTree COMMA &locals->subRule}, 2)
+            *outResult = locals->followingTree.result;
+            if (!locals->followingTreeMatched) {
+                outResult->matchLength += locals->subRule.result.matchLength;
+                DiscardMatchingResult(&locals->subRule)
+                ReturnFrame(False)
+            }
+            break;
+    }
+
+    AcceptMatchResult(locals->subRule)
+    ReturnFrame(True)
+}
+
+static void repeatNodeStep(struct NCC* ncc, MatchingFrame* frame) {
+    RepeatNodeLocals* locals = &frame->locals.repeatNode;
+    NCC_Node* node = frame->node;
+    const char* text = frame->text;
+    NCC_ASTNode_Data* astParentNode = frame->astParentNode;
+    NCC_MatchingResult* outResult = &frame->result;
+    RepeatNodeData* nodeData = node->data;
+    RuleTree nextTree = getNextTree(node, frame->instruction);
+    RuleTree repeatedTree = getSubTree(nodeData->repeatedNode, frame->instruction);
+
+    // Repeating pushes another frame of this node, the same way repeatNodeMatch() calls itself. Only
+    // it's the heap that grows, not the native stack,
+    switch (frame->state) {
+        case 0:
+            if (!treeExists(nextTree)) {
+                PushParentNode(node)
+                CallTree(repeatedNode, repeatedTree, text, astParentNode, 1)
+            }
+            CallTree(followingTree, nextTree, text, astParentNode, 3)
+
+        // No following tree,
+        case 1:
+            ResumeTree(repeatedNode, 0, {&locals->repeatedNode}, 1)
+            PopParentNode(node)
+            if (!locals->repeatedNodeMatched) {
+                NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+                ReturnFrame(True)
+            } else if (locals->repeatedNode.result.matchLength==0) {
+                DiscardMatchingResult(&locals->repeatedNode)
+                NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+                ReturnFrame(True)
+            }
+            frame->state = 2;
+            pushNodeFrame(ncc, node, frame->instruction, &text[locals->repeatedNode.result.matchLength], astParentNode, 0);
+            return;
+
+        case 2:
+            *outResult = frame->calleeResult;
+            if (outResult->terminate) {
+                outResult->matchLength += locals->repeatedNode.result.matchLength;
+                ReturnFrame(True)
+            }
+            AcceptMatchResult(locals->repeatedNode)
+            ReturnFrame(True)
+
+        // Following tree exists,
+        case 3:
+            ResumeTree(followingTree, 0, {&locals->followingTree}, 1)
+            *outResult = locals->followingTree.result;
+            if (locals->followingTreeMatched && locals->followingTree.result.matchLength!=0) ReturnFrame(True)
+            PushParentNode(node)
+            CallTree(repeatedNode, repeatedTree, text, astParentNode, 4)
+
+        case 4:
+            ResumeTree(repeatedNode, 0, {&locals->followingTree COMMA &locals->repeatedNode}, 2)
+            PopParentNode(node)
+            if (!locals->repeatedNodeMatched || locals->repeatedNode.result.matchLength==0) {
+                if (locals->repeatedNodeMatched) DiscardMatchingResult(&locals->repeatedNode)
+                if (locals->followingTreeMatched) ReturnFrame(True)
+                outResult->matchLength += locals->repeatedNode.result.matchLength;
+                ReturnFrame(False)
+            }
+            discardMatchingResultBelow(ncc, &locals->followingTree, &locals->repeatedNode);
+            frame->state = 5;
+            pushNodeFrame(ncc, node, frame->instruction, &text[locals->repeatedNode.result.matchLength], astParentNode, 0);
+            return;
+
+        case 5:
+            *outResult = frame->calleeResult;
+            if (outResult->terminate || !frame->calleeMatched) {
+                outResult->matchLength += locals->repeatedNode.result.matchLength;
+                DiscardMatchingResult(&locals->repeatedNode)
+                ReturnFrame(False)
+            }
+            AcceptMatchResult(locals->repeatedNode)
+            ReturnFrame(True)
+    }
+}
+
+static void anythingNodeStep(struct NCC* ncc, MatchingFrame* frame) {
+    AnythingNodeLocals* locals = &frame->locals.anythingNode;
+    const char* text = frame->text;
+    NCC_MatchingResult* outResult = &frame->result;
+    RuleTree nextTree = getNextTree(frame->node, frame->instruction);
+
+    if (frame->state == 0) {
+        if (!treeExists(nextTree)) {
+            NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+            outResult->matchLength = ncc->textEnd - text;
+            ReturnFrame(True)
+        }
+        locals->totalMatchLength = findDelimiterCandidate(ncc, frame->node, frame->instruction, text, 0);
+        CallTree(followingTree, nextTree, &text[locals->totalMatchLength], frame->astParentNode, 1)
+    }
+
+    ResumeTree(followingTree, locals->totalMatchLength, {&locals->followingTree}, 1)
+    if (locals->followingTreeMatched && locals->followingTree.result.matchLength > 0) {
+        *outResult = locals->followingTree.result;
+        outResult->matchLength += locals->totalMatchLength;
+        ReturnFrame(True)
+    }
+    if (!text[locals->totalMatchLength]) {
+        *outResult = locals->followingTree.result;
+        outResult->matchLength += locals->totalMatchLength;
+        ReturnFrame(locals->followingTreeMatched)
+    }
+    if (locals->followingTreeMatched) DiscardMatchingResult(&locals->followingTree)
+    locals->totalMatchLength = findDelimiterCandidate(ncc, frame->node, frame->instruction, text, locals->totalMatchLength+1);
+    CallTree(followingTree, nextTree, &text[locals->totalMatchLength], frame->astParentNode, 1)
+}
+
+static void substituteNodeStep(struct NCC* ncc, MatchingFrame* frame) {
+    SubstituteNodeLocals* locals = &frame->locals.substituteNode;
+    SubstituteMatch* match = &locals->match;
+    NCC_Node* node = frame->node;
+    const char* text = frame->text;
+    NCC_ASTNode_Data* astParentNode = frame->astParentNode;
+    NCC_MatchingResult* outResult = &frame->result;
+    RuleTree nextTree;
+
+    switch (frame->state) {
+        case 0:
+            if (beginSubstituteMatch(ncc, match, node, text, astParentNode, outResult)) {
+                PushParentNode(node)
+                frame->state = 1;
+                callTree(ncc, getRuleTree(ncc, match->nodeData.rule), text, &match->rule, getSubstituteMatchParent(match, astParentNode));
+                return;
+            } else if (!match->accepted) {
+                ReturnFrame(False)
+            }
+            goto matchConfirmed;
+
+        case 1:
+            match->accepted = match->discardRule = finishCall(ncc, frame, &match->rule, 0, 0, 0);
+            PopParentNode(node)
+            if (!confirmSubstituteMatch(ncc, match, text, outResult)) ReturnFrame(finishSubstituteMatch(ncc, match, astParentNode))
+
+            matchConfirmed:
+            substituteMatchConfirmed(ncc, match, astParentNode);
+            nextTree = getNextTree(node, frame->instruction);
+            if (treeExists(nextTree)) {
+                frame->state = 2;
+                callTree(ncc, nextTree, &text[match->rule.result.matchLength], &locals->nextNode, astParentNode);
+                return;
+            }
+            NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+            break;
+
+        case 2:
+            match->accepted = finishCall(ncc, frame, &locals->nextNode, 0, (MatchedASTTree*[]) {&locals->nextNode}, 1);
+            *outResult = locals->nextNode.result;
+            if (locals->nextNode.result.terminate || !match->accepted) {
+                outResult->matchLength += match->rule.result.matchLength;
+                ReturnFrame(finishSubstituteMatch(ncc, match, astParentNode))
+            }
+            break;
+    }
+
+    acceptSubstituteMatch(match, outResult);
+    ReturnFrame(finishSubstituteMatch(ncc, match, astParentNode))
+}
+
+static void selectionNodeStep(struct NCC* ncc, MatchingFrame* frame) {
+    SelectionNodeLocals* locals = &frame->locals.selectionNode;
+    NCC_Node* node = frame->node;
+    const char* text = frame->text;
+    NCC_ASTNode_Data* astParentNode = frame->astParentNode;
+    NCC_MatchingResult* outResult = &frame->result;
+    SelectionNodeData* nodeData = node->data;
+    int32_t attemptedRulesCount = NVector.size(&nodeData->attemptedRules);
+    SubstituteNodeData* attemptedRuleData;
+    RuleTree nextTree;
+
+    switch (frame->state) {
+        case 0:
+            locals->longestMatchRuleId = -1;
+            locals->matchFound = False;
+            outResult->matchLength = VERY_NEGATIVE_MATCH_LENGTH;
+            locals->attemptedRuleIndex = 0;
+            locals->useLiteralsTrie = literalsTrieUsed(nodeData, frame->instruction);
+            if (locals->useLiteralsTrie) findLiteralRules(nodeData, text, ncc->textEnd, &locals->literalRules);
+            goto attemptRule;
+
+        case 1:
+            ResumeTree(rule, 0, {&locals->rule}, 1)
+            PopParentNode(node)
+            attemptedRuleData = (SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, locals->attemptedRuleIndex);
+
+            if (!locals->matchFound && locals->rule.result.matchLength > outResult->matchLength) *outResult = locals->rule.result;
+            if (locals->ruleMatched) {
+                if (!locals->matchFound || locals->rule.result.matchLength > locals->longestMatchRule.result.matchLength) {
+                    if (locals->matchFound) discardMatchingResultBelow(ncc, &locals->longestMatchRule, &locals->rule);
+                    locals->matchFound = True;
+                    locals->longestMatchRule = locals->rule;
+                    locals->longestMatchRuleId = attemptedRuleData->rule->data.ruleId;
+                } else {
+                    DiscardMatchingResult(&locals->rule)
+                }
+            }
+            locals->attemptedRuleIndex++;
+
+            attemptRule:
+            while (locals->useLiteralsTrie && locals->attemptedRuleIndex < attemptedRulesCount &&
+                   !isAttemptedRuleFound(ncc, nodeData, locals->attemptedRuleIndex, &locals->literalRules, text)) {
+                if (outResult->matchLength == VERY_NEGATIVE_MATCH_LENGTH) NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+                locals->attemptedRuleIndex++;
+            }
+            if (locals->attemptedRuleIndex < attemptedRulesCount) {
+                attemptedRuleData = (SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, locals->attemptedRuleIndex);
+                *((SubstituteNodeData*) nodeData->substituteNode->data) = *attemptedRuleData;
+                PushParentNode(node)
+                CallTree(rule, ((RuleTree) { .node=nodeData->substituteNode }), text, astParentNode, 1)
+            }
+
+            if (!locals->matchFound) {
+                if (outResult->matchLength==VERY_NEGATIVE_MATCH_LENGTH) NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+                ReturnFrame(False)
+            }
+
+            // Verify,
+            if (isVerificationRule(nodeData, locals->longestMatchRuleId) ^ nodeData->matchIfIncluded) {
+                *outResult = locals->longestMatchRule.result;
+                DiscardMatchingResult(&locals->longestMatchRule)
+                ReturnFrame(False)
+            }
+
+            nextTree = getNextTree(node, frame->instruction);
+            if (treeExists(nextTree)) CallTree(followingTree, nextTree, &text[locals->longestMatchRule.result.matchLength], astParentNode, 2)
+            NSystemUtils.memset(outResult, 0, sizeof(NCC_MatchingResult));
+            break;
+
+        case 2:
+            ResumeTree(followingTree, locals->longestMatchRule.result.matchLength, {&locals->followingTree COMMA &locals->longestMatchRule}, 2)
+            *outResult = locals->followingTree.result;
+            if (!locals->followingTreeMatched) {
+                outResult->matchLength += locals->longestMatchRule.result.matchLength;
+                DiscardMatchingResult(&locals->longestMatchRule)
+                ReturnFrame(False)
+            }
+            break;
+    }
+
+    AcceptMatchResult(locals->longestMatchRule)
+    ReturnFrame(True)
+}
+
+typedef void (*MatchingFrame_step)(struct NCC* ncc, MatchingFrame* frame);
+static MatchingFrame_step frameSteps[] = {0, 0, 0, orNodeStep, subRuleNodeStep, repeatNodeStep, anythingNodeStep, substituteNodeStep, selectionNodeStep, 0};
+
+// Matches a tree without recursion. Frames are pushed above the current depth, so this can be
+// re-entered (from listeners that match other text, for example),
+static boolean stacklessMatch(RuleTree tree, struct NCC* ncc, const char* text, NCC_ASTNode_Data* astParentNode, NCC_MatchingResult* outResult) {
+
+    // The bottom frame receives the final result. Matching is over once it's on top again,
+    int32_t bottomDepth = ncc->matchingDepth;
+    MatchingFrame* bottomFrame = pushFrame(ncc, NCC_NodeType.ROOT);
+    pushTree(ncc, tree, text, astParentNode);
+    while (ncc->matchingDepth > bottomDepth+1) {
+        MatchingFrame* frame = getTopFrame(ncc);
+        frameSteps[frame->type](ncc, frame);
+    }
+    ncc->matchingDepth = bottomDepth;
+
+    *outResult = bottomFrame->calleeResult;
+    return bottomFrame->calleeMatched;
+}
+
+static void destroyMatchingFrames(struct NCC* ncc) {
+    // Frames are allocated in blocks. Free every block through its first frame,
+    int32_t framesCount = NVector.size(&ncc->matchingFrames);
+    for (int32_t i=0; i<framesCount; i+=NCC_MATCHING_FRAMES_BLOCK_SIZE) NFREE(*(MatchingFrame**) NVector.get(&ncc->matchingFrames, i), "NCC.destroyMatchingFrames() frames");
+    NVector.destroy(&ncc->matchingFrames);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Helper functions
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Constructs a rule tree from rule text. The text is parsed in place, in a single pass. Sub-rules
+// are parsed recursively up to (not including) their closing brace, after which "in_out_rule" is
+// left pointing,
+static NCC_Node* constructRuleTree(struct NCC* ncc, const char** in_out_rule, boolean inSubRule) {
+
+    // Every rule tree must start with a root node,
+    NCC_Node* rootNode = createRootNode();
+
+    // Start parsing the rule text,
+    NCC_Node* currentNode = rootNode;
+    int32_t oldErrorsCount = NError.observeErrors();
+    do {
+        // Parse next node,
+        currentNode = getNextNode(ncc, currentNode, in_out_rule, inSubRule);
+
+        // If new errors observed,
+        if (NError.observeErrors()>oldErrorsCount) break;
+
+        // No errors. If we no longer get new nodes, then we've finished the text,
+        if (!currentNode) return rootNode;
+    } while (True);
+
+    // Failed,
+    nodeDeleteTree[rootNode->type](rootNode);
+    return 0;
+}
+
+// Identifies and creates the next rule tree node from the rule text. "in_out_rule" will be modified
+// to point after the returned node text. This function is used to systematically parse rule text
+// into a rule tree. Returns 0 at the end of the text, or at the closing brace if in a sub-rule,
+static NCC_Node* getNextNode(struct NCC* ncc, NCC_Node* parentNode, const char** in_out_rule, boolean inSubRule) {
+
+    // Skip unescaped spaces or tabs,
+    char currentChar = **skipWhiteSpaces(in_out_rule);
+
+    // Handle different token types,
+    switch (currentChar) {
+        case   0: return 0;
+        case '#': return createSelectionNode (ncc, parentNode, in_out_rule);
+        case '@':
+        case '$': return createSubstituteNode(ncc, parentNode, in_out_rule);
+        case '*': return createAnythingNode  (     parentNode, in_out_rule);
+        case '{': return createSubRuleNode   (ncc, parentNode, in_out_rule);
+        case '^': return createRepeatNode    (     parentNode, in_out_rule);
+        case '|': return createOrNode        (ncc, parentNode, in_out_rule, inSubRule);
+        case '-':
+            NERROR("NCC", "getNextNode(): a '%s-%s' must always be preceded by a literal", NTCOLOR(HIGHLIGHT), NTCOLOR(STREAM_DEFAULT));
+            return 0;
+        case '}':
+            if (inSubRule) return 0;
+            return handleLiteral(parentNode, in_out_rule);
+        default: return handleLiteral(parentNode, in_out_rule);
+    }
+}
+
+// Removes the AST stack entries from "start" up to (not including) "end", moving the entries above
+// them down in their place,
+static void removeASTStackEntries(struct NCC* ncc, int32_t start, int32_t end) {
+    int32_t stackSize = NVector.size(&ncc->astNodeStack);
+    NCC_ASTNode_Data* entries = (NCC_ASTNode_Data*) ncc->astNodeStack.objects;
+    for (int32_t i=end; i<stackSize; i++) entries[start + i - end] = entries[i];
+    NVector.resize(&ncc->astNodeStack, stackSize - (end - start));
+}
+
+// Calls the appropriate delete listeners of the AST stack entries from "start" up to (not
+// including) "end", last pushed first,
+static void deleteASTStackEntries(struct NCC* ncc, int32_t start, int32_t end, NCC_ASTNode_Data* astParentNode) {
+    for (int32_t i=end-1; i>=start; i--) {
+        NCC_ASTNode_Data currentNode = *((NCC_ASTNode_Data*) NVector.get(&ncc->astNodeStack, i));
+
+        // Get that specific rule's delete listener,
+        NCC_deleteASTNodeListener deleteListener = currentNode.rule->deleteASTNodeListener;
+        if (deleteListener) {
+            deleteListener(&currentNode, astParentNode);
+        } else {
+            // This shouldn't be reachable. When a create listener is specified, a delete one MUST
+            // be provided,
+            //NERROR("NCC", "deleteASTStackEntries(): no delete listener for rule: %s%s%s. Unable to discard AST node", NTCOLOR(HIGHLIGHT), NString.get(&currentNode.rule->ruleName), NTCOLOR(STREAM_DEFAULT));
+        }
+    }
+}
+
+// Discards any AST nodes created when matching the provided tree (and any tree matched after it)
+// by calling the appropriate delete listeners, then truncates the stack back to its mark,
+static void discardMatchingResult(struct NCC* ncc, MatchedASTTree* tree) {
+    int32_t stackSize = NVector.size(&ncc->astNodeStack);
+    if (stackSize <= tree->astStackMark) return;
+    deleteASTStackEntries(ncc, tree->astStackMark, stackSize, tree->astParentNode);
+    NVector.resize(&ncc->astNodeStack, tree->astStackMark);
+}
+
+// Discards "tree", which was matched before "aboveTree", along with anything matched in between.
+// "aboveTree" (and anything matched after it) is moved down in its place. Returns the number of
+// entries discarded, which is how much the marks of the trees matched after "aboveTree" move,
+static int32_t discardMatchingResultBelow(struct NCC* ncc, MatchedASTTree* tree, MatchedASTTree* aboveTree) {
+    int32_t discardedEntriesCount = aboveTree->astStackMark - tree->astStackMark;
+    if (!discardedEntriesCount) return 0;
+    deleteASTStackEntries(ncc, tree->astStackMark, aboveTree->astStackMark, tree->astParentNode);
+    removeASTStackEntries(ncc, tree->astStackMark, aboveTree->astStackMark);
+    aboveTree->astStackMark = tree->astStackMark;
+    return discardedEntriesCount;
+}
+
+// Parses "text" to see if it matches "ruleTree" according to the rule definitions in "ncc". Fills
+// "outMatchingResult" with match info, attaches the constructed AST to "astParentNode" and pushes
+// its nodes to NCC's AST stack. If one of the AST manipulation listeners decided to reject this match
+// (terminate it) midway, "lengthToAddIfTerminated" is added to the match length, and the specified
+// "astTrees" are discarded,
+static boolean matchRuleTree(
+        struct NCC* ncc, RuleTree ruleTree, const char* text,
+        MatchedASTTree* outMatchingResult, NCC_ASTNode_Data* astParentNode,
+        int32_t lengthToAddIfTerminated, MatchedASTTree** astTreesToDiscardIfTerminated, int32_t astTreesToDiscardCount) {
+
+    // Match,
+    outMatchingResult->astParentNode = astParentNode;
+    outMatchingResult->astStackMark = NVector.size(&ncc->astNodeStack);
+    if (!isTreeViable(ncc, ruleTree, text)) {
+        NSystemUtils.memset(&outMatchingResult->result, 0, sizeof(NCC_MatchingResult));
+        return False;
+    }
+    boolean matched;
+    if (ncc->matchingEngine == NCC_MatchingEngine.STACKLESS) {
+        matched = stacklessMatch(ruleTree, ncc, text, astParentNode, &outMatchingResult->result);
+    } else if (ruleTree.instruction) {
+        matched = programMatch(ruleTree.instruction, ncc, text, astParentNode, &outMatchingResult->result);
+    } else {
+        matched = nodeMatch[ruleTree.node->type](ruleTree.node, 0, ncc, text, astParentNode, &outMatchingResult->result);
+    }
+
+    // Return immediately if termination didn't take place,
+    if (!outMatchingResult->result.terminate) return matched;
+
+    // Termination took place. We still report the maximum length matched during the rejected match,
+    outMatchingResult->result.matchLength += lengthToAddIfTerminated;
+
+    // Discard trees,
+    for (int32_t i=0; i<astTreesToDiscardCount; i++) DiscardMatchingResult(astTreesToDiscardIfTerminated[i]);
+
+    return matched;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AST arena
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define NCC_AST_ARENA_BLOCK_SIZE 256
+
+static NCC_ASTArena* createASTArena() {
+    NCC_ASTArena* arena = NMALLOC(sizeof(NCC_ASTArena), "NCC.createASTArena() arena");
+    NVector.initialize(&arena->blocks, 0, sizeof(NCC_ASTNode*));
+    NVector.initialize(&arena->freeNodes, 0, sizeof(NCC_ASTNode*));
+    arena->lastBlockUsedCount = NCC_AST_ARENA_BLOCK_SIZE;
+    return arena;
+}
+
+static inline int32_t getASTArenaBlockUsedCount(NCC_ASTArena* arena, int32_t blockIndex) {
+    return (blockIndex == NVector.size(&arena->blocks)-1) ? arena->lastBlockUsedCount : NCC_AST_ARENA_BLOCK_SIZE;
+}
+
+static void destroyAndFreeASTArena(NCC_ASTArena* arena) {
+
+    // Every node handed out so far has its members initialized, whether it's in use or free,
+    for (int32_t i=NVector.size(&arena->blocks)-1; i>=0; i--) {
+        NCC_ASTNode* block = *((NCC_ASTNode**) NVector.get(&arena->blocks, i));
+        for (int32_t j=getASTArenaBlockUsedCount(arena, i)-1; j>=0; j--) {
+            NString.destroy(&block[j].name);
+            NString.destroy(&block[j].value);
+            NVector.destroy(&block[j].childNodes);
+        }
+        NFREE(block, "NCC.destroyAndFreeASTArena() block");
+    }
+    NVector.destroy(&arena->blocks);
+    NVector.destroy(&arena->freeNodes);
+    NFREE(arena, "NCC.destroyAndFreeASTArena() arena");
+}
+
+// Same as NCC_createASTNode(), but reuses a deleted node (along with its buffers) if possible,
+static NCC_ASTNode* createArenaASTNode(NCC_ASTArena* arena, NCC_RuleData* ruleData, NCC_ASTNode_Data* astParentNodeData) {
+
+    NCC_ASTNode* astNode;
+    if (NVector.popBack(&arena->freeNodes, &astNode)) {
+        NString.set(&astNode->name, "%s", NString.get(&ruleData->ruleName));
+        NString.set(&astNode->value, "not set yet");
+    } else {
+
+        // Hand out a new node, allocating a new block if needed,
+        if (arena->lastBlockUsedCount == NCC_AST_ARENA_BLOCK_SIZE) {
+            NCC_ASTNode* block = NMALLOC(sizeof(NCC_ASTNode) * NCC_AST_ARENA_BLOCK_SIZE, "NCC.createArenaASTNode() block");
+            NVector.pushBack(&arena->blocks, &block);
+            arena->lastBlockUsedCount = 0;
+        }
+        astNode = &(*((NCC_ASTNode**) NVector.getLast(&arena->blocks)))[arena->lastBlockUsedCount++];
+        NString.initialize(&astNode->name, "%s", NString.get(&ruleData->ruleName));
+        NString.initialize(&astNode->value, "not set yet");
+        NVector.initialize(&astNode->childNodes, 0, sizeof(NCC_ASTNode*));
+        astNode->arena = arena;
+    }
+    astNode->rule = ruleData;
+    astNode->extraData = 0;
+
+    // Attach this node to the parent,
+    if (astParentNodeData) {
+        NCC_ASTNode* parentASTNode = astParentNodeData->node;
+        NVector.pushBack(&parentASTNode->childNodes, &astNode);
+    }
+
+    return astNode;
+}
+
+// Calls the create AST node listener of the rule, unless it's the generic one and the arena is
+// enabled, in which case the node is allocated from the arena,
+static void* createASTNode(struct NCC* ncc, NCC_RuleData* ruleData, NCC_ASTNode_Data* astParentNode) {
+    if (ncc->useASTArena && ruleData->createASTNodeListener == NCC_createASTNode) {
+        if (!ncc->astArena) ncc->astArena = createASTArena();
+        return createArenaASTNode(ncc->astArena, ruleData, astParentNode);
+    }
+    return ruleData->createASTNodeListener(ruleData, astParentNode);
+}
+
+void NCC_clearASTArena(struct NCC* ncc) {
+
+    NCC_ASTArena* arena = ncc->astArena;
+    if (!arena) return;
+
+    // Put all the nodes handed out so far in the free list, including the ones already there,
+    NVector.clear(&arena->freeNodes);
+    for (int32_t i=NVector.size(&arena->blocks)-1; i>=0; i--) {
+        NCC_ASTNode* block = *((NCC_ASTNode**) NVector.get(&arena->blocks, i));
+        for (int32_t j=getASTArenaBlockUsedCount(arena, i)-1; j>=0; j--) {
+            NCC_ASTNode* astNode = &block[j];
+            NVector.clear(&astNode->childNodes);
+            NVector.pushBack(&arena->freeNodes, &astNode);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// NCC
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct NCC* NCC_initializeNCC(struct NCC* ncc) {
+    ncc->extraData = 0;
+    ncc->matchingEngine = NCC_MatchingEngine.PROGRAM;
+    ncc->rulesAnalyzed = False;
+    ncc->silent = False;
+    NVector.initialize(&ncc->rules            , 0, sizeof(NCC_Rule*));
+    NVector.initialize(&ncc->rulesTable       , 0, sizeof(NCC_Rule*));
+    NVector.initialize(&ncc->parentStack      , 0, sizeof(NCC_Node*));
+    NVector.initialize(&ncc->maxMatchRuleStack, 0, sizeof(const char*));
+    NVector.initialize(&ncc->astNodeStack, 0, sizeof(NCC_ASTNode_Data));
+
+    // Error reporting,
+    ncc->leanMatching = False;
+    ncc->trackErrors = True;
+    ncc->maxMatchLength = 0;
+    ncc->expectedTextOffset = -1;
+    NSystemUtils.memset(ncc->expectedCharacters, 0, sizeof(ncc->expectedCharacters));
+
+    // Memoization,
+    ncc->memoize = False;
+    ncc->memoEntriesCount = 0;
+    NVector.initialize(&ncc->memoTable          , 0, sizeof(MemoEntry  ));
+    NVector.initialize(&ncc->memoRuleNames      , 0, sizeof(const char*));
+    NVector.initialize(&ncc->matchRecords       , 0, sizeof(MatchRecord));
+    NVector.initialize(&ncc->matchRecordChildren, 0, sizeof(int32_t    ));
+
+    // AST arena,
+    ncc->useASTArena = False;
+    ncc->astArena = 0;
+
+    // Deferred listeners,
+    ncc->deferListeners = False;
+    ncc->deferring = False;
+    ncc->recordMatches = False;
+
+    // Stackless engine,
+    NVector.initialize(&ncc->matchingFrames, 0, sizeof(void*));
+    ncc->matchingDepth = 0;
+    ncc->peakMatchingDepth = 0;
+
+    return ncc;
+}
+
+struct NCC* NCC_createNCC() {
+    struct NCC* ncc = NMALLOC(sizeof(struct NCC), "NCC.NCC_createNCC() ncc");
+    return NCC_initializeNCC(ncc);
+}
+
+void NCC_destroyNCC(struct NCC* ncc) {
+
+    // Rules,
+    for (int32_t i=NVector.size(&ncc->rules)-1; i>=0; i--) destroyAndFreeRule(*((NCC_Rule**) NVector.get(&ncc->rules, i)));
+    NVector.destroy(&ncc->rules);
+    NVector.destroy(&ncc->rulesTable);
+
+    // Stacks,
+    NVector.destroy(&ncc->parentStack);
+    NVector.destroy(&ncc->maxMatchRuleStack);
+    NVector.destroy(&ncc->astNodeStack);
+
+    // Memoization,
+    NVector.destroy(&ncc->memoTable);
+    NVector.destroy(&ncc->memoRuleNames);
+    NVector.destroy(&ncc->matchRecords);
+    NVector.destroy(&ncc->matchRecordChildren);
+
+    // AST arena,
+    if (ncc->astArena) destroyAndFreeASTArena(ncc->astArena);
+
+    // Stackless engine,
+    destroyMatchingFrames(ncc);
+}
+
+void NCC_destroyAndFreeNCC(struct NCC* ncc) {
+    NCC_destroyNCC(ncc);
+    NFREE(ncc, "NCC.NCC_destroyAndFreeNCC() ncc");
+}
+
+// Rules are looked up by name in ncc->rulesTable, an open addressing hash table of rule pointers,
+
+#define NCC_RULES_TABLE_INITIAL_CAPACITY 64
+
+// Names are passed as spans (beginning and length) so that names can be looked up right from the
+// rule text, without copying them,
+static inline uint32_t ruleNameHash(const char* ruleName, int32_t ruleNameLength) {
+    // FNV-1a,
+    uint32_t hash = 0x811C9DC5u;
+    for (int32_t i=0; i<ruleNameLength; i++) hash = (hash ^ (unsigned char) ruleName[i]) * 0x01000193u;
+    return hash;
+}
+
+static inline boolean ruleNameEquals(const char* ruleName, int32_t ruleNameLength, const char* otherRuleName) {
+    for (int32_t i=0; i<ruleNameLength; i++) {
+        if (ruleName[i] != otherRuleName[i]) return False;
+    }
+    return !otherRuleName[ruleNameLength];
+}
+
+// Returns the slot holding the rule with the specified name, or the empty slot where it should be
+// inserted,
+static NCC_Rule** getRulesTableSlot(struct NCC* ncc, const char* ruleName, int32_t ruleNameLength) {
+    uint32_t mask = NVector.size(&ncc->rulesTable) - 1;
+    uint32_t index = ruleNameHash(ruleName, ruleNameLength) & mask;
+    NCC_Rule** slots = (NCC_Rule**) ncc->rulesTable.objects;
+    do {
+        NCC_Rule* rule = slots[index];
+        if (!rule || ruleNameEquals(ruleName, ruleNameLength, NString.get(&rule->data.ruleName))) return &slots[index];
+        index = (index + 1) & mask;
+    } while (True);
+}
+
+static NCC_Rule** getRuleSlot(struct NCC* ncc, NCC_Rule* rule) {
+    return getRulesTableSlot(ncc, NString.get(&rule->data.ruleName), NString.length(&rule->data.ruleName));
+}
+
+static NCC_Rule* getRule(struct NCC* ncc, const char* ruleName, int32_t ruleNameLength) {
+    if (!NVector.size(&ncc->rulesTable)) return 0;
+    return *getRulesTableSlot(ncc, ruleName, ruleNameLength);
+}
+
+static void addToRulesTable(struct NCC* ncc, NCC_Rule* rule) {
+
+    // Keep the load factor below 0.5. Grow (and rehash) if needed. Rules are already in ncc->rules,
+    int32_t rulesCount = NVector.size(&ncc->rules);
+    int32_t capacity = NVector.size(&ncc->rulesTable);
+    if (rulesCount*2 > capacity) {
+        int32_t newCapacity = capacity ? capacity*2 : NCC_RULES_TABLE_INITIAL_CAPACITY;
+        NVector.resize(&ncc->rulesTable, newCapacity);
+        NSystemUtils.memset(ncc->rulesTable.objects, 0, newCapacity * sizeof(NCC_Rule*));
+        for (int32_t i=0; i<rulesCount; i++) {
+            NCC_Rule* currentRule = *((NCC_Rule**) NVector.get(&ncc->rules, i));
+            *getRuleSlot(ncc, currentRule) = currentRule;
+        }
+        return;
+    }
+
+    *getRuleSlot(ncc, rule) = rule;
+}
+
+// Creates a rule and adds it to the NCC,
+boolean NCC_addRule(struct NCC* ncc, NCC_RuleData* ruleData) {
+
+    // Check if a rule with this name already exists,
+    const char* ruleName = NString.get(&ruleData->ruleName);
+    if (NCC_getRule(ncc, ruleName)) {
+        NERROR("NCC", "NCC_addRule(): unable to create rule %s%s%s. A rule with the same name exists.", NTCOLOR(HIGHLIGHT), ruleName, NTCOLOR(STREAM_DEFAULT));
+        return False;
+    }
+
+    // Create rule tree,
+    const char* ruleText = NString.get(&ruleData->ruleText);
+    const char* remainingText = ruleText;
+    NCC_Node* ruleTree = constructRuleTree(ncc, &remainingText, False);
+    if (!ruleTree) {
+        NERROR("NCC", "NCC_addRule(): unable to construct rule tree: %s%s%s", NTCOLOR(HIGHLIGHT), ruleText, NTCOLOR(STREAM_DEFAULT));
+        return False;
+    }
+
+    // Create and initialize rule,
+    NCC_Rule* rule = NMALLOC(sizeof(NCC_Rule), "NCC.NCC_addRule() rule");
+    rule->tree = ruleTree;
+    NVector.initialize(&rule->program, 0, sizeof(NCC_Instruction));
+    compileRuleTree(ruleTree, &rule->program);
+    ncc->rulesAnalyzed = False;
+    rule->data = *ruleData;  // Copy all members. But note that, copying strings is dangerous due
+                             // to memory allocations. For every string in ruleData, we now have
+                             // two NStrings pointing to the same memory block.
+                             // Just create new NStrings overwriting the ones we just copied,
+    NString.initialize(&rule->data.ruleName, "%s", ruleName);
+    NString.initialize(&rule->data.ruleText, "%s", ruleText);
+
+    // Create the substitute node used to match this rule directly. It's created once and for all,
+    // so that matching needs no allocations,
+    rule->wrapperNode = genericCreateNode(NCC_NodeType.SUBSTITUTE, sizeof(SubstituteNodeData));
+    *((SubstituteNodeData*) rule->wrapperNode->data) = (SubstituteNodeData) { .rule=rule, .silent=False };
+    rule->inlined = False;
+
+    // Add to ncc,
+    rule->data.ruleId = NVector.size(&ncc->rules);
+    NVector.pushBack(&ncc->rules, &rule);
+    addToRulesTable(ncc, rule);
+    return True;
+}
+
+// Returns the rule with the specified name from this ncc if found, NULL otherwise,
+NCC_Rule* NCC_getRule(struct NCC* ncc, const char* ruleName) {
+    return getRule(ncc, ruleName, NCString.length(ruleName));
+}
+
+// Returns the rule with the specified id from this ncc if found, NULL otherwise,
+NCC_Rule* NCC_getRuleById(struct NCC* ncc, int32_t ruleId) {
+    if (ruleId < 0 || ruleId >= NVector.size(&ncc->rules)) return 0;
+    return *((NCC_Rule**) NVector.get(&ncc->rules, ruleId));
+}
+
+// Returns the rule data of the specified rule (duh!),
+NCC_RuleData* NCC_getRuleData(struct NCC* ncc, const char* ruleName) {
+    NCC_Rule* rule = NCC_getRule(ncc, ruleName);
+    if (!rule) {
+        NERROR("NCC", "NCC_getRuleData(): couldn't find rule: %s%s%s", NTCOLOR(HIGHLIGHT), ruleName, NTCOLOR(STREAM_DEFAULT));
+        return 0;
+    }
+    return &rule->data;
+}
+
+boolean NCC_updateRule(struct NCC* ncc, NCC_RuleData* ruleData) {
+
+    // Fetch rule,
+    const char* ruleName = NString.get(&ruleData->ruleName);
+    NCC_Rule* rule = NCC_getRule(ncc, ruleName);
+    if (!rule) {
+        NERROR("NCC", "NCC_updateRule(): unable to update rule %s%s%s. Rule doesn't exist.", NTCOLOR(HIGHLIGHT), ruleName, NTCOLOR(STREAM_DEFAULT));
+        return False;
+    }
+
+    // Create new rule tree,
+    const char* ruleText = NString.get(&ruleData->ruleText);
+    if (!NCC_updateRuleText(ncc, rule, ruleText)) return False;
+
+    // Reinitialize rule data by copying all members. But note that copying strings is dangerous due
+    // to memory allocations. Strings have to be handled carefully,
+    if (ruleData != &rule->data) {   // We needn't copy onto ourselves. It's dangerous in fact.
+
+        // Keep our old strings and id,
+        struct NString ruleNameString = rule->data.ruleName;
+        struct NString ruleTextString = rule->data.ruleText;
+        int32_t ruleId = rule->data.ruleId;
+
+        // Overwrite,
+        rule->data = *ruleData;
+
+        // Restore our old strings and id,
+        rule->data.ruleName = ruleNameString;
+        rule->data.ruleText = ruleTextString;
+        rule->data.ruleId = ruleId;
+        NString.set(&rule->data.ruleName, "%s", ruleName);
+        NString.set(&rule->data.ruleText, "%s", ruleText);
+    }
+
+    return True;
+}
+
+boolean NCC_updateRuleText(struct NCC* ncc, NCC_Rule* rule, const char* newRuleText) {
+
+    // The rules it was inlined into would still match the old tree,
+    if (rule->inlined) {
+        NERROR("NCC", "NCC_updateRuleText(): rule %s%s%s was inlined by NCC_optimizeRules(), it can't be updated.", NTCOLOR(HIGHLIGHT), NString.get(&rule->data.ruleName), NTCOLOR(STREAM_DEFAULT));
+        return False;
+    }
+
+    // Create new rule tree,
+    const char* remainingText = newRuleText;
+    NCC_Node* ruleTree = constructRuleTree(ncc, &remainingText, False);
+    if (!ruleTree) {
+        NERROR("NCC", "NCC_updateRuleText(): unable to construct rule tree: %s%s%s. Failed to update rule: %s%s%s.", NTCOLOR(HIGHLIGHT), newRuleText, NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), NString.get(&rule->data.ruleName), NTCOLOR(STREAM_DEFAULT));
+        return False;
+    }
+
+    // Dispose of the old rule-tree and set the new one,
+    nodeDeleteTree[rule->tree->type](rule->tree);
+    rule->tree = ruleTree;
+    compileRuleTree(ruleTree, &rule->program);
+    ncc->rulesAnalyzed = False;
+
+    // Update rule data,
+    NString.set(&rule->data.ruleText, "%s", newRuleText);
+
+    return True;
+}
+
+static void buildFlatAST(struct NCC* ncc, NCC_FlatAST* ast, const char* text);
+
+// Matches the rule, then either returns the AST node in outNode, or the flat AST in outFlatAST,
+static boolean match(struct NCC* ncc, NCC_Rule* rule, const char* text, NCC_MatchingResult* outResult, NCC_ASTNode_Data* outNode, NCC_FlatAST* outFlatAST) {
+
+    // Only substitute nodes push AST nodes. Matching the rule tree alone wouldn't make the rule
+    // itself appear in the AST tree. Match its wrapper substitute node instead. If the rule won't
+    // show in the tree anyway, match its tree directly,
+    RuleTree ruleTreeToBeMatched;
+    if (rule->data.createASTNodeListener || rule->data.ruleMatchListener) {
+        ruleTreeToBeMatched = (RuleTree) { .node=rule->wrapperNode };
+    } else {
+        ruleTreeToBeMatched = getRuleTree(ncc, rule);
+    }
+
+    // Match. In lean matching, errors are only tracked if the match fails. The text is then matched
+    // again to find out what went wrong (see "Lean matching" in NCC.h),
+    MatchedASTTree ruleTree;
+    boolean matched;
+    ncc->trackErrors = !ncc->leanMatching;
+    ncc->textBeginning = text;
+    ncc->textEnd = &text[NCString.length(text)];
+    if (!ncc->rulesAnalyzed) analyzeRules(ncc);
+    do {
+        // Prepare for matching,
+        ncc->maxMatchLength = 0;
+        ncc->expectedTextOffset = -1;
+        NSystemUtils.memset(ncc->expectedCharacters, 0, sizeof(ncc->expectedCharacters));
+        NVector.clear(&ncc->parentStack);
+        NVector.clear(&ncc->maxMatchRuleStack);
+        clearMemo(ncc);
+        ncc->deferring = ncc->deferListeners || outFlatAST;
+        ncc->recordMatches = ncc->memoize || ncc->deferring;
+        ncc->peakMatchingDepth = ncc->matchingDepth;
+
+        matched = matchRuleTree(ncc, ruleTreeToBeMatched, text,
+                                &ruleTree, 0,
+                                0, (MatchedASTTree *[]) {&ruleTree}, 1);
+        if (matched || ruleTree.result.terminate || ncc->trackErrors) break;
+
+        // Failed lean match, undo whatever is left of it, and try again tracking errors,
+        discardMatchingResult(ncc, &ruleTree);
+        ncc->trackErrors = True;
+    } while (True);
+    *outResult = ruleTree.result;
+    boolean succeeded = matched && !ruleTree.result.terminate;
+    if (outFlatAST) {
+        outFlatAST->nodesCount = 0;
+        if (succeeded) buildFlatAST(ncc, outFlatAST, text);
+    } else if (succeeded && ncc->deferring) {
+        commitMatchRecords(ncc);
+    }
+    ncc->deferring = False;
+    if (ncc->recordMatches) removeMatchRecordMarkers(&ncc->astNodeStack);
+    ncc->recordMatches = False;
+    if (succeeded) {
+
+        // If an output node is expected, return it,
+        if (outNode) {
+            // TODO: .... there could be more than one node on the stack?...
+            if (!NVector.popBack(&ncc->astNodeStack, outNode)) NSystemUtils.memset(outNode, 0, sizeof(NCC_ASTNode_Data));
         } else {
-            // This shouldn't be reachable. When a create listener is specified, a delete one MUST
-            // be provided,
-            //NERROR("NCC", "discardMatchingResult(): no delete listener for rule: %s%s%s. Unable to discard AST node", NTCOLOR(HIGHLIGHT), NString.get(&currentNode.rule->ruleName), NTCOLOR(STREAM_DEFAULT));
+
+            // Delete the unused tree,
+            NCC_ASTNode_Data tempNode;
+            while (NVector.popBack(&ncc->astNodeStack, &tempNode)) {
+                NCC_deleteASTNodeListener deleteListener = tempNode.rule->deleteASTNodeListener;
+                if (deleteListener) deleteListener(&tempNode, 0);
+            }
         }
     }
+
+    return matched;
 }
 
-// Parses "text" to see if it matches "ruleTree" according to the rule definitions in "ncc". Fills
-// "outMatchingResult" with match info, attaches the constructed AST to "astParentNode" and pushes
-// its nodes to "astStack". If one of the AST manipulation listeners decided to reject this match
-// (terminate it) midway, "lengthToAddIfTerminated" is added to the match length, and the specified
-// "astTrees" are discarded,
-static boolean matchRuleTree(
-        struct NCC* ncc, NCC_Node* ruleTree, const char* text,
-        MatchedASTTree* outMatchingResult, NCC_ASTNode_Data* astParentNode, struct NVector** astStack,
-        int32_t lengthToAddIfTerminated, MatchedASTTree** astTreesToDiscardIfTerminated, int32_t astTreesToDiscardCount) {
+boolean NCC_match(struct NCC* ncc, NCC_Rule* rule, const char* text, NCC_MatchingResult* outResult, NCC_ASTNode_Data* outNode) {
+    return match(ncc, rule, text, outResult, outNode, 0);
+}
 
-    // Match,
-    outMatchingResult->astParentNode = astParentNode;
-    outMatchingResult->astNodesStack = astStack;
-    outMatchingResult->astStackMark = NVector.size(*astStack);
-    switchStacks(&ncc->astNodeStacks[0], astStack);
-    boolean matched = nodeMatch[ruleTree->type](ruleTree, ncc, text, astParentNode, &outMatchingResult->result);
-    switchStacks(&ncc->astNodeStacks[0], astStack);
+boolean NCC_matchFlat(struct NCC* ncc, NCC_Rule* rule, const char* text, NCC_MatchingResult* outResult, NCC_FlatAST* outAST) {
+    return match(ncc, rule, text, outResult, 0, outAST);
+}
 
-    // Return immediately if termination didn't take place,
-    if (!outMatchingResult->result.terminate) return matched;
+const char* NCC_getMatchedText(NCC_MatchingData* matchingData, struct NString* outText) {
 
-    // Termination took place. We still report the maximum length matched during the rejected match,
-    outMatchingResult->result.matchLength += lengthToAddIfTerminated;
+    // Copy the matched text directly into the string, then zero-terminate it,
+    int32_t length = matchingData->matchedTextLength;
+    NByteVector.resize(&outText->string, length+1);
+    char* text = (char*) NString.get(outText);
+    NSystemUtils.memcpy(text, matchingData->matchedTextStart, length);
+    text[length] = 0;
+    return text;
+}
 
-    // Discard trees,
-    for (int32_t i=0; i<astTreesToDiscardCount; i++) DiscardMatchingResult(astTreesToDiscardIfTerminated[i]);
+// Escapes characters as in rule texts. Non-printable ones are written in hex (\xhh),
+static void appendExpectedCharacter(struct NString* outCharacters, unsigned char character) {
+    if (character < ' ' || character > '~') {
+        const char* hexDigits = "0123456789abcdef";
+        NString.append(outCharacters, "\\x%c%c", hexDigits[character >> 4], hexDigits[character & 15]);
+    } else if (isReserved(character) || character == '\\') {
+        NString.append(outCharacters, "\\%c", character);
+    } else {
+        NString.append(outCharacters, "%c", character);
+    }
+}
 
-    return matched;
+const char* NCC_getExpectedCharacters(struct NCC* ncc, struct NString* outCharacters) {
+
+    // Write the expected characters as alternatives, joining consecutive characters into ranges,
+    NString.set(outCharacters, "");
+    for (int32_t character=0; character<256; character++) {
+        if (!containsByte(ncc->expectedCharacters, character)) continue;
+        int32_t rangeEnd = character;
+        while (rangeEnd<255 && containsByte(ncc->expectedCharacters, rangeEnd+1)) rangeEnd++;
+
+        if (NString.length(outCharacters)) NString.append(outCharacters, "|");
+        appendExpectedCharacter(outCharacters, character);
+        if (rangeEnd > character+1) {
+            NString.append(outCharacters, "-");
+            appendExpectedCharacter(outCharacters, rangeEnd);
+        } else if (rangeEnd > character) {
+            NString.append(outCharacters, "|");
+            appendExpectedCharacter(outCharacters, rangeEnd);
+        }
+        character = rangeEnd;
+    }
+    return NString.get(outCharacters);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// NCC
+// Precompiled grammars
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-#define NCC_MATCH_RULE_NAME "_NCC_match()_"
-struct NCC* NCC_initializeNCC(struct NCC* ncc) {
-    ncc->extraData = 0;
-    ncc->silent = False;
-    NVector.initialize(&ncc->rules            , 0, sizeof(NCC_Rule*));
-    NVector.initialize(&ncc->parentStack      , 0, sizeof(NCC_Node*));
-    NVector.initialize(&ncc->maxMatchRuleStack, 0, sizeof(const char*));
-    for (int32_t i=0; i<NCC_AST_NODE_STACKS_COUNT; i++) ncc->astNodeStacks[i] = NVector.create(0, sizeof(NCC_ASTNode_Data));
+// A grammar is saved as the rule trees themselves, so that loading it needs no rule text parsing.
+// The data is made of int32 fields and raw bytes, with no pointers. Things refer to each other by
+// offsets from the beginning of the data, or by rule ids:
+//    => Header: magic number, version and rules count.
+//    => Rule table: an entry per rule (GrammarRuleEntry), in rule id order.
+//    => Strings: length, then the characters, zero-terminated.
+//    => Trees: node records. A record is the node type followed by the node fields (see
+//       writeNode()). The trees a node owns (or branches, sub-rule trees and repeated nodes) follow
+//       its fields right away. Every tree starts with a root node and ends with
+//       NCC_GRAMMAR_TREE_END.
+// Substitute and selection nodes refer to rules by id, so rules can refer to rules saved after
+// them. Integers are saved in the byte order of the saving machine. The magic number is saved as an
+// integer too, so data saved on a machine of a different byte order is rejected.
+
+#define NCC_GRAMMAR_MAGIC 0x4743434E // "NCCG" in little endian.
+#define NCC_GRAMMAR_VERSION 1
+#define NCC_GRAMMAR_HEADER_SIZE (3 * (int32_t) sizeof(int32_t))
+#define NCC_GRAMMAR_TREE_END (-1)
+
+#define NCC_GRAMMAR_EAGER_LISTENERS 1 // Rule flags.
+#define NCC_GRAMMAR_INLINED         2
+
+typedef struct GrammarRuleEntry {
+    int32_t nameOffset, textOffset, treeOffset;
+    int32_t flags;
+} GrammarRuleEntry;
+
+static int32_t writeBytes(struct NByteVector* data, const void* bytes, int32_t size) {
+    int32_t offset = NByteVector.size(data);
+    NByteVector.resize(data, offset + size);
+    NSystemUtils.memcpy(&data->objects[offset], bytes, size);
+    return offset;
+}
 
-    // Only substitute nodes push AST nodes. When we match a rule, we only match its rule tree, not
-    // a substitute node referring to the rule. As such, the rule being matched won't appear in the
-    // AST tree. We use "matchRule" to wrap rules being matched into a substitute node,
-    NCC_RuleData matchRuleData;
-    NCC_initializeRuleData(&matchRuleData, NCC_MATCH_RULE_NAME, "", 0, 0, 0);
-    NCC_addRule(ncc, &matchRuleData);
-    NCC_destroyRuleData(&matchRuleData);
-    ncc->matchRule = NCC_getRule(ncc, NCC_MATCH_RULE_NAME);
+static int32_t writeInt32(struct NByteVector* data, int32_t value) {
+    return writeBytes(data, &value, sizeof(int32_t));
+}
 
-    return ncc;
+static int32_t writeString(struct NByteVector* data, const char* string, int32_t length) {
+    int32_t offset = writeInt32(data, length);
+    writeBytes(data, string, length+1);
+    return offset;
 }
 
-struct NCC* NCC_createNCC() {
-    struct NCC* ncc = NMALLOC(sizeof(struct NCC), "NCC.NCC_createNCC() ncc");
-    return NCC_initializeNCC(ncc);
+static void writeTree(struct NByteVector* data, NCC_Node* tree);
+
+static void writeNode(struct NByteVector* data, NCC_Node* node) {
+
+    writeInt32(data, node->type);
+    if (node->type == NCC_NodeType.LITERALS) {
+        LiteralsNodeData* nodeData = node->data;
+        writeString(data, NString.get(&nodeData->literals), NString.length(&nodeData->literals));
+    } else if (node->type == NCC_NodeType.LITERAL_RANGE) {
+        LiteralRangeNodeData* nodeData = node->data;
+        writeBytes(data, &nodeData->rangeStart, 1);
+        writeBytes(data, &nodeData->rangeEnd  , 1);
+    } else if (node->type == NCC_NodeType.CHARACTER_CLASS) {
+        CharacterClassNodeData* nodeData = node->data;
+        writeBytes(data, nodeData->characters, sizeof(nodeData->characters));
+    } else if (node->type == NCC_NodeType.OR) {
+        OrNodeData* nodeData = node->data;
+        int32_t branchesCount = NVector.size(&nodeData->branches);
+        writeInt32(data, branchesCount);
+        for (int32_t i=0; i<branchesCount; i++) writeTree(data, *(NCC_Node**) NVector.get(&nodeData->branches, i));
+    } else if (node->type == NCC_NodeType.SUB_RULE) {
+        writeTree(data, ((SubRuleNodeData*) node->data)->subRuleTree);
+    } else if (node->type == NCC_NodeType.REPEAT) {
+        writeTree(data, ((RepeatNodeData*) node->data)->repeatedNode);
+    } else if (node->type == NCC_NodeType.SUBSTITUTE) {
+        SubstituteNodeData* nodeData = node->data;
+        writeInt32(data, nodeData->rule->data.ruleId);
+        writeInt32(data, nodeData->silent);
+    } else if (node->type == NCC_NodeType.SELECTION) {
+        SelectionNodeData* nodeData = node->data;
+        int32_t attemptedRulesCount = NVector.size(&nodeData->attemptedRules);
+        writeInt32(data, attemptedRulesCount);
+        for (int32_t i=0; i<attemptedRulesCount; i++) {
+            SubstituteNodeData* attemptedRule = NVector.get(&nodeData->attemptedRules, i);
+            writeInt32(data, attemptedRule->rule->data.ruleId);
+            writeInt32(data, attemptedRule->silent);
+        }
+        int32_t verificationRulesCount = NVector.size(&nodeData->verificationRules);
+        writeInt32(data, verificationRulesCount);
+        for (int32_t i=0; i<verificationRulesCount; i++) writeInt32(data, (*(NCC_Rule**) NVector.get(&nodeData->verificationRules, i))->data.ruleId);
+        writeInt32(data, nodeData->matchIfIncluded);
+    }
+    // Root and anything nodes have no fields to save.
 }
 
-void NCC_destroyNCC(struct NCC* ncc) {
+static void writeTree(struct NByteVector* data, NCC_Node* tree) {
+    for (NCC_Node* node = tree; node; node = node->nextNode) writeNode(data, node);
+    writeInt32(data, NCC_GRAMMAR_TREE_END);
+}
 
-    // Rules,
+void NCC_serializeGrammar(struct NCC* ncc, struct NByteVector* outData) {
+
+    // Header,
+    int32_t rulesCount = NVector.size(&ncc->rules);
+    NByteVector.resize(outData, 0);
+    writeInt32(outData, NCC_GRAMMAR_MAGIC);
+    writeInt32(outData, NCC_GRAMMAR_VERSION);
+    writeInt32(outData, rulesCount);
+
+    // Leave room for the rule table, then write the rules, filling their entries as we go. Note
+    // that the data may move as it grows, so entries are copied in, not written through pointers,
+    int32_t ruleTableOffset = NByteVector.size(outData);
+    NByteVector.resize(outData, ruleTableOffset + rulesCount * (int32_t) sizeof(GrammarRuleEntry));
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = *(NCC_Rule**) NVector.get(&ncc->rules, i);
+        GrammarRuleEntry entry;
+        entry.nameOffset = writeString(outData, NString.get(&rule->data.ruleName), NString.length(&rule->data.ruleName));
+        entry.textOffset = writeString(outData, NString.get(&rule->data.ruleText), NString.length(&rule->data.ruleText));
+        entry.treeOffset = NByteVector.size(outData);
+        writeTree(outData, rule->tree);
+        entry.flags = (rule->data.eagerListeners ? NCC_GRAMMAR_EAGER_LISTENERS : 0) | (rule->inlined ? NCC_GRAMMAR_INLINED : 0);
+        NSystemUtils.memcpy(&outData->objects[ruleTableOffset + i * (int32_t) sizeof(GrammarRuleEntry)], &entry, sizeof(GrammarRuleEntry));
+    }
+}
+
+// Reads the grammar data. Every read is checked against the data size. Once anything is wrong, an
+// error is raised and "failed" is set, after which nothing more is read,
+typedef struct GrammarReader {
+    struct NCC* ncc;
+    const uint8_t* data;
+    int32_t size;
+    int32_t offset;
+    boolean failed;
+} GrammarReader;
+
+static void grammarError(GrammarReader* reader, const char* problem) {
+    if (reader->failed) return;
+    NERROR("NCC", "NCC_deserializeGrammar(): %s at offset %s%d%s", problem, NTCOLOR(HIGHLIGHT), reader->offset, NTCOLOR(STREAM_DEFAULT));
+    reader->failed = True;
+}
+
+static boolean seekGrammarData(GrammarReader* reader, int32_t offset) {
+    if ((offset < 0) || (offset > reader->size)) {
+        grammarError(reader, "offset out of bounds");
+        return False;
+    }
+    reader->offset = offset;
+    return !reader->failed;
+}
+
+static boolean readBytes(GrammarReader* reader, void* outBytes, int32_t size) {
+    if (reader->failed) return False;
+    if (size > reader->size - reader->offset) {
+        grammarError(reader, "unexpected end of data");
+        return False;
+    }
+    NSystemUtils.memcpy(outBytes, &reader->data[reader->offset], size);
+    reader->offset += size;
+    return True;
+}
+
+static int32_t readInt32(GrammarReader* reader) {
+    int32_t value=0;
+    readBytes(reader, &value, sizeof(int32_t));
+    return value;
+}
+
+// Strings are used right where they are in the data, no copying. A zero inside a string would
+// match the terminating zero of the text, so it's rejected,
+static const char* readString(GrammarReader* reader, int32_t* outLength) {
+    int32_t length = readInt32(reader);
+    if (reader->failed) return 0;
+    if ((length < 0) || (length >= reader->size - reader->offset) || reader->data[reader->offset + length]) {
+        grammarError(reader, "malformed string");
+        return 0;
+    }
+    const char* string = (const char*) &reader->data[reader->offset];
+    for (int32_t i=0; i<length; i++) {
+        if (!string[i]) {
+            grammarError(reader, "malformed string");
+            return 0;
+        }
+    }
+    reader->offset += length+1;
+    if (outLength) *outLength = length;
+    return string;
+}
+
+static NCC_Rule* readRule(GrammarReader* reader) {
+    int32_t ruleId = readInt32(reader);
+    if (reader->failed) return 0;
+    NCC_Rule* rule = NCC_getRuleById(reader->ncc, ruleId);
+    if (!rule) grammarError(reader, "rule id out of bounds");
+    return rule;
+}
+
+// Reads a count of things that take at least "minimumSize" bytes each,
+static int32_t readCount(GrammarReader* reader, int32_t minimumCount, int32_t minimumSize) {
+    int32_t count = readInt32(reader);
+    if (reader->failed) return 0;
+    if ((count < minimumCount) || (count > (reader->size - reader->offset) / minimumSize)) {
+        grammarError(reader, "count out of bounds");
+        return 0;
+    }
+    return count;
+}
+
+static NCC_Node* readTree(GrammarReader* reader);
+
+static NCC_Node* readNode(GrammarReader* reader, int32_t type) {
+
+    if (type == NCC_NodeType.LITERALS) {
+        int32_t literalsCount;
+        const char* literals = readString(reader, &literalsCount);
+        if (!literals) return 0;
+        if (!literalsCount) {
+            grammarError(reader, "empty literals node");
+            return 0;
+        }
+        NCC_Node* node = genericCreateNode(NCC_NodeType.LITERALS, sizeof(LiteralsNodeData));
+        LiteralsNodeData* nodeData = node->data;
+        NString.initialize(&nodeData->literals, "");
+        setStringSpan(&nodeData->literals, literals, literalsCount);
+        updateLiteralsWords(nodeData);
+        return node;
+    } else if (type == NCC_NodeType.LITERAL_RANGE) {
+        unsigned char range[2];
+        if (!readBytes(reader, range, 2)) return 0;
+        if (!range[0] || !range[1]) {
+            // The terminating zero is never a part of the text,
+            grammarError(reader, "malformed literal range");
+            return 0;
+        }
+        return createLiteralRangeNode(range[0], range[1]);
+    } else if (type == NCC_NodeType.CHARACTER_CLASS) {
+        uint32_t characters[8];
+        if (!readBytes(reader, characters, sizeof(characters))) return 0;
+        return createCharacterClassNode(characters);
+    } else if (type == NCC_NodeType.OR) {
+        int32_t branchesCount = readCount(reader, 2, 2 * sizeof(int32_t));
+        if (reader->failed) return 0;
+        NCC_Node* node = genericCreateNode(NCC_NodeType.OR, sizeof(OrNodeData));
+        OrNodeData* nodeData = node->data;
+        NVector.initialize(&nodeData->branches      , branchesCount, sizeof(NCC_Node*));
+        NVector.initialize(&nodeData->branchPrograms, branchesCount, sizeof(int32_t  ));
+        for (int32_t i=0; i<branchesCount; i++) {
+            NCC_Node* branch = readTree(reader);
+            if (!branch) {
+                orNodeDeleteTree(node);
+                return 0;
+            }
+            NVector.pushBack(&nodeData->branches, &branch);
+        }
+        return node;
+    } else if ((type == NCC_NodeType.SUB_RULE) || (type == NCC_NodeType.REPEAT)) {
+        NCC_Node* tree = readTree(reader);
+        if (!tree) return 0;
+        if (type == NCC_NodeType.SUB_RULE) {
+            NCC_Node* node = genericCreateNode(NCC_NodeType.SUB_RULE, sizeof(SubRuleNodeData));
+            ((SubRuleNodeData*) node->data)->subRuleTree = tree;
+            return node;
+        }
+        NCC_Node* node = genericCreateNode(NCC_NodeType.REPEAT, sizeof(RepeatNodeData));
+        ((RepeatNodeData*) node->data)->repeatedNode = tree;
+        return node;
+    } else if (type == NCC_NodeType.ANYTHING) {
+        NCC_Node* node = genericCreateNode(NCC_NodeType.ANYTHING, sizeof(AnythingNodeData));
+        ((AnythingNodeData*) node->data)->delimiterWords.literalsCount = 0;
+        return node;
+    } else if (type == NCC_NodeType.SUBSTITUTE) {
+        NCC_Rule* rule = readRule(reader);
+        boolean silent = readInt32(reader) != 0;
+        if (reader->failed) return 0;
+        NCC_Node* node = genericCreateNode(NCC_NodeType.SUBSTITUTE, sizeof(SubstituteNodeData));
+        *((SubstituteNodeData*) node->data) = (SubstituteNodeData) { .rule=rule, .silent=silent };
+        return node;
+    } else if (type == NCC_NodeType.SELECTION) {
+
+        // Create the node the same way createSelectionNode() does,
+        NCC_Node* node = genericCreateNode(NCC_NodeType.SELECTION, sizeof(SelectionNodeData));
+        SelectionNodeData* nodeData = node->data;
+        NVector.initialize(&nodeData->   attemptedRules, 0, sizeof(SubstituteNodeData));
+        NVector.initialize(&nodeData->verificationRules, 0, sizeof(NCC_Rule*         ));
+        NVector.initialize(&nodeData->literalsTrie         , 0, sizeof(LiteralsTrieNode));
+        NVector.initialize(&nodeData->literalRulesTrieNodes, 0, sizeof(int32_t         ));
+        nodeData->substituteNode = genericCreateNode(NCC_NodeType.SUBSTITUTE, sizeof(SubstituteNodeData));
+        ((SubstituteNodeData*) nodeData->substituteNode->data)->rule = 0;
+
+        // Read the rules lists,
+        int32_t attemptedRulesCount = readCount(reader, 1, 2 * sizeof(int32_t));
+        for (int32_t i=0; i<attemptedRulesCount; i++) {
+            SubstituteNodeData attemptedRule;
+            attemptedRule.rule = readRule(reader);
+            attemptedRule.silent = readInt32(reader) != 0;
+            if (reader->failed) break;
+            NVector.pushBack(&nodeData->attemptedRules, &attemptedRule);
+        }
+        int32_t verificationRulesCount = readCount(reader, 0, sizeof(int32_t));
+        for (int32_t i=0; i<verificationRulesCount; i++) {
+            NCC_Rule* rule = readRule(reader);
+            if (reader->failed) break;
+            NVector.pushBack(&nodeData->verificationRules, &rule);
+        }
+        nodeData->matchIfIncluded = readInt32(reader) != 0;
+        if (reader->failed) {
+            selectionNodeDeleteTree(node);
+            return 0;
+        }
+        return node;
+    }
+
+    grammarError(reader, "unknown node type");
+    return 0;
+}
+
+static NCC_Node* readTree(GrammarReader* reader) {
+
+    // Every tree starts with a root node,
+    if (readInt32(reader) != NCC_NodeType.ROOT) {
+        grammarError(reader, "expected a root node");
+        return 0;
+    }
+    NCC_Node* rootNode = createRootNode();
+
+    // Read the nodes until the end of the tree,
+    NCC_Node* currentNode = rootNode;
+    do {
+        int32_t type = readInt32(reader);
+        if (reader->failed) break;
+        if (type == NCC_GRAMMAR_TREE_END) return rootNode;
+
+        NCC_Node* node = readNode(reader, type);
+        if (!node) break;
+        genericSetNextNode(currentNode, node);
+        currentNode = node;
+    } while (True);
+
+    // Failed,
+    rootNodeDeleteTree(rootNode);
+    return 0;
+}
+
+boolean NCC_deserializeGrammar(struct NCC* ncc, const void* data, int32_t size) {
+
+    // Grammars are loaded into empty NCCs only,
+    if (NVector.size(&ncc->rules)) {
+        NERROR("NCC", "NCC_deserializeGrammar(): can't load a grammar into an NCC that already has rules");
+        return False;
+    }
+
+    // Check the header,
+    GrammarReader reader = { .ncc=ncc, .data=data, .size=size, .offset=0, .failed=False };
+    if (readInt32(&reader) != NCC_GRAMMAR_MAGIC) grammarError(&reader, "not a grammar (or saved on a machine of a different byte order)");
+    if (readInt32(&reader) != NCC_GRAMMAR_VERSION) grammarError(&reader, "unsupported grammar version");
+    int32_t rulesCount = readCount(&reader, 0, sizeof(GrammarRuleEntry));
+    if (reader.failed) return False;
+    int32_t ruleTableOffset = reader.offset;
+
+    // Create all the rules first, so that trees can refer to any of them. Their trees are read
+    // next. Till then, they get empty trees,
+    for (int32_t i=0; i<rulesCount; i++) {
+        GrammarRuleEntry entry;
+        seekGrammarData(&reader, ruleTableOffset + i * (int32_t) sizeof(GrammarRuleEntry));
+        readBytes(&reader, &entry, sizeof(GrammarRuleEntry));
+        if (!seekGrammarData(&reader, entry.nameOffset)) break;
+        int32_t ruleNameLength;
+        const char* ruleName = readString(&reader, &ruleNameLength);
+        if (!seekGrammarData(&reader, entry.textOffset)) break;
+        const char* ruleText = readString(&reader, 0);
+        if (reader.failed) break;
+        if (getRule(ncc, ruleName, ruleNameLength)) {
+            grammarError(&reader, "duplicate rule name");
+            break;
+        }
+
+        NCC_Rule* rule = NMALLOC(sizeof(NCC_Rule), "NCC.NCC_deserializeGrammar() rule");
+        NCC_initializeRuleData(&rule->data, ruleName, ruleText, 0, 0, 0);
+        rule->data.eagerListeners = (entry.flags & NCC_GRAMMAR_EAGER_LISTENERS) != 0;
+        rule->inlined = (entry.flags & NCC_GRAMMAR_INLINED) != 0;
+        rule->tree = createRootNode();
+        NVector.initialize(&rule->program, 0, sizeof(NCC_Instruction));
+        rule->wrapperNode = genericCreateNode(NCC_NodeType.SUBSTITUTE, sizeof(SubstituteNodeData));
+        *((SubstituteNodeData*) rule->wrapperNode->data) = (SubstituteNodeData) { .rule=rule, .silent=False };
+        rule->data.ruleId = i;
+        NVector.pushBack(&ncc->rules, &rule);
+        addToRulesTable(ncc, rule);
+    }
+
+    // Read and compile the trees,
+    for (int32_t i=0; (i<rulesCount) && !reader.failed; i++) {
+        NCC_Rule* rule = *(NCC_Rule**) NVector.get(&ncc->rules, i);
+        GrammarRuleEntry entry;
+        seekGrammarData(&reader, ruleTableOffset + i * (int32_t) sizeof(GrammarRuleEntry));
+        readBytes(&reader, &entry, sizeof(GrammarRuleEntry));
+        if (!seekGrammarData(&reader, entry.treeOffset)) break;
+        NCC_Node* ruleTree = readTree(&reader);
+        if (!ruleTree) break;
+        rootNodeDeleteTree(rule->tree);
+        rule->tree = ruleTree;
+        compileRuleTree(ruleTree, &rule->program);
+    }
+    ncc->rulesAnalyzed = False;
+    if (!reader.failed) return True;
+
+    // Failed, remove whatever was loaded,
     for (int32_t i=NVector.size(&ncc->rules)-1; i>=0; i--) destroyAndFreeRule(*((NCC_Rule**) NVector.get(&ncc->rules, i)));
-    NVector.destroy(&ncc->rules);
+    NVector.clear(&ncc->rules);
+    NSystemUtils.memset(ncc->rulesTable.objects, 0, NVector.size(&ncc->rulesTable) * sizeof(NCC_Rule*));
+    return False;
+}
 
-    // Stacks,
-    NVector.destroy(&ncc->parentStack);
-    NVector.destroy(&ncc->maxMatchRuleStack);
-    for (int32_t i=0; i<NCC_AST_NODE_STACKS_COUNT; i++) NVector.destroyAndFree(ncc->astNodeStacks[i]);
+boolean NCC_saveGrammar(struct NCC* ncc, const char* filePath) {
+    struct NByteVector data;
+    NByteVector.initialize(&data, 0);
+    NCC_serializeGrammar(ncc, &data);
+    boolean written = NSystemUtils.writeToFile(filePath, (const char*) data.objects, NByteVector.size(&data), False);
+    NByteVector.destroy(&data);
+    if (!written) NERROR("NCC", "NCC_saveGrammar(): couldn't write file: %s%s%s", NTCOLOR(HIGHLIGHT), filePath, NTCOLOR(STREAM_DEFAULT));
+    return written;
+}
+
+boolean NCC_loadGrammar(struct NCC* ncc, const char* filePath) {
+
+    // Read the file,
+    int64_t fileSize = NSystemUtils.getFileSize(filePath, False);
+    if ((fileSize <= 0) || (fileSize > INT32_MAX)) {
+        NERROR("NCC", "NCC_loadGrammar(): couldn't read file: %s%s%s", NTCOLOR(HIGHLIGHT), filePath, NTCOLOR(STREAM_DEFAULT));
+        return False;
+    }
+    char* data = NMALLOC(fileSize, "NCC.NCC_loadGrammar() data");
+    if (NSystemUtils.readFromFile(filePath, False, 0, 0, data) != fileSize) {
+        NERROR("NCC", "NCC_loadGrammar(): couldn't read file: %s%s%s", NTCOLOR(HIGHLIGHT), filePath, NTCOLOR(STREAM_DEFAULT));
+        NFREE(data, "NCC.NCC_loadGrammar() data");
+        return False;
+    }
+
+    // Load,
+    boolean loaded = NCC_deserializeGrammar(ncc, data, fileSize);
+    NFREE(data, "NCC.NCC_loadGrammar() data");
+    return loaded;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Grammar analysis
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Looks for the patterns that make matching slow, or make parts of a grammar unreachable, and
+// estimates how much every rule can backtrack. Works on the compiled programs, after the rules
+// summaries are computed (see "Analysis" above),
+
+#define NCC_ANALYSIS_LONG_PREFIX_LENGTH 3               // Or branches sharing this many characters (or any rule) are reported.
+#define NCC_ANALYSIS_MAX_PREFIX_INSTRUCTIONS 32         // Or branches prefixes are compared up to this many instructions.
+#define NCC_ANALYSIS_MIN_SELECTION_BRANCHES 3           // Ors of rules only with this many branches are reported.
+#define NCC_ANALYSIS_MAX_BACKTRACKING_FACTOR 1000000.0  // Rules estimated to backtrack more than this are reported.
+
+typedef struct GrammarAnalysis {
+    struct NCC* ncc;
+    struct NString* report;
+    int32_t warningsCount;
+    double* backtrackingFactors;    // Per rule id. Zero until estimated, negative while being estimated.
+} GrammarAnalysis;
+
+static void addWarning(GrammarAnalysis* analysis, NCC_Rule* rule, const char* format, ...) {
+    NString.append(analysis->report, "Warning: rule \"%s\": ", NString.get(&rule->data.ruleName));
+    va_list vaList;
+    va_start(vaList, format);
+    NString.vAppend(analysis->report, format, vaList);
+    va_end(vaList);
+    NString.append(analysis->report, "\n");
+    analysis->warningsCount++;
+}
+
+static inline boolean isInstructionNullable(struct NCC* ncc, const NCC_Instruction* instruction) {
+    TreeSummary summary;
+    summarizeInstruction(ncc, (NCC_Instruction*) instruction, False, &summary);
+    return summary.nullable;
+}
+
+static inline int32_t getBranchesCount(const NCC_Instruction* instruction) {
+    return NVector.size(&((OrNodeData*) instruction->node->data)->branches);
+}
+
+// Left recursion: rules that can call themselves before consuming anything never stop calling
+// themselves. Marks the rules a chain can call at its very beginning, going through the
+// instructions that can match nothing,
+static void markLeftCalls(GrammarAnalysis* analysis, const NCC_Instruction* instruction, boolean* outCalledRules) {
+    for (; instruction->opCode != NCC_OP_END; instruction++) {
+        int32_t opCode = instruction->opCode;
+        if (opCode == NCC_NodeType.SUBSTITUTE) {
+            outCalledRules[((SubstituteNodeData*) instruction->node->data)->rule->data.ruleId] = True;
+        } else if (opCode == NCC_NodeType.SELECTION) {
+            struct NVector* attemptedRules = &((SelectionNodeData*) instruction->node->data)->attemptedRules;
+            for (int32_t i=NVector.size(attemptedRules)-1; i>=0; i--) outCalledRules[((SubstituteNodeData*) NVector.get(attemptedRules, i))->rule->data.ruleId] = True;
+        } else if (opCode == NCC_NodeType.OR) {
+            for (int32_t i=getBranchesCount(instruction)-1; i>=0; i--) markLeftCalls(analysis, &instruction[instruction->branchPrograms[i]], outCalledRules);
+        } else if ((opCode == NCC_NodeType.SUB_RULE) || (opCode == NCC_NodeType.REPEAT)) {
+            markLeftCalls(analysis, &instruction[instruction->subProgram], outCalledRules);
+        }
+        if (!isInstructionNullable(analysis->ncc, instruction)) return;
+    }
+}
+
+static void checkLeftRecursion(GrammarAnalysis* analysis) {
+
+    // Every rule's left calls, in a rules count x rules count matrix,
+    struct NCC* ncc = analysis->ncc;
+    int32_t rulesCount = NVector.size(&ncc->rules);
+    boolean* leftCalls = NMALLOC(rulesCount * rulesCount * sizeof(boolean), "NCC.checkLeftRecursion() leftCalls");
+    NSystemUtils.memset(leftCalls, 0, rulesCount * rulesCount * sizeof(boolean));
+    for (int32_t i=0; i<rulesCount; i++) markLeftCalls(analysis, (const NCC_Instruction*) NCC_getRuleById(ncc, i)->program.objects, &leftCalls[i * rulesCount]);
+
+    // Look for a path back to every rule (breadth first, so that the shortest one is reported),
+    int32_t* previousRules = NMALLOC(rulesCount * sizeof(int32_t), "NCC.checkLeftRecursion() previousRules");
+    int32_t* queue = NMALLOC(rulesCount * sizeof(int32_t), "NCC.checkLeftRecursion() queue");
+    struct NString path;
+    NString.initialize(&path, "");
+    for (int32_t i=0; i<rulesCount; i++) {
+        for (int32_t j=0; j<rulesCount; j++) previousRules[j] = -1;
+        int32_t queueStart=0, queueEnd=0;
+        queue[queueEnd++] = i;
+        while ((queueStart < queueEnd) && (previousRules[i] == -1)) {
+            int32_t caller = queue[queueStart++];
+            for (int32_t callee=0; callee<rulesCount; callee++) {
+                if (!leftCalls[caller * rulesCount + callee] || (previousRules[callee] != -1)) continue;
+                previousRules[callee] = caller;
+                queue[queueEnd++] = callee;
+            }
+        }
+        if (previousRules[i] == -1) continue;
+
+        // Found. Collect the path backwards (the queue is no longer needed), then write it down,
+        int32_t pathLength=0;
+        for (int32_t ruleId = previousRules[i]; ruleId != i; ruleId = previousRules[ruleId]) queue[pathLength++] = ruleId;
+        NString.set(&path, "%s", NString.get(&NCC_getRuleById(ncc, i)->data.ruleName));
+        for (int32_t j=pathLength-1; j>=0; j--) NString.append(&path, " -> %s", NString.get(&NCC_getRuleById(ncc, queue[j])->data.ruleName));
+        addWarning(analysis, NCC_getRuleById(ncc, i), "left recursive, matching never ends: %s -> %s", NString.get(&path), NString.get(&NCC_getRuleById(ncc, i)->data.ruleName));
+    }
+    NString.destroy(&path);
+    NFREE(queue, "NCC.checkLeftRecursion() queue");
+    NFREE(previousRules, "NCC.checkLeftRecursion() previousRules");
+    NFREE(leftCalls, "NCC.checkLeftRecursion() leftCalls");
+}
+
+// Lists the instructions a chain starts with, looking into sub-rules, up to the first instruction
+// that can't be compared. Returns false if it stopped before the end of the chain,
+static boolean listLeadingInstructions(const NCC_Instruction* instruction, const NCC_Instruction** outInstructions, int32_t* in_out_count) {
+    for (; instruction->opCode != NCC_OP_END; instruction++) {
+        int32_t opCode = instruction->opCode;
+        if (*in_out_count == NCC_ANALYSIS_MAX_PREFIX_INSTRUCTIONS) return False;
+        if (opCode == NCC_NodeType.SUB_RULE) {
+            if (!listLeadingInstructions(&instruction[instruction->subProgram], outInstructions, in_out_count)) return False;
+        } else if ((opCode == NCC_OP_LITERALS) || (opCode == NCC_OP_LITERAL_RANGE) || (opCode == NCC_OP_CHARACTER_CLASS) || (opCode == NCC_NodeType.SUBSTITUTE)) {
+            outInstructions[(*in_out_count)++] = instruction;
+        } else {
+            return False;
+        }
+    }
+    return True;
 }
 
-void NCC_destroyAndFreeNCC(struct NCC* ncc) {
-    NCC_destroyNCC(ncc);
-    NFREE(ncc, "NCC.NCC_destroyAndFreeNCC() ncc");
+// Counts the characters and the rules two chains start with in common,
+static void getCommonPrefix(const NCC_Instruction* chain1, const NCC_Instruction* chain2, int32_t* outCharactersCount, int32_t* outRulesCount) {
+
+    const NCC_Instruction *instructions1[NCC_ANALYSIS_MAX_PREFIX_INSTRUCTIONS], *instructions2[NCC_ANALYSIS_MAX_PREFIX_INSTRUCTIONS];
+    int32_t instructionsCount1=0, instructionsCount2=0;
+    listLeadingInstructions(chain1, instructions1, &instructionsCount1);
+    listLeadingInstructions(chain2, instructions2, &instructionsCount2);
+
+    *outCharactersCount = *outRulesCount = 0;
+    for (int32_t i=0; (i<instructionsCount1) && (i<instructionsCount2); i++) {
+        const NCC_Instruction* instruction1 = instructions1[i];
+        const NCC_Instruction* instruction2 = instructions2[i];
+        int32_t opCode = instruction1->opCode;
+        if (opCode != instruction2->opCode) return;
+        if (opCode == NCC_OP_LITERALS) {
+            int32_t length=0;
+            while (instruction1->literals[length] && (instruction1->literals[length] == instruction2->literals[length])) length++;
+            *outCharactersCount += length;
+            if (instruction1->literals[length] || instruction2->literals[length]) return;
+        } else if (opCode == NCC_OP_LITERAL_RANGE) {
+            if ((instruction1->rangeStart != instruction2->rangeStart) || (instruction1->rangeEnd != instruction2->rangeEnd)) return;
+            (*outCharactersCount)++;
+        } else if (opCode == NCC_OP_CHARACTER_CLASS) {
+            for (int32_t j=0; j<8; j++) if (instruction1->characterClass[j] != instruction2->characterClass[j]) return;
+            (*outCharactersCount)++;
+        } else {
+            if (((SubstituteNodeData*) instruction1->node->data)->rule != ((SubstituteNodeData*) instruction2->node->data)->rule) return;
+            (*outRulesCount)++;
+        }
+    }
 }
 
-// Creates a rule and adds it to the NCC,
-boolean NCC_addRule(struct NCC* ncc, NCC_RuleData* ruleData) {
+static void checkOr(GrammarAnalysis* analysis, NCC_Rule* rule, const NCC_Instruction* instruction) {
+
+    // Branches that start the same way match the same thing again and again,
+    int32_t branchesCount = getBranchesCount(instruction);
+    int32_t longestBranch1=-1, longestBranch2=-1, longestCharactersCount=0, longestRulesCount=0;
+    for (int32_t i=0; i<branchesCount; i++) {
+        for (int32_t j=i+1; j<branchesCount; j++) {
+            int32_t charactersCount, rulesCount;
+            getCommonPrefix(&instruction[instruction->branchPrograms[i]], &instruction[instruction->branchPrograms[j]], &charactersCount, &rulesCount);
+            if ((rulesCount < longestRulesCount) || ((rulesCount == longestRulesCount) && (charactersCount <= longestCharactersCount))) continue;
+            longestBranch1 = i; longestBranch2 = j;
+            longestCharactersCount = charactersCount; longestRulesCount = rulesCount;
+        }
+    }
+    if (longestRulesCount || (longestCharactersCount >= NCC_ANALYSIS_LONG_PREFIX_LENGTH)) {
+        addWarning(analysis, rule, "or branches %d and %d share a prefix (rules: %d, characters: %d), which is matched again for every branch. Factor it out of the or",
+                longestBranch1+1, longestBranch2+1, longestRulesCount, longestCharactersCount);
+    }
 
-    // Check if a rule with this name already exists,
-    const char* ruleName = NString.get(&ruleData->ruleName);
-    if (NCC_getRule(ncc, ruleName)) {
-        NERROR("NCC", "NCC_addRule(): unable to create rule %s%s%s. A rule with the same name exists.", NTCOLOR(HIGHLIGHT), ruleName, NTCOLOR(STREAM_DEFAULT));
-        return False;
+    // An or of rules only could be a selection, which matches the rules without matching the rest
+    // of the tree for every one of them, and skips the literal rules that don't match at once,
+    if (branchesCount < NCC_ANALYSIS_MIN_SELECTION_BRANCHES) return;
+    for (int32_t i=0; i<branchesCount; i++) {
+        const NCC_Instruction* branch = &instruction[instruction->branchPrograms[i]];
+        if ((branch->opCode != NCC_NodeType.SUBSTITUTE) || (branch[1].opCode != NCC_OP_END)) return;
+    }
+    struct NString selection;
+    NString.initialize(&selection, "#{");
+    for (int32_t i=0; i<branchesCount; i++) {
+        SubstituteNodeData* nodeData = instruction[instruction->branchPrograms[i]].node->data;
+        NString.append(&selection, "%s{%s}", i ? " " : "", NString.get(&nodeData->rule->data.ruleName));
     }
+    NString.append(&selection, "}");
+    addWarning(analysis, rule, "or of rules only, could be the selection %s", NString.get(&selection));
+    NString.destroy(&selection);
+}
 
-    // Create rule tree,
-    const char* ruleText = NString.get(&ruleData->ruleText);
-    NCC_Node* ruleTree = constructRuleTree(ncc, ruleText);
-    if (!ruleTree) {
-        NERROR("NCC", "NCC_addRule(): unable to construct rule tree: %s%s%s", NTCOLOR(HIGHLIGHT), ruleText, NTCOLOR(STREAM_DEFAULT));
+// If the instruction matches exactly one character, gets the set of characters it matches,
+static boolean getSingleCharacterSet(const NCC_Instruction* instruction, uint32_t* outCharacters) {
+    NSystemUtils.memset(outCharacters, 0, 8 * sizeof(uint32_t));
+    if ((instruction->opCode == NCC_OP_LITERALS) && (instruction->literalsWords.literalsCount == 1)) {
+        addByte(outCharacters, (unsigned char) instruction->literals[0]);
+    } else if (instruction->opCode == NCC_OP_LITERAL_RANGE) {
+        addByteRange(outCharacters, instruction->rangeStart, instruction->rangeEnd);
+    } else if (instruction->opCode == NCC_OP_CHARACTER_CLASS) {
+        addBytes(outCharacters, instruction->characterClass);
+    } else {
         return False;
     }
-
-    // Create and initialize rule,
-    NCC_Rule* rule = NMALLOC(sizeof(NCC_Rule), "NCC.NCC_addRule() rule");
-    rule->tree = ruleTree;
-    rule->data = *ruleData;  // Copy all members. But note that, copying strings is dangerous due
-                             // to memory allocations. For every string in ruleData, we now have
-                             // two NStrings pointing to the same memory block.
-                             // Just create new NStrings overwriting the ones we just copied,
-    NString.initialize(&rule->data.ruleName, "%s", ruleName);
-    NString.initialize(&rule->data.ruleText, "%s", ruleText);
-
-    // Add to ncc,
-    NVector.pushBack(&ncc->rules, &rule);
     return True;
 }
 
-// Returns the rule with the specified name from this ncc if found, NULL otherwise,
-NCC_Rule* NCC_getRule(struct NCC* ncc, const char* ruleName) {
-    for (int32_t i=NVector.size(&ncc->rules)-1; i>=0; i--) {
-        NCC_Rule* currentRule = *((NCC_Rule**) NVector.get(&ncc->rules, i));
-        if (NCString.equals(ruleName, NString.get(&currentRule->data.ruleName))) return currentRule;
-    }
-    return 0;
+// Whether the instruction is a repeat of a single character that ends its chain. Nothing follows it,
+// so it simply takes as many of the character as it can,
+static inline boolean isTrailingCharacterRepeat(const NCC_Instruction* instruction) {
+    if ((instruction->opCode != NCC_NodeType.REPEAT) || (instruction[1].opCode != NCC_OP_END)) return False;
+    const NCC_Instruction* repeatedInstruction = &instruction[instruction->subProgram];
+    uint32_t characters[8];
+    return getSingleCharacterSet(repeatedInstruction, characters) && (repeatedInstruction[1].opCode == NCC_OP_END);
 }
 
-// Returns the rule data of the specified rule (duh!),
-NCC_RuleData* NCC_getRuleData(struct NCC* ncc, const char* ruleName) {
-    NCC_Rule* rule = NCC_getRule(ncc, ruleName);
-    if (!rule) {
-        NERROR("NCC", "NCC_getRuleData(): couldn't find rule: %s%s%s", NTCOLOR(HIGHLIGHT), ruleName, NTCOLOR(STREAM_DEFAULT));
-        return 0;
+// Checks whether a rule that has no rejecting listeners, and that is made of single characters and
+// literals only (optionally ending with a repeated single character), matches all of "literals".
+// When it does, it matches at least as much wherever "literals" appear,
+static boolean simpleRuleMatchesLiterals(NCC_Rule* rule, const char* literals) {
+
+    NCC_ruleMatchListener matchListener = rule->data.ruleMatchListener;
+    if (matchListener && (matchListener != NCC_matchASTNode) && (matchListener != NCC_matchSpanASTNode)) return False;
+
+    int32_t length=0;
+    uint32_t characters[8];
+    for (const NCC_Instruction* instruction = rule->program.objects; True; instruction++) {
+        if (instruction->opCode == NCC_OP_END) return !literals[length];
+        if (instruction->opCode == NCC_OP_LITERALS) {
+            for (const char* ruleLiterals = instruction->literals; *ruleLiterals; ruleLiterals++, length++) {
+                if (*ruleLiterals != literals[length]) return False;
+            }
+        } else if (getSingleCharacterSet(instruction, characters)) {
+            if (!literals[length] || !containsByte(characters, (unsigned char) literals[length])) return False;
+            length++;
+        } else if (isTrailingCharacterRepeat(instruction)) {
+            getSingleCharacterSet(&instruction[instruction->subProgram], characters);
+            while (literals[length] && containsByte(characters, (unsigned char) literals[length])) length++;
+            return !literals[length];
+        } else {
+            return False;
+        }
     }
-    return &rule->data;
 }
 
-boolean NCC_updateRule(struct NCC* ncc, NCC_RuleData* ruleData) {
+static void checkSelection(GrammarAnalysis* analysis, NCC_Rule* rule, const NCC_Instruction* instruction) {
 
-    // Fetch rule,
-    const char* ruleName = NString.get(&ruleData->ruleName);
-    NCC_Rule* rule = NCC_getRule(ncc, ruleName);
-    if (!rule) {
-        NERROR("NCC", "NCC_updateRule(): unable to update rule %s%s%s. Rule doesn't exist.", NTCOLOR(HIGHLIGHT), ruleName, NTCOLOR(STREAM_DEFAULT));
-        return False;
+    SelectionNodeData* nodeData = instruction->node->data;
+    int32_t attemptedRulesCount = NVector.size(&nodeData->attemptedRules);
+    for (int32_t i=0; i<attemptedRulesCount; i++) {
+        NCC_Rule* attemptedRule = ((SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, i))->rule;
+
+        // Ties go to the earlier rules. A literal rule can't win if an earlier rule always matches
+        // the same literals (rules attempted twice are already rejected by the parser),
+        const char* literals = getRuleLiterals(attemptedRule);
+        for (int32_t j=0; j<i; j++) {
+            NCC_Rule* earlierRule = ((SubstituteNodeData*) NVector.get(&nodeData->attemptedRules, j))->rule;
+            if (literals && simpleRuleMatchesLiterals(earlierRule, literals)) {
+                addWarning(analysis, rule, "selection rule \"%s\" can never win, \"%s\" is attempted first and always matches as much", NString.get(&attemptedRule->data.ruleName), NString.get(&earlierRule->data.ruleName));
+                break;
+            }
+        }
     }
+}
 
-    // Create new rule tree,
-    const char* ruleText = NString.get(&ruleData->ruleText);
-    if (!NCC_updateRuleText(ncc, rule, ruleText)) return False;
+// Checks every instruction of a chain, and the chains they own. "followed" is whether something
+// follows the chain outside of it,
+static void checkChain(GrammarAnalysis* analysis, NCC_Rule* rule, const NCC_Instruction* instruction, boolean followed) {
+    for (; instruction->opCode != NCC_OP_END; instruction++) {
+        boolean ownedChainsFollowed = followed || (instruction[1].opCode != NCC_OP_END);
+        int32_t opCode = instruction->opCode;
+        if (opCode == NCC_NodeType.ANYTHING) {
+            // Anything nodes only look for the rest of their own chain (see "Wildcard nodes" in NCC.h),
+            if (followed && (instruction[1].opCode == NCC_OP_END)) addWarning(analysis, rule, "anything node (*) with nothing after it in its sub-rule consumes the whole text, so what follows the sub-rule never matches");
+        } else if (opCode == NCC_NodeType.REPEAT) {
+            TreeSummary summary;
+            summarizeChain(analysis->ncc, (NCC_Instruction*) &instruction[instruction->subProgram], False, &summary);
+            if (summary.nullable) addWarning(analysis, rule, "repeated tree (^*) can match nothing, repeating silently stops at its first empty match");
+            checkChain(analysis, rule, &instruction[instruction->subProgram], ownedChainsFollowed);
+        } else if (opCode == NCC_NodeType.SUB_RULE) {
+            checkChain(analysis, rule, &instruction[instruction->subProgram], ownedChainsFollowed);
+        } else if (opCode == NCC_NodeType.OR) {
+            checkOr(analysis, rule, instruction);
+            for (int32_t i=getBranchesCount(instruction)-1; i>=0; i--) checkChain(analysis, rule, &instruction[instruction->branchPrograms[i]], ownedChainsFollowed);
+        } else if (opCode == NCC_NodeType.SELECTION) {
+            checkSelection(analysis, rule, instruction);
+        }
+    }
+}
 
-    // Reinitialize rule data by copying all members. But note that copying strings is dangerous due
-    // to memory allocations. Strings have to be handled carefully,
-    if (ruleData != &rule->data) {   // We needn't copy onto ourselves. It's dangerous in fact.
+// The backtracking factor estimates how many node matches a single attempt of a chain can take in
+// the worst case, without memoization. Or nodes match the rest of the chain once for every branch,
+// and a rule is matched again by every node that refers to it. So nested ors and rules referred to
+// many times (like expression levels that match the next level more than once) multiply. Repeats
+// count a single repetition. Recursive references count as a single node match,
+static double estimateRuleBacktrackingFactor(GrammarAnalysis* analysis, NCC_Rule* rule);
+
+static double estimateChainBacktrackingFactor(GrammarAnalysis* analysis, const NCC_Instruction* instruction) {
+
+    if (instruction->opCode == NCC_OP_END) return 0;
+    double restFactor = estimateChainBacktrackingFactor(analysis, &instruction[1]);
+
+    int32_t opCode = instruction->opCode;
+    if (opCode == NCC_NodeType.OR) {
+        double factor = 0;
+        int32_t branchesCount = getBranchesCount(instruction);
+        for (int32_t i=0; i<branchesCount; i++) factor += estimateChainBacktrackingFactor(analysis, &instruction[instruction->branchPrograms[i]]);
+        return factor + branchesCount * restFactor;
+    } else if ((opCode == NCC_NodeType.SUB_RULE) || (opCode == NCC_NodeType.REPEAT)) {
+        return estimateChainBacktrackingFactor(analysis, &instruction[instruction->subProgram]) + restFactor;
+    } else if (opCode == NCC_NodeType.SUBSTITUTE) {
+        return estimateRuleBacktrackingFactor(analysis, ((SubstituteNodeData*) instruction->node->data)->rule) + restFactor;
+    } else if (opCode == NCC_NodeType.SELECTION) {
+        double factor = 0;
+        struct NVector* attemptedRules = &((SelectionNodeData*) instruction->node->data)->attemptedRules;
+        for (int32_t i=NVector.size(attemptedRules)-1; i>=0; i--) factor += estimateRuleBacktrackingFactor(analysis, ((SubstituteNodeData*) NVector.get(attemptedRules, i))->rule);
+        return factor + restFactor;
+    }
+    return 1 + restFactor;
+}
 
-        // Keep our old strings,
-        struct NString ruleNameString = rule->data.ruleName;
-        struct NString ruleTextString = rule->data.ruleText;
+static double estimateRuleBacktrackingFactor(GrammarAnalysis* analysis, NCC_Rule* rule) {
+    double* factor = &analysis->backtrackingFactors[rule->data.ruleId];
+    if (*factor < 0) return 1;
+    if (*factor > 0) return *factor;
+    *factor = -1;
+    double estimatedFactor = estimateChainBacktrackingFactor(analysis, rule->program.objects);
+    return *factor = (estimatedFactor < 1) ? 1 : estimatedFactor;
+}
 
-        // Overwrite,
-        rule->data = *ruleData;
+int32_t NCC_analyzeGrammar(struct NCC* ncc, struct NString* outReport) {
 
-        // Restore our old strings,
-        rule->data.ruleName = ruleNameString;
-        rule->data.ruleText = ruleTextString;
-        NString.set(&rule->data.ruleName, "%s", ruleName);
-        NString.set(&rule->data.ruleText, "%s", ruleText);
+    NString.set(outReport, "");
+    int32_t rulesCount = NVector.size(&ncc->rules);
+    if (!rulesCount) {
+        NString.append(outReport, "No rules.\n");
+        return 0;
     }
+    if (!ncc->rulesAnalyzed) analyzeRules(ncc);
+    GrammarAnalysis analysis = { .ncc=ncc, .report=outReport, .warningsCount=0 };
 
-    return True;
-}
-
-boolean NCC_updateRuleText(struct NCC* ncc, NCC_Rule* rule, const char* newRuleText) {
+    // Lints,
+    checkLeftRecursion(&analysis);
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = NCC_getRuleById(ncc, i);
+        if (NCString.contains(NString.get(&rule->data.ruleText), "STUB!")) addWarning(&analysis, rule, "still a stub (STUB!), was never updated with its actual text");
+        checkChain(&analysis, rule, rule->program.objects, False);
+    }
 
-    // Create new rule tree,
-    NCC_Node* ruleTree = constructRuleTree(ncc, newRuleText);
-    if (!ruleTree) {
-        NERROR("NCC", "NCC_updateRuleText(): unable to construct rule tree: %s%s%s. Failed to update rule: %s%s%s.", NTCOLOR(HIGHLIGHT), newRuleText, NTCOLOR(STREAM_DEFAULT), NTCOLOR(HIGHLIGHT), NString.get(&rule->data.ruleName), NTCOLOR(STREAM_DEFAULT));
-        return False;
+    // Backtracking factors,
+    analysis.backtrackingFactors = NMALLOC(rulesCount * sizeof(double), "NCC.NCC_analyzeGrammar() backtrackingFactors");
+    NSystemUtils.memset(analysis.backtrackingFactors, 0, rulesCount * sizeof(double));
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = NCC_getRuleById(ncc, i);
+        double factor = estimateRuleBacktrackingFactor(&analysis, rule);
+        if (!ncc->memoize && (factor > NCC_ANALYSIS_MAX_BACKTRACKING_FACTOR)) addWarning(&analysis, rule, "estimated worst-case backtracking factor of %.3g, turn on memoization or factor out repeated matches", factor);
+    }
+    NString.append(outReport, "Estimated worst-case backtracking factors (without memoization):\n");
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = NCC_getRuleById(ncc, i);
+        NString.append(outReport, "    \"%s\": %.3g\n", NString.get(&rule->data.ruleName), analysis.backtrackingFactors[rule->data.ruleId]);
     }
+    NFREE(analysis.backtrackingFactors, "NCC.NCC_analyzeGrammar() backtrackingFactors");
 
-    // Dispose of the old rule-tree and set the new one,
-    nodeDeleteTree[rule->tree->type](rule->tree);
-    rule->tree = ruleTree;
+    NString.append(outReport, "%d warning%s.\n", analysis.warningsCount, (analysis.warningsCount == 1) ? "" : "s");
+    return analysis.warningsCount;
+}
 
-    // Update rule data,
-    NString.set(&rule->data.ruleText, "%s", newRuleText);
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rule optimization
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Rule trees are optimized in place, then compiled again. Two rewrites are done:
+//    => Substitute nodes of rules that have no listeners are replaced by copies of the rules trees.
+//       Such rules create no AST nodes and can't reject matches, so matching their trees right
+//       away gives the same result without the substitute node machinery (silence, memoization
+//       and AST stack bookkeeping).
+//    => Sub-rule nodes are replaced by the nodes they contain, when that doesn't change what they
+//       match (see isChainIsolationFree()).
+//    => Consecutive literals nodes (like those split by breakLastLiteralIfNeeded(), or brought
+//       together by the rewrites above) are merged into one. A literals node fails as a whole, so
+//       failed matches may then report shorter lengths.
+// Inlined trees are copied as they are when they match the same in place, and wrapped in sub-rule
+// nodes otherwise.
+
+#define NCC_OPTIMIZER_MAX_INLINED_NODES 8 // Larger rules are left as substitutes.
+
+typedef struct RuleOptimizer {
+    struct NCC* ncc;
+    struct NVector inliningStack;   // NCC_Rule*. The rule being optimized and the rules being inlined
+                                    // into it. Inlining them again would never end.
+    int32_t inlinedNodesCount;
+} RuleOptimizer;
+
+// Or, repeat and anything nodes match differently depending on what follows them. Chains without
+// them match the same, whether isolated (in a sub-rule or a rule of their own) or followed by more
+// nodes,
+static boolean isChainIsolationFree(NCC_Node* tree) {
+    for (NCC_Node* node = tree->nextNode; node; node = node->nextNode) {
+        if ((node->type == NCC_NodeType.OR) || (node->type == NCC_NodeType.REPEAT) || (node->type == NCC_NodeType.ANYTHING)) return False;
+    }
     return True;
 }
 
-boolean NCC_match(struct NCC* ncc, NCC_Rule* rule, const char* text, NCC_MatchingResult* outResult, NCC_ASTNode_Data* outNode) {
+// Counts the nodes of the tree (and the trees it owns), root nodes aside. Sets outHasRules if any
+// of them matches other rules,
+static int32_t countTreeNodes(NCC_Node* tree, boolean* outHasRules) {
+    int32_t nodesCount=0;
+    for (NCC_Node* node = tree; node; node = node->nextNode) {
+        if (node->type == NCC_NodeType.ROOT) continue;
+        nodesCount++;
+        if ((node->type == NCC_NodeType.SUBSTITUTE) || (node->type == NCC_NodeType.SELECTION)) {
+            *outHasRules = True;
+        } else if (node->type == NCC_NodeType.OR) {
+            OrNodeData* nodeData = node->data;
+            int32_t branchesCount = NVector.size(&nodeData->branches);
+            for (int32_t i=0; i<branchesCount; i++) nodesCount += countTreeNodes(*(NCC_Node**) NVector.get(&nodeData->branches, i), outHasRules);
+        } else if (node->type == NCC_NodeType.SUB_RULE) {
+            nodesCount += countTreeNodes(((SubRuleNodeData*) node->data)->subRuleTree, outHasRules);
+        } else if (node->type == NCC_NodeType.REPEAT) {
+            nodesCount += countTreeNodes(((RepeatNodeData*) node->data)->repeatedNode, outHasRules);
+        }
+    }
+    return nodesCount;
+}
 
-    // Wrap the rule into a substitute node so it can appear in the AST tree,
-    NCC_Node* ruleTreeToBeMatched;
-    if (rule->data.createASTNodeListener || rule->data.ruleMatchListener) {
+static boolean isInlinable(RuleOptimizer* optimizer, NCC_Node* substituteNode) {
 
-        // Prepare the wrapping rule text,
-        struct NString wrappingRuleText;
-        NString.initialize(&wrappingRuleText, "${%s}", NString.get(&rule->data.ruleName));
+    // Rules with listeners have to go through substitute nodes. Same for rules that fire listeners
+    // eagerly, they change how the rules they match are matched,
+    SubstituteNodeData* nodeData = substituteNode->data;
+    NCC_Rule* rule = nodeData->rule;
+    if (rule->data.createASTNodeListener || rule->data.ruleMatchListener || rule->data.eagerListeners) return False;
 
-        // Only update if the rule to be matched changed since the last time,
-        if (!NCString.equals(
-                NString.get(&ncc->matchRule->data.ruleText),
-                NString.get(&wrappingRuleText))) {
-            NCC_updateRuleText(ncc, ncc->matchRule, NString.get(&wrappingRuleText));
-        }
+    int32_t stackSize = NVector.size(&optimizer->inliningStack);
+    for (int32_t i=0; i<stackSize; i++) {
+        if (*(NCC_Rule**) NVector.get(&optimizer->inliningStack, i) == rule) return False;
+    }
+
+    // Silent substitute nodes silence the rules matched inside them. Inline them only if there are
+    // none,
+    boolean hasRules = False;
+    if (countTreeNodes(rule->tree, &hasRules) > NCC_OPTIMIZER_MAX_INLINED_NODES) return False;
+    return !(nodeData->silent && hasRules);
+}
 
-        // Cleanup and set the wrapping rule's tree as the one to be matched,
-        NString.destroy(&wrappingRuleText);
-        ruleTreeToBeMatched = ncc->matchRule->tree;
+// Copies the tree through the grammar serialization, which already writes and reads every node
+// type,
+static NCC_Node* copyTree(struct NCC* ncc, NCC_Node* tree) {
+    struct NByteVector data;
+    NByteVector.initialize(&data, 0);
+    writeTree(&data, tree);
+    GrammarReader reader = { .ncc=ncc, .data=data.objects, .size=NByteVector.size(&data), .offset=0, .failed=False };
+    NCC_Node* copy = readTree(&reader);
+    NByteVector.destroy(&data);
+    return copy;
+}
 
-    } else {
-        // The rule won't show in the tree anyway, match directly,
-        ruleTreeToBeMatched = rule->tree;
+// Replaces the node with the chain of the tree. The node (but not the trees it owns) and the root
+// node of the tree are freed. Returns the node that now comes before the node following the
+// replaced one,
+static NCC_Node* replaceNodeWithChain(NCC_Node* node, NCC_Node* tree) {
+
+    NCC_Node* previousNode = node->previousNode;
+    NCC_Node* nextNode = node->nextNode;
+    genericSetNextNode(previousNode, 0);
+    genericSetNextNode(node, 0);
+    NFREE(node, "NCC.replaceNodeWithChain() node");
+
+    NCC_Node* firstNode = tree->nextNode;
+    genericSetNextNode(tree, 0);
+    rootNodeDeleteTree(tree);
+    if (!firstNode) {
+        genericSetNextNode(previousNode, nextNode);
+        return previousNode;
     }
 
-    // Prepare for matching,
-    ncc->maxMatchLength = 0;
-    ncc->textBeginning = text;
-    NVector.clear(&ncc->maxMatchRuleStack);
+    NCC_Node* lastNode = firstNode;
+    while (lastNode->nextNode) lastNode = lastNode->nextNode;
+    genericSetNextNode(previousNode, firstNode);
+    genericSetNextNode(lastNode, nextNode);
+    return lastNode;
+}
 
-    // Match,
-    MatchedASTTree ruleTree;
-    boolean matched = matchRuleTree(ncc, ruleTreeToBeMatched, text,
-                                    &ruleTree, 0, &ncc->astNodeStacks[0],
-                                    0, (MatchedASTTree *[]) {&ruleTree}, 1);
-    *outResult = ruleTree.result;
-    if (matched && !ruleTree.result.terminate) {
+// Appends the literals of the literals nodes that follow this one to it, and removes them,
+static void mergeFollowingLiteralsNodes(NCC_Node* node) {
+    LiteralsNodeData* nodeData = node->data;
+    if (!node->nextNode || (node->nextNode->type != NCC_NodeType.LITERALS)) return;
+    do {
+        NCC_Node* mergedNode = node->nextNode;
+        NCC_Node* nextNode = mergedNode->nextNode;
+        genericSetNextNode(mergedNode, 0);
+        genericSetNextNode(node, nextNode);
+        NString.append(&nodeData->literals, "%s", NString.get(&((LiteralsNodeData*) mergedNode->data)->literals));
+        literalsNodeDeleteTree(mergedNode);
+    } while (node->nextNode && (node->nextNode->type == NCC_NodeType.LITERALS));
+    updateLiteralsWords(nodeData);
+}
 
-        // If an output node is expected, return it,
-        if (outNode) {
-            // TODO: .... there could be more than one node on the stack?...
-            if (!NVector.popBack(ncc->astNodeStacks[0], outNode)) NSystemUtils.memset(outNode, 0, sizeof(NCC_ASTNode_Data));
-        } else {
+static void optimizeChain(RuleOptimizer* optimizer, NCC_Node* tree);
+
+static NCC_Node* inlineSubstituteNode(RuleOptimizer* optimizer, NCC_Node* node) {
+
+    NCC_Rule* rule = ((SubstituteNodeData*) node->data)->rule;
+    NCC_Node* inlinedTree = copyTree(optimizer->ncc, rule->tree);
+    NVector.pushBack(&optimizer->inliningStack, &rule);
+    optimizeChain(optimizer, inlinedTree);
+    NVector.popBack(&optimizer->inliningStack, &rule);
+    rule->inlined = True;
+    optimizer->inlinedNodesCount++;
+
+    // Nothing follows the last node of a chain, so it needn't be isolated,
+    if (!node->nextNode || isChainIsolationFree(inlinedTree)) return replaceNodeWithChain(node, inlinedTree);
+
+    NCC_Node* subRuleNode = genericCreateNode(NCC_NodeType.SUB_RULE, sizeof(SubRuleNodeData));
+    ((SubRuleNodeData*) subRuleNode->data)->subRuleTree = inlinedTree;
+    NCC_Node* previousNode = node->previousNode;
+    NCC_Node* nextNode = node->nextNode;
+    genericSetNextNode(previousNode, 0);
+    genericSetNextNode(node, 0);
+    NFREE(node, "NCC.inlineSubstituteNode() node");
+    genericSetNextNode(previousNode, subRuleNode);
+    genericSetNextNode(subRuleNode, nextNode);
+    return subRuleNode;
+}
 
-            // Delete the unused tree,
-            NCC_ASTNode_Data tempNode;
-            while (NVector.popBack(ncc->astNodeStacks[0], &tempNode)) {
-                NCC_deleteASTNodeListener deleteListener = tempNode.rule->deleteASTNodeListener;
-                if (deleteListener) deleteListener(&tempNode, 0);
-            }
+static void optimizeChain(RuleOptimizer* optimizer, NCC_Node* tree) {
+    for (NCC_Node* node = tree->nextNode; node; node = node->nextNode) {
+        if (node->type == NCC_NodeType.OR) {
+            OrNodeData* nodeData = node->data;
+            int32_t branchesCount = NVector.size(&nodeData->branches);
+            for (int32_t i=0; i<branchesCount; i++) optimizeChain(optimizer, *(NCC_Node**) NVector.get(&nodeData->branches, i));
+        } else if (node->type == NCC_NodeType.REPEAT) {
+            optimizeChain(optimizer, ((RepeatNodeData*) node->data)->repeatedNode);
+        } else if (node->type == NCC_NodeType.SUB_RULE) {
+            NCC_Node* subRuleTree = ((SubRuleNodeData*) node->data)->subRuleTree;
+            optimizeChain(optimizer, subRuleTree);
+            if (!node->nextNode || isChainIsolationFree(subRuleTree)) node = replaceNodeWithChain(node, subRuleTree);
+        } else if ((node->type == NCC_NodeType.SUBSTITUTE) && isInlinable(optimizer, node)) {
+            node = inlineSubstituteNode(optimizer, node);
         }
     }
 
-    return matched;
+    // Merging is left to the end, once inlining and flattening brought together all they could,
+    for (NCC_Node* node = tree->nextNode; node; node = node->nextNode) {
+        if (node->type == NCC_NodeType.LITERALS) mergeFollowingLiteralsNodes(node);
+    }
+}
+
+int32_t NCC_optimizeRules(struct NCC* ncc) {
+
+    RuleOptimizer optimizer = { .ncc=ncc, .inlinedNodesCount=0 };
+    NVector.initialize(&optimizer.inliningStack, 0, sizeof(NCC_Rule*));
+    int32_t rulesCount = NVector.size(&ncc->rules);
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = NCC_getRuleById(ncc, i);
+        NVector.pushBack(&optimizer.inliningStack, &rule);
+        optimizeChain(&optimizer, rule->tree);
+        NVector.clear(&optimizer.inliningStack);
+    }
+    NVector.destroy(&optimizer.inliningStack);
+
+    for (int32_t i=0; i<rulesCount; i++) {
+        NCC_Rule* rule = NCC_getRuleById(ncc, i);
+        compileRuleTree(rule->tree, &rule->program);
+    }
+    ncc->rulesAnalyzed = False;
+    return optimizer.inlinedNodesCount;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -2061,6 +5321,7 @@ void* NCC_createASTNode(NCC_RuleData* ruleData, NCC_ASTNode_Data* astParentNodeD
     NString.initialize(&astNode->value, "not set yet");
     NVector.initialize(&astNode->childNodes, 0, sizeof(NCC_ASTNode*));
     astNode->rule = ruleData;
+    astNode->arena = 0;
 
     // Attach this node to the parent. Again, this is our user-defined implementation, which
     // supports having children,
@@ -2073,11 +5334,27 @@ void* NCC_createASTNode(NCC_RuleData* ruleData, NCC_ASTNode_Data* astParentNodeD
     return astNode;
 }
 
+// Removes a node from a vector of child node pointers,
+static inline void removeChildNode(struct NVector* childNodes, void* childNode) {
+
+    // Rollback is LIFO, so check the last child first,
+    int32_t childrenCount = NVector.size(childNodes);
+    if (childrenCount && *((void**) NVector.get(childNodes, childrenCount-1)) == childNode) {
+        NVector.resize(childNodes, childrenCount-1);
+        return;
+    }
+
+    int32_t nodeIndex = NVector.getFirstInstanceIndex(childNodes, &childNode);
+    if (nodeIndex!=-1) NVector.remove(childNodes, nodeIndex);
+}
+
 static inline void deleteASTNode(NCC_ASTNode* astNode, NCC_ASTNode_Data* astParentNodeData) {
 
-    // Destroy members,
-    NString.destroy(&astNode->name);
-    NString.destroy(&astNode->value);
+    // Destroy members. Arena nodes keep them to be reused,
+    if (!astNode->arena) {
+        NString.destroy(&astNode->name);
+        NString.destroy(&astNode->value);
+    }
 
     // Delete children. Luckily, the last AST node to be created is the first to be deleted. So, if
     // all nodes on a stack are being deleted, the children are collected first (and detached from
@@ -2103,17 +5380,18 @@ static inline void deleteASTNode(NCC_ASTNode* astNode, NCC_ASTNode_Data* astPare
             currentChild->rule->deleteASTNodeListener(&nodeData, &parentNodeData);
         }
     }
-    NVector.destroy(&astNode->childNodes);
 
     // Delete node,
-    NFREE(astNode, "NCC.NCC_deleteASTNode() astNode");
-
-    // Remove from parent (if any),
-    if (astParentNodeData) {
-        NCC_ASTNode* parentASTNode = astParentNodeData->node;
-        int32_t nodeIndex = NVector.getFirstInstanceIndex(&parentASTNode->childNodes, &astNode);
-        if (nodeIndex!=-1) NVector.remove(&parentASTNode->childNodes, nodeIndex);
+    if (astNode->arena) {
+        NVector.pushBack(&astNode->arena->freeNodes, &astNode);
+    } else {
+        NVector.destroy(&astNode->childNodes);
+        NFREE(astNode, "NCC.NCC_deleteASTNode() astNode");
     }
+
+    // Remove from parent (if any). Nodes are deleted in the reverse order of their creation, so
+    // it's almost always the last child. Avoid searching the children if so,
+    if (astParentNodeData) removeChildNode(&((NCC_ASTNode*) astParentNodeData->node)->childNodes, astNode);
 }
 
 void NCC_deleteASTNode(NCC_ASTNode_Data* node, NCC_ASTNode_Data* astParentNode) {
@@ -2127,17 +5405,100 @@ boolean NCC_matchASTNode(NCC_MatchingData* matchingData) {
     // listener is called is the value defined. Set the value here. You may also alter the match
     // length or terminate the matching,
     NCC_ASTNode* astNode = matchingData->node.node;
-    NString.set(&astNode->value, "%s", matchingData->matchedText);
+    NCC_getMatchedText(matchingData, &astNode->value);
+    return True;
+}
+
+// Span-based nodes,
+void* NCC_createSpanASTNode(NCC_RuleData* ruleData, NCC_ASTNode_Data* astParentNodeData) {
+
+    // Only the rule is kept, no names or values are copied,
+    NCC_SpanASTNode* astNode = NMALLOC(sizeof(NCC_SpanASTNode), "NCC.NCC_createSpanASTNode() astNode");
+    astNode->rule = ruleData;
+    astNode->valueStart = 0;
+    astNode->valueLength = 0;
+    NVector.initialize(&astNode->childNodes, 0, sizeof(NCC_SpanASTNode*));
+    astNode->extraData = 0;
+
+    if (astParentNodeData) {
+        NCC_SpanASTNode* parentASTNode = astParentNodeData->node;
+        NVector.pushBack(&parentASTNode->childNodes, &astNode);
+    }
+
+    return astNode;
+}
+
+static void deleteSpanASTNode(NCC_SpanASTNode* astNode, NCC_ASTNode_Data* astParentNodeData) {
+
+    // Delete children (see deleteASTNode()),
+    NCC_SpanASTNode* currentChild;
+    while (NVector.popBack(&astNode->childNodes, &currentChild)) {
+        if (currentChild->rule->deleteASTNodeListener == NCC_deleteSpanASTNode) {
+            deleteSpanASTNode(currentChild, 0);
+        } else if (currentChild->rule->deleteASTNodeListener) {
+            NCC_ASTNode_Data nodeData;
+            nodeData.node = currentChild;
+            nodeData.rule = currentChild->rule;
+            NCC_ASTNode_Data parentNodeData;
+            parentNodeData.node = astNode;
+            parentNodeData.rule = astNode->rule;
+            currentChild->rule->deleteASTNodeListener(&nodeData, &parentNodeData);
+        }
+    }
+    NVector.destroy(&astNode->childNodes);
+    NFREE(astNode, "NCC.NCC_deleteSpanASTNode() astNode");
+
+    // Remove from parent (if any),
+    if (astParentNodeData) removeChildNode(&((NCC_SpanASTNode*) astParentNodeData->node)->childNodes, astNode);
+}
+
+void NCC_deleteSpanASTNode(NCC_ASTNode_Data* node, NCC_ASTNode_Data* astParentNode) {
+    if (!node->node) return;
+    deleteSpanASTNode((NCC_SpanASTNode*) node->node, astParentNode);
+}
+
+boolean NCC_matchSpanASTNode(NCC_MatchingData* matchingData) {
+    NCC_SpanASTNode* astNode = matchingData->node.node;
+    astNode->valueStart = matchingData->matchedTextStart;
+    astNode->valueLength = matchingData->matchedTextLength;
     return True;
 }
 
+const char* NCC_getSpanASTNodeValue(NCC_SpanASTNode* node, struct NString* outValue) {
+    if (!node->valueStart) return NString.set(outValue, "not set yet");
+    NCC_MatchingData matchingData;
+    matchingData.matchedTextStart = node->valueStart;
+    matchingData.matchedTextLength = node->valueLength;
+    return NCC_getMatchedText(&matchingData, outValue);
+}
+
+void NCC_getSpanASTNodeLocation(NCC_SpanASTNode* node, const char* text, int32_t* outLine, int32_t* outColumn) {
+    int32_t line=1, column=1;
+    for (const char* currentChar=text; currentChar<node->valueStart; currentChar++) {
+        if (*currentChar == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+    *outLine = line;
+    *outColumn = column;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Pretty printing trees
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// TODO: convert into a generic function that can print any PrintableTree { data, getChild(index), getChildrenCount(), getName(), getValue() ...etc },
-//       then create NCC_ASTTreeToString() that wraps NCC_ASTNode in PrintableTree and uses it.
-void NCC_ASTTreeToString(NCC_ASTNode* tree, struct NString* prefix, struct NString* outString, boolean printColored) {
+// Describes how to get the details of the nodes of a tree to be printed,
+typedef struct PrintableTree {
+    void* context;                                                                  // Passed to all the functions below.
+    const char* (*getName)(void* context, void* node);
+    const char* (*getValue)(void* context, void* node, struct NString* temp);       // May use temp to hold the value.
+    struct NVector* (*getChildNodes)(void* context, void* node, struct NVector* temp); // Pointers to nodes. May use temp to hold them.
+} PrintableTree;
+
+static void treeToString(void* tree, const PrintableTree* printableTree, struct NString* prefix, struct NString* outString, boolean printColored) {
 
     // Unicode box drawing block:
     // Single Lines:
@@ -2175,16 +5536,22 @@ void NCC_ASTTreeToString(NCC_ASTNode* tree, struct NString* prefix, struct NStri
     const char* childrenPrefixCString = NString.get(childrenPrefix);
 
     // Prepare node name,
-    struct NString *nodeName = NString.replace(NString.get(&tree->name), "\n", "\\n");
+    struct NString *nodeName = NString.replace(printableTree->getName(printableTree->context, tree), "\n", "\\n");
 
     // Tree value could span multiple lines, remove line-breaks,
-    int32_t childrenCount = NVector.size(&tree->childNodes);
-    boolean containsLineBreak = NCString.contains(NString.get(&tree->value), "\n");
+    struct NString valueTemp;
+    NString.initialize(&valueTemp, "");
+    const char* value = printableTree->getValue(printableTree->context, tree, &valueTemp);
+    struct NVector childNodesTemp;
+    NVector.initialize(&childNodesTemp, 0, sizeof(void*));
+    struct NVector* childNodes = printableTree->getChildNodes(printableTree->context, tree, &childNodesTemp);
+    int32_t childrenCount = NVector.size(childNodes);
+    boolean containsLineBreak = NCString.contains(value, "\n");
     if (containsLineBreak) {
         struct NString  temp1;
         struct NString *temp2;
         NString.initialize(&temp1, "\n%s%s", childrenPrefixCString, childrenCount ? "│" : " ");
-        temp2 = NString.replace(NString.get(&tree->value), "\n", NString.get(&temp1));
+        temp2 = NString.replace(value, "\n", NString.get(&temp1));
         NString.append(outString, "%s:%s%s", NString.get(nodeName), NString.get(&temp1), NString.get(temp2));
         if (!NCString.endsWith(NString.get(temp2), "│")) NString.append(outString, "%s", NString.get(&temp1));
         NString.append(outString, "\n");
@@ -2192,13 +5559,14 @@ void NCC_ASTTreeToString(NCC_ASTNode* tree, struct NString* prefix, struct NStri
         NString.destroyAndFree(temp2);
     } else {
         if (printColored) {
-            NString.append(outString, "%s: %s%s%s\n", NString.get(nodeName), NTCOLOR(BLUE_BACKGROUND), NString.get(&tree->value), NTCOLOR(STREAM_DEFAULT));
+            NString.append(outString, "%s: %s%s%s\n", NString.get(nodeName), NTCOLOR(BLUE_BACKGROUND), value, NTCOLOR(STREAM_DEFAULT));
         } else {
-            NString.append(outString, "%s: %s\n", NString.get(nodeName), NString.get(&tree->value));
+            NString.append(outString, "%s: %s\n", NString.get(nodeName), value);
         }
     }
 
     NString.destroyAndFree(nodeName);
+    NString.destroy(&valueTemp);
 
     // Print children,
     struct NString childPrefix;
@@ -2206,8 +5574,8 @@ void NCC_ASTTreeToString(NCC_ASTNode* tree, struct NString* prefix, struct NStri
     for (int32_t i=0; i<childrenCount; i++) {
         boolean lastChild = (i==(childrenCount-1));
         NString.set(&childPrefix, "%s%s", childrenPrefixCString, lastChild ? "└─" : "├─");
-        NCC_ASTNode* currentChild = *((NCC_ASTNode**) NVector.get(&tree->childNodes, i));
-        NCC_ASTTreeToString(currentChild, &childPrefix, outString, printColored);
+        void* currentChild = *((void**) NVector.get(childNodes, i));
+        treeToString(currentChild, printableTree, &childPrefix, outString, printColored);
     }
 
     // Extra line break if this was the last child of its parent,
@@ -2219,6 +5587,25 @@ void NCC_ASTTreeToString(NCC_ASTNode* tree, struct NString* prefix, struct NStri
 
     NString.destroyAndFree(childrenPrefix);
     NString.destroy(&childPrefix);
+    NVector.destroy(&childNodesTemp);
+}
+
+static const char* getASTNodeName(void* context, void* node) { return NString.get(&((NCC_ASTNode*) node)->name); }
+static const char* getASTNodeValue(void* context, void* node, struct NString* temp) { return NString.get(&((NCC_ASTNode*) node)->value); }
+static struct NVector* getASTNodeChildNodes(void* context, void* node, struct NVector* temp) { return &((NCC_ASTNode*) node)->childNodes; }
+
+void NCC_ASTTreeToString(NCC_ASTNode* tree, struct NString* prefix, struct NString* outString, boolean printColored) {
+    static const PrintableTree printableTree = { 0, getASTNodeName, getASTNodeValue, getASTNodeChildNodes };
+    treeToString(tree, &printableTree, prefix, outString, printColored);
+}
+
+static const char* getSpanASTNodeName(void* context, void* node) { return NString.get(&((NCC_SpanASTNode*) node)->rule->ruleName); }
+static const char* getSpanASTNodeValue(void* context, void* node, struct NString* temp) { return NCC_getSpanASTNodeValue(node, temp); }
+static struct NVector* getSpanASTNodeChildNodes(void* context, void* node, struct NVector* temp) { return &((NCC_SpanASTNode*) node)->childNodes; }
+
+void NCC_SpanASTTreeToString(NCC_SpanASTNode* tree, struct NString* prefix, struct NString* outString, boolean printColored) {
+    static const PrintableTree printableTree = { 0, getSpanASTNodeName, getSpanASTNodeValue, getSpanASTNodeChildNodes };
+    treeToString(tree, &printableTree, prefix, outString, printColored);
 }
 
 // TODO: print tree ....
@@ -2227,3 +5614,143 @@ void NCC_ASTTreeToString(NCC_ASTNode* tree, struct NString* prefix, struct NStri
 //    │     ├─── tree node
 //    │     └─── tree node
 //    └─── tree node
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Flat ASTs
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define NCC_FLAT_AST_ARRAYS_COUNT 5
+
+NCC_FlatAST* NCC_initializeFlatAST(NCC_FlatAST* ast) {
+    NSystemUtils.memset(ast, 0, sizeof(NCC_FlatAST));
+    return ast;
+}
+
+void NCC_destroyFlatAST(NCC_FlatAST* ast) {
+    // All arrays live in the same block,
+    if (ast->ruleIds) NFREE(ast->ruleIds, "NCC.NCC_destroyFlatAST() arrays");
+    NCC_initializeFlatAST(ast);
+}
+
+static void setFlatASTArrays(NCC_FlatAST* ast, int32_t* block) {
+    ast->ruleIds       = block;
+    ast->offsets       = &block[ast->capacity  ];
+    ast->lengths       = &block[ast->capacity*2];
+    ast->firstChildren = &block[ast->capacity*3];
+    ast->nextSiblings  = &block[ast->capacity*4];
+}
+
+static int32_t addFlatASTNode(NCC_FlatAST* ast, int32_t ruleId, int32_t offset, int32_t length) {
+
+    // Grow all the arrays at once, in a single block,
+    if (ast->nodesCount == ast->capacity) {
+        NCC_FlatAST oldAST = *ast;
+        ast->capacity = oldAST.capacity ? oldAST.capacity*2 : 256;
+        int32_t* block = NMALLOC(sizeof(int32_t) * ast->capacity * NCC_FLAT_AST_ARRAYS_COUNT, "NCC.addFlatASTNode() arrays");
+        setFlatASTArrays(ast, block);
+        if (oldAST.ruleIds) {
+            int32_t arraySize = sizeof(int32_t) * oldAST.nodesCount;
+            NSystemUtils.memcpy(ast->ruleIds      , oldAST.ruleIds      , arraySize);
+            NSystemUtils.memcpy(ast->offsets      , oldAST.offsets      , arraySize);
+            NSystemUtils.memcpy(ast->lengths      , oldAST.lengths      , arraySize);
+            NSystemUtils.memcpy(ast->firstChildren, oldAST.firstChildren, arraySize);
+            NSystemUtils.memcpy(ast->nextSiblings , oldAST.nextSiblings , arraySize);
+            NFREE(oldAST.ruleIds, "NCC.addFlatASTNode() arrays");
+        }
+    }
+
+    int32_t node = ast->nodesCount++;
+    ast->ruleIds      [node] = ruleId;
+    ast->offsets      [node] = offset;
+    ast->lengths      [node] = length;
+    ast->firstChildren[node] = -1;
+    ast->nextSiblings [node] = -1;
+    return node;
+}
+
+// Appends the nodes of a match record (and its children) in preorder. The records of rules that
+// don't create AST nodes add no nodes, their children are appended in their place. "in_out_lastNode"
+// is the last node appended under the same parent (-1 if none), to link siblings,
+static void appendFlatASTNodes(struct NCC* ncc, NCC_FlatAST* ast, int32_t recordIndex, int32_t parentNode, int32_t* in_out_lastNode) {
+
+    MatchRecord record = *((MatchRecord*) NVector.get(&ncc->matchRecords, recordIndex));
+    int32_t childrenParentNode = parentNode;
+    int32_t* childrenLastNode = in_out_lastNode;
+    int32_t lastChildNode = -1;
+    if (record.rule->data.createASTNodeListener) {
+        int32_t node = addFlatASTNode(ast, record.rule->data.ruleId, record.textOffset, record.matchLength);
+        if (*in_out_lastNode != -1) {
+            ast->nextSiblings[*in_out_lastNode] = node;
+        } else if (parentNode != -1) {
+            ast->firstChildren[parentNode] = node;
+        }
+        *in_out_lastNode = node;
+        childrenParentNode = node;
+        childrenLastNode = &lastChildNode;
+    }
+
+    for (int32_t i=0; i<record.childrenCount; i++) {
+        int32_t childRecordIndex = *((int32_t*) NVector.get(&ncc->matchRecordChildren, record.firstChildIndex + i));
+        appendFlatASTNodes(ncc, ast, childRecordIndex, childrenParentNode, childrenLastNode);
+    }
+}
+
+// Builds the flat AST from the match record markers left on NCC's AST stack (see match()),
+static void buildFlatAST(struct NCC* ncc, NCC_FlatAST* ast, const char* text) {
+    ast->ncc = ncc;
+    ast->text = text;
+    ast->nodesCount = 0;
+
+    struct NVector* markers = &ncc->astNodeStack;
+    int32_t markersCount = NVector.size(markers);
+    int32_t lastNode = -1;
+    for (int32_t i=0; i<markersCount; i++) {
+        NCC_ASTNode_Data* entry = NVector.get(markers, i);
+        if (entry->rule == &matchRecordMarker) appendFlatASTNodes(ncc, ast, (int32_t) (intptr_t) entry->node, -1, &lastNode);
+    }
+}
+
+NCC_RuleData* NCC_getFlatASTNodeRule(NCC_FlatAST* ast, int32_t node) {
+    return &NCC_getRuleById(ast->ncc, ast->ruleIds[node])->data;
+}
+
+const char* NCC_getFlatASTNodeValue(NCC_FlatAST* ast, int32_t node, struct NString* outValue) {
+    NCC_MatchingData matchingData;
+    matchingData.matchedTextStart = &ast->text[ast->offsets[node]];
+    matchingData.matchedTextLength = ast->lengths[node];
+    return NCC_getMatchedText(&matchingData, outValue);
+}
+
+static void visitFlatASTNode(NCC_FlatAST* ast, int32_t node, int32_t depth, NCC_FlatASTVisitor visitor, void* data) {
+    if (!visitor(ast, node, depth, data)) return;
+    for (int32_t child=ast->firstChildren[node]; child!=-1; child=ast->nextSiblings[child]) visitFlatASTNode(ast, child, depth+1, visitor, data);
+}
+
+void NCC_visitFlatAST(NCC_FlatAST* ast, NCC_FlatASTVisitor visitor, void* data) {
+    if (!ast->nodesCount) return;
+    for (int32_t node=0; node!=-1; node=ast->nextSiblings[node]) visitFlatASTNode(ast, node, 0, visitor, data);
+}
+
+// Flat AST nodes are passed to treeToString() as indices cast to pointers,
+static const char* getFlatASTNodeName(void* context, void* node) {
+    return NString.get(&NCC_getFlatASTNodeRule(context, (int32_t) (intptr_t) node)->ruleName);
+}
+
+static const char* getFlatASTNodeValue(void* context, void* node, struct NString* temp) {
+    return NCC_getFlatASTNodeValue(context, (int32_t) (intptr_t) node, temp);
+}
+
+static struct NVector* getFlatASTNodeChildNodes(void* context, void* node, struct NVector* temp) {
+    NCC_FlatAST* ast = context;
+    for (int32_t child=ast->firstChildren[(intptr_t) node]; child!=-1; child=ast->nextSiblings[child]) {
+        void* childNode = (void*) (intptr_t) child;
+        NVector.pushBack(temp, &childNode);
+    }
+    return temp;
+}
+
+void NCC_FlatASTToString(NCC_FlatAST* ast, struct NString* prefix, struct NString* outString, boolean printColored) {
+    if (!ast->nodesCount) return;
+    PrintableTree printableTree = { ast, getFlatASTNodeName, getFlatASTNodeValue, getFlatASTNodeChildNodes };
+    for (int32_t node=0; node!=-1; node=ast->nextSiblings[node]) treeToString((void*) (intptr_t) node, &printableTree, prefix, outString, printColored);
+}